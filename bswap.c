@@ -0,0 +1,164 @@
+/* bswap.c
+ *
+ * Bulk byte-swapping of ELF64 tables, see bswap.h.
+ *
+ * A layout is the list of its struct's field widths.  At start-up each one
+ * is turned into a byte permutation of one entry and, from that, the pshufb
+ * masks for a block of entries that ends on a 16-byte boundary: lcm( size,
+ * 16 ) bytes, e.g. two Elf64_Phdr in seven lanes.  ELF fields are naturally
+ * aligned, so no field straddles a lane and each lane is one shuffle.  The
+ * AVX2 kernel does two such blocks per step, since vpshufb shuffles within
+ * 128-bit halves.  Entries left over after the last whole block go through
+ * the scalar loop.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>     // memcpy(3)
+#include <stdint.h>     // uint16_t and friends
+#include <pthread.h>    // pthread_once(3)
+#include "bswap.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>  // _mm_*, _mm256_*
+#endif
+
+#define MAX_ENTSIZE (64)        // Elf64_Shdr
+#define MAX_LANES (7)           // Elf64_Phdr: 56 bytes is 7 lanes of 16
+
+struct layout {
+    size_t size;
+    unsigned char fields[12];   // Widths in bytes, 0-terminated
+
+    // Built by pick_kernel().
+    size_t lanes;               // Per block; 0 if fields straddle lanes
+    unsigned char lane_mask[MAX_LANES][16];
+    unsigned char ymm_mask[MAX_LANES][32];
+};
+
+static struct layout layouts[] = {
+    [BSWAP_DYN]  = { 16, { 8, 8 } },
+    [BSWAP_PHDR] = { 56, { 4, 4, 8, 8, 8, 8, 8, 8 } },
+    [BSWAP_SHDR] = { 64, { 4, 4, 8, 8, 8, 8, 4, 4, 8, 8 } },
+};
+
+typedef void (*swap_fn)( struct layout const *l, unsigned char *dst,
+        unsigned char const *src, size_t n );
+
+static void
+swap_scalar( struct layout const *l, unsigned char *dst, unsigned char const *src, size_t n ){
+    for( size_t i = 0; i < n; i++, src += l->size, dst += l->size ){
+        size_t off = 0;
+        for( unsigned char const *w = l->fields; *w; off += *w++ ){
+            uint16_t v16;
+            uint32_t v32;
+            uint64_t v64;
+            switch( *w ){
+                case 1: dst[off] = src[off]; break;
+                case 2: memcpy( &v16, src + off, 2 ); v16 = __builtin_bswap16( v16 ); memcpy( dst + off, &v16, 2 ); break;
+                case 4: memcpy( &v32, src + off, 4 ); v32 = __builtin_bswap32( v32 ); memcpy( dst + off, &v32, 4 ); break;
+                case 8: memcpy( &v64, src + off, 8 ); v64 = __builtin_bswap64( v64 ); memcpy( dst + off, &v64, 8 ); break;
+            }
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("ssse3")))
+static void
+swap_ssse3( struct layout const *l, unsigned char *dst, unsigned char const *src, size_t n ){
+    size_t block = 16 * l->lanes, per_block = block / l->size, i = 0;
+    __m128i mask[MAX_LANES];
+
+    for( size_t k = 0; k < l->lanes; k++ ){
+        mask[k] = _mm_loadu_si128( (__m128i const *)l->lane_mask[k] );
+    }
+    for( ; l->lanes && i + per_block <= n; i += per_block, src += block, dst += block ){
+        for( size_t k = 0; k < l->lanes; k++ ){
+            __m128i v = _mm_loadu_si128( (__m128i const *)( src + 16 * k ) );
+            _mm_storeu_si128( (__m128i *)( dst + 16 * k ), _mm_shuffle_epi8( v, mask[k] ) );
+        }
+    }
+    swap_scalar( l, dst, src, n - i );
+}
+
+__attribute__((target("avx2")))
+static void
+swap_avx2( struct layout const *l, unsigned char *dst, unsigned char const *src, size_t n ){
+    size_t block = 32 * l->lanes, per_block = block / l->size, i = 0;
+    __m256i mask[MAX_LANES];
+
+    for( size_t k = 0; k < l->lanes; k++ ){
+        mask[k] = _mm256_loadu_si256( (__m256i const *)l->ymm_mask[k] );
+    }
+    for( ; l->lanes && i + per_block <= n; i += per_block, src += block, dst += block ){
+        for( size_t k = 0; k < l->lanes; k++ ){
+            __m256i v = _mm256_loadu_si256( (__m256i const *)( src + 32 * k ) );
+            _mm256_storeu_si256( (__m256i *)( dst + 32 * k ), _mm256_shuffle_epi8( v, mask[k] ) );
+        }
+    }
+    swap_scalar( l, dst, src, n - i );
+}
+
+#endif // __x86_64__
+
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+static swap_fn swap = swap_scalar;
+
+// Fill in the shuffle masks of l, or leave lanes at 0 if a field would
+// straddle two lanes.
+static void
+build_masks( struct layout *l ){
+    unsigned char perm[MAX_ENTSIZE];
+    size_t off = 0, g = 1, a = l->size, b = 16, lanes;
+
+    // Byte i of a swapped entry is byte perm[i] of the original.
+    for( unsigned char const *w = l->fields; *w; off += *w++ ){
+        for( size_t j = 0; j < *w; j++ ){
+            perm[ off + j ] = off + *w - 1 - j;
+        }
+    }
+    while( b ){
+        g = a % b;
+        a = b;
+        b = g;
+    }
+    lanes = l->size / a;            // lcm( size, 16 ) / 16
+    for( size_t k = 0; k < lanes; k++ ){
+        for( size_t j = 0; j < 16; j++ ){
+            size_t at = 16 * k + j, in_entry = at % l->size;
+            size_t from = at - in_entry + perm[ in_entry ];
+            if( from < 16 * k || from >= 16 * ( k + 1 ) ){
+                return;
+            }
+            l->lane_mask[k][j] = from - 16 * k;
+        }
+    }
+    // Two blocks per 256-bit step: lane L of the pair uses mask L % lanes.
+    for( size_t k = 0; k < lanes; k++ ){
+        memcpy( l->ymm_mask[k], l->lane_mask[ ( 2 * k ) % lanes ], 16 );
+        memcpy( l->ymm_mask[k] + 16, l->lane_mask[ ( 2 * k + 1 ) % lanes ], 16 );
+    }
+    l->lanes = lanes;
+}
+
+static void
+pick_kernel( void ){
+    for( size_t i = 0; i < BSWAP_NLAYOUTS; i++ ){
+        build_masks( &layouts[i] );
+    }
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) ){
+        swap = swap_avx2;
+    }else if( __builtin_cpu_supports( "ssse3" ) ){
+        swap = swap_ssse3;
+    }
+#endif
+}
+
+void
+bswap_table( enum bswap_layout l, void *dst, void const *src, size_t n ){
+    pthread_once( &kernel_once, pick_kernel );
+    swap( &layouts[l], dst, src, n );
+}
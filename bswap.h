@@ -0,0 +1,32 @@
+/* bswap.h
+ *
+ * Bulk byte-swapping of ELF64 tables.  For an ELF64 file of the other byte
+ * order every struct has the native layout with each field reversed, so a
+ * whole table converts with one byte shuffle per 16 bytes and no per-field
+ * work.  The kernel is picked once at run time: AVX2 or SSSE3 on x86-64
+ * when the CPU has them, scalar otherwise.
+ *
+ * Only the tables pe_open() converts are covered.  Symbol and relocation
+ * tables are decoded entry by entry where they are read: converting them
+ * in bulk first measured no faster, since page faults on the copy cost
+ * more than the per-field swaps it saves.
+ */
+#ifndef BSWAP_H
+#define BSWAP_H
+
+#include <stddef.h>     // size_t
+
+// The tables that can be swapped, each an array of the Elf64 struct.
+enum bswap_layout {
+    BSWAP_DYN = 0,      // Elf64_Dyn
+    BSWAP_PHDR,         // Elf64_Phdr
+    BSWAP_SHDR,         // Elf64_Shdr
+    BSWAP_NLAYOUTS
+};
+
+// Write n entries of src, with every field byte-reversed, to dst.  The
+// tables may be unaligned; dst may equal src but must not otherwise
+// overlap it.
+void bswap_table( enum bswap_layout l, void *dst, void const *src, size_t n );
+
+#endif // BSWAP_H
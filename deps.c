@@ -0,0 +1,805 @@
+/* deps.c
+ *
+ * DT_NEEDED closure resolution, see deps.h.
+ *
+ * Every path probed while searching is remembered, including the ones where
+ * nothing was found, and every file found is keyed by device and inode, so
+ * a library reached through a symlink, the cache and a search directory is
+ * still one struct dep_lib.  Loading happens outside the lock; a thread
+ * that asks for a library someone else is still loading waits for it.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>     // malloc(3), calloc(3), realloc(3), free(3), getenv(3), qsort(3)
+#include <string.h>     // memcmp(3), memcpy(3), strchr(3), strrchr(3), strcmp(3), strdup(3)
+#include <stdint.h>     // uint64_t and friends
+#include <stdbool.h>    // bool, true, false
+#include <ctype.h>      // isalnum(3)
+#include <limits.h>     // PATH_MAX
+#include <assert.h>     // assert(3)
+#include <sys/types.h>  // stat(2), open(2)
+#include <sys/stat.h>   // stat(2), fstat(2)
+#include <fcntl.h>      // open(2)
+#include <unistd.h>     // close(2)
+#include <sys/mman.h>   // mmap(2), munmap(2)
+#include <pthread.h>    // pthread_mutex_lock(3) and friends
+#include <stdatomic.h>  // atomic_bool, atomic_exchange(3)
+#include "deps.h"
+#include "libparse_elf.h"
+
+#define LD_CACHE_PATH "/etc/ld.so.cache"
+
+struct dep_lib {
+    struct dep_lib *next;           // Every library, for deps_destroy()
+    struct deps *d;
+    char *path;                     // The path it was first found under
+    bool loading;                   // Under d->lock
+    int err;                        // PE_* result of opening it
+    atomic_bool prefetched;         // Dependencies queued for loading
+
+    uint16_t machine;
+    uint8_t elfclass;
+    int32_t cache_flags;            // What its ld.so wants in ld.so.cache
+    bool nodeflib;                  // DF_1_NODEFLIB
+    char const *soname;             // These point into strs, NULL if absent
+    char const *rpath;
+    char const *runpath;
+    char const **needed;
+    size_t nneeded;
+    char *strs;
+};
+
+// Everything probed, by path.  lib is NULL where nothing was found.
+struct path_slot {
+    char *path;
+    struct dep_lib *lib;
+    uint64_t hash;
+};
+
+struct ino_slot {
+    dev_t dev;
+    ino_t ino;
+    struct dep_lib *lib;            // NULL for an empty slot
+};
+
+/* /etc/ld.so.cache in the "glibc-ld.so.cache1.1" format, possibly after an
+ * old-format ("ld.so-1.7.0") block.  String offsets are relative to the
+ * start of the new-format header.
+ */
+#define LD_CACHE_MAGIC_OLD "ld.so-1.7.0"
+#define LD_CACHE_MAGIC_NEW "glibc-ld.so.cache1.1"
+#define LD_CACHE_OLD_HDR_SZ (16)
+#define LD_CACHE_OLD_ENTRY_SZ (12)
+#define LD_CACHE_NEW_HDR_SZ (48)
+#define LD_CACHE_NEW_ENTRY_SZ (24)  // int32 flags, uint32 key, value, osversion, uint64 hwcap
+
+struct ld_cache_entry {
+    int32_t flags;
+    uint32_t key;
+    uint32_t value;
+    uint32_t osversion;
+    uint64_t hwcap;
+};
+
+struct ld_cache {
+    unsigned char const *map;
+    size_t map_size;
+    unsigned char const *base;      // New-format header; strings are relative to it
+    size_t base_len;
+    unsigned char const *entries;
+    uint32_t nlibs;
+    uint32_t *slots;                // Entry index + 1 by key hash, 0 = empty
+    size_t mask;
+};
+
+struct root_task {
+    struct deps *d;
+    char const *path;
+};
+
+struct deps {
+    struct pool *pool;
+    char *sysroot;                  // "" if none
+    char *ld_library_path;          // NULL if unset
+    struct ld_cache cache;
+
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;          // Some library finished loading
+    struct dep_lib *libs;
+    struct path_slot *paths;
+    size_t npaths, paths_mask;
+    struct ino_slot *inos;
+    size_t ninos, inos_mask;
+    char **roots;
+    size_t nroots, roots_cap;
+};
+
+// FNV-1a
+static uint64_t
+hash_str( char const *s ){
+    uint64_t h = 14695981039346656037ull;
+    for( ; *s; s++ ){
+        h = ( h ^ (unsigned char)*s ) * 1099511628211ull;
+    }
+    return h;
+}
+
+static uint64_t
+hash_ino( dev_t dev, ino_t ino ){
+    return ( (uint64_t)ino * 0x9e3779b97f4a7c15ull ) ^ (uint64_t)dev;
+}
+
+/* ld.so.cache */
+
+// _DL_CACHE_DEFAULT_ID of the ld.so that would load a program like e: the
+// flag ldconfig gives that ABI's libraries plus FLAG_ELF_LIBC6.  ABIs with
+// no flag of their own (i386, 31-bit s390, ...) are plain FLAG_ELF_LIBC6.
+static int32_t
+cache_flags_want( Elf64_Ehdr const *e ){
+    bool is64 = ELFCLASS64 == e->e_ident[EI_CLASS];
+    bool nan2008 = 0 != ( e->e_flags & EF_MIPS_NAN2008 );
+
+    switch( e->e_machine ){
+        case EM_SPARCV9:    return 0x0103;
+        case EM_IA_64:      return 0x0203;
+        case EM_X86_64:     return is64 ? 0x0303 : 0x0803;     // x32
+        case EM_S390:       return is64 ? 0x0403 : 0x0003;
+        case EM_PPC64:      return 0x0503;
+        case EM_MIPS:
+            if( is64 ){
+                return nan2008 ? 0x0e03 : 0x0703;               // n64
+            }else if( e->e_flags & EF_MIPS_ABI2 ){
+                return nan2008 ? 0x0d03 : 0x0603;               // n32
+            }
+            return nan2008 ? 0x0c03 : 0x0003;
+        case EM_ARM:
+            return ( e->e_flags & EF_ARM_ABI_FLOAT_HARD ) ? 0x0903 : 0x0b03;
+        case EM_AARCH64:    return 0x0a03;
+        case EM_RISCV:
+            return EF_RISCV_FLOAT_ABI_DOUBLE == ( e->e_flags & EF_RISCV_FLOAT_ABI ) ? 0x1003 : 0x0f03;
+        default:            return 0x0003;
+    }
+}
+
+// _dl_cache_check_flags(): only the exact ID, except that ARM's ld.so also
+// takes libraries from before the float ABI was marked.
+static bool
+cache_flags_match( int32_t flags, struct dep_lib const *req ){
+    return req->cache_flags == flags || ( EM_ARM == req->machine && 0x0003 == flags );
+}
+
+static void
+cache_entry( struct ld_cache const *c, size_t i, struct ld_cache_entry *e ){
+    memcpy( e, c->entries + i * LD_CACHE_NEW_ENTRY_SZ, sizeof( *e ) );
+}
+
+static void
+cache_open( struct ld_cache *c, char const *path ){
+    struct stat s;
+    size_t off = 0;
+    int fd = open( path, O_RDONLY | O_CLOEXEC );
+
+    if( -1 == fd ){
+        return;
+    }
+    if( -1 == fstat( fd, &s ) || 0 == s.st_size ){
+        close( fd );
+        return;
+    }
+    c->map_size = s.st_size;
+    c->map = mmap( NULL, c->map_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if( MAP_FAILED == c->map ){
+        c->map = NULL;
+        return;
+    }
+
+    if( c->map_size >= LD_CACHE_OLD_HDR_SZ
+            && 0 == memcmp( c->map, LD_CACHE_MAGIC_OLD, sizeof( LD_CACHE_MAGIC_OLD ) - 1 ) ){
+        uint32_t nold;
+        memcpy( &nold, c->map + 12, sizeof( nold ) );
+        off = ( LD_CACHE_OLD_HDR_SZ + (size_t)nold * LD_CACHE_OLD_ENTRY_SZ + 7 ) & ~(size_t)7;
+    }
+    if( off > c->map_size || c->map_size - off < LD_CACHE_NEW_HDR_SZ
+            || 0 != memcmp( c->map + off, LD_CACHE_MAGIC_NEW, sizeof( LD_CACHE_MAGIC_NEW ) - 1 ) ){
+        return;
+    }
+    c->base = c->map + off;
+    c->base_len = c->map_size - off;
+    memcpy( &c->nlibs, c->base + 20, sizeof( c->nlibs ) );
+    if( ( c->base_len - LD_CACHE_NEW_HDR_SZ ) / LD_CACHE_NEW_ENTRY_SZ < c->nlibs ){
+        c->nlibs = 0;
+        return;
+    }
+    c->entries = c->base + LD_CACHE_NEW_HDR_SZ;
+
+    // Index by name.  Entries sharing a name stay in file order along their
+    // probe sequence, which is the order ldconfig ranked them in.
+    size_t nslots = 16;
+    while( nslots < 2 * (size_t)c->nlibs ){
+        nslots *= 2;
+    }
+    c->slots = calloc( nslots, sizeof( uint32_t ) );
+    assert( NULL != c->slots );
+    c->mask = nslots - 1;
+    for( uint32_t i = 0; i < c->nlibs; i++ ){
+        struct ld_cache_entry e;
+        cache_entry( c, i, &e );
+        char const *key = pe_string( c->base, c->base_len, e.key );
+        if( NULL == key ){
+            continue;
+        }
+        size_t j = hash_str( key ) & c->mask;
+        while( c->slots[j] ){
+            j = ( j + 1 ) & c->mask;
+        }
+        c->slots[j] = i + 1;
+    }
+}
+
+static void
+cache_close( struct ld_cache *c ){
+    if( c->map ){
+        munmap( (void *)c->map, c->map_size );
+    }
+    free( c->slots );
+}
+
+/* Path and inode tables, both under d->lock. */
+
+static struct path_slot *
+path_find( struct deps *d, char const *path, uint64_t h ){
+    for( size_t j = h & d->paths_mask; ; j = ( j + 1 ) & d->paths_mask ){
+        struct path_slot *s = &d->paths[j];
+        if( NULL == s->path || ( h == s->hash && 0 == strcmp( s->path, path ) ) ){
+            return s;
+        }
+    }
+}
+
+static void
+path_insert( struct deps *d, char const *path, uint64_t h, struct dep_lib *lib ){
+    struct path_slot *s;
+
+    if( 2 * ( d->npaths + 1 ) > d->paths_mask + 1 ){
+        struct path_slot *old = d->paths;
+        size_t oldn = d->paths_mask + 1;
+        d->paths = calloc( 2 * oldn, sizeof( struct path_slot ) );
+        assert( NULL != d->paths );
+        d->paths_mask = 2 * oldn - 1;
+        for( size_t i = 0; i < oldn; i++ ){
+            if( old[i].path ){
+                *path_find( d, old[i].path, old[i].hash ) = old[i];
+            }
+        }
+        free( old );
+    }
+    s = path_find( d, path, h );
+    s->path = strdup( path );
+    assert( NULL != s->path );
+    s->lib = lib;
+    s->hash = h;
+    d->npaths++;
+}
+
+static struct ino_slot *
+ino_find( struct deps *d, dev_t dev, ino_t ino ){
+    for( size_t j = hash_ino( dev, ino ) & d->inos_mask; ; j = ( j + 1 ) & d->inos_mask ){
+        struct ino_slot *s = &d->inos[j];
+        if( NULL == s->lib || ( dev == s->dev && ino == s->ino ) ){
+            return s;
+        }
+    }
+}
+
+static void
+ino_insert( struct deps *d, dev_t dev, ino_t ino, struct dep_lib *lib ){
+    if( 2 * ( d->ninos + 1 ) > d->inos_mask + 1 ){
+        struct ino_slot *old = d->inos;
+        size_t oldn = d->inos_mask + 1;
+        d->inos = calloc( 2 * oldn, sizeof( struct ino_slot ) );
+        assert( NULL != d->inos );
+        d->inos_mask = 2 * oldn - 1;
+        for( size_t i = 0; i < oldn; i++ ){
+            if( old[i].lib ){
+                *ino_find( d, old[i].dev, old[i].ino ) = old[i];
+            }
+        }
+        free( old );
+    }
+    *ino_find( d, dev, ino ) = (struct ino_slot){ dev, ino, lib };
+    d->ninos++;
+}
+
+/* Libraries */
+
+static bool
+kept_tag( int64_t tag ){
+    return DT_NEEDED == tag || DT_SONAME == tag || DT_RPATH == tag || DT_RUNPATH == tag;
+}
+
+// Open the file and keep what resolution needs.  Nothing else about it is
+// kept, and the mapping is released before returning.
+static void
+lib_load( struct dep_lib *lib ){
+    struct pe_file *f;
+    Elf64_Dyn const *dyn;
+    unsigned char const *tab;
+    size_t ndyn, tablen, total = 0, nneeded = 0;
+    char const *s;
+    char *p;
+
+    lib->err = pe_open( lib->path, &f );
+    if( PE_OK != lib->err ){
+        return;
+    }
+    lib->machine = pe_ehdr( f )->e_machine;
+    lib->elfclass = pe_ehdr( f )->e_ident[EI_CLASS];
+    lib->cache_flags = cache_flags_want( pe_ehdr( f ) );
+    if( PE_OK != pe_dynamic( f, &dyn, &ndyn ) ){
+        pe_close( f );              // Static, nothing to resolve
+        return;
+    }
+    pe_dynamic_strtab( f, &tab, &tablen );
+    lib->nodeflib = 0 != ( pe_dynamic_value( dyn, ndyn, DT_FLAGS_1, 0 ) & DF_1_NODEFLIB );
+
+    // Size everything up, then copy it into one block.
+    for( size_t i = 0; i < ndyn; i++ ){
+        if( kept_tag( dyn[i].d_tag ) && ( s = pe_string( tab, tablen, dyn[i].d_un.d_val ) ) ){
+            total += strlen( s ) + 1;
+            nneeded += DT_NEEDED == dyn[i].d_tag;
+        }
+    }
+    lib->strs = malloc( total + 1 );
+    lib->needed = malloc( nneeded * sizeof( char const * ) + 1 );
+    assert( NULL != lib->strs && NULL != lib->needed );
+
+    p = lib->strs;
+    for( size_t i = 0; i < ndyn; i++ ){
+        if( !kept_tag( dyn[i].d_tag ) || NULL == ( s = pe_string( tab, tablen, dyn[i].d_un.d_val ) ) ){
+            continue;
+        }
+        size_t len = strlen( s ) + 1;
+        memcpy( p, s, len );
+        switch( dyn[i].d_tag ){
+            case DT_NEEDED:  lib->needed[ lib->nneeded++ ] = p; break;
+            case DT_SONAME:  lib->soname = lib->soname ? lib->soname : p; break;
+            case DT_RPATH:   lib->rpath = lib->rpath ? lib->rpath : p; break;
+            case DT_RUNPATH: lib->runpath = lib->runpath ? lib->runpath : p; break;
+        }
+        p += len;
+    }
+    pe_close( f );
+}
+
+// The library at path, loaded if this is the first time it has been seen
+// under any path.  NULL if there is no regular file at path.
+static struct dep_lib *
+lib_get( struct deps *d, char const *path ){
+    uint64_t h = hash_str( path );
+    struct path_slot *ps;
+    struct dep_lib *lib;
+
+    pthread_mutex_lock( &d->lock );
+    ps = path_find( d, path, h );
+    if( NULL != ps->path ){
+        lib = ps->lib;
+    }else{
+        // Not seen before.  stat(2) without the lock, then check nobody
+        // else got there in the meantime.
+        struct stat s;
+        pthread_mutex_unlock( &d->lock );
+        bool exists = 0 == stat( path, &s ) && S_ISREG( s.st_mode );
+        pthread_mutex_lock( &d->lock );
+
+        ps = path_find( d, path, h );
+        if( NULL != ps->path ){
+            lib = ps->lib;
+        }else if( !exists ){
+            lib = NULL;
+            path_insert( d, path, h, NULL );
+        }else if( NULL != ( lib = ino_find( d, s.st_dev, s.st_ino )->lib ) ){
+            path_insert( d, path, h, lib );
+        }else{
+            lib = calloc( 1, sizeof( struct dep_lib ) );
+            assert( NULL != lib );
+            lib->path = strdup( path );
+            assert( NULL != lib->path );
+            lib->d = d;
+            lib->loading = true;
+            lib->next = d->libs;
+            d->libs = lib;
+            ino_insert( d, s.st_dev, s.st_ino, lib );
+            path_insert( d, path, h, lib );
+            pthread_mutex_unlock( &d->lock );
+
+            lib_load( lib );
+
+            pthread_mutex_lock( &d->lock );
+            lib->loading = false;
+            pthread_cond_broadcast( &d->loaded );
+        }
+    }
+    while( NULL != lib && lib->loading ){
+        pthread_cond_wait( &d->loaded, &d->lock );
+    }
+    pthread_mutex_unlock( &d->lock );
+    return lib;
+}
+
+/* Searching */
+
+static bool
+put( char *buf, size_t *n, char const *s, size_t len ){
+    if( len >= PATH_MAX - *n ){
+        return false;
+    }
+    memcpy( buf + *n, s, len );
+    *n += len;
+    return true;
+}
+
+// Length of an $ORIGIN or ${ORIGIN} token at s, or 0.
+static size_t
+origin_token( char const *s, size_t len ){
+    if( len >= 9 && 0 == memcmp( s, "${ORIGIN}", 9 ) ){
+        return 9;
+    }
+    if( len >= 7 && 0 == memcmp( s, "$ORIGIN", 7 )
+            && ( 7 == len || !( isalnum( (unsigned char)s[7] ) || '_' == s[7] ) ) ){
+        return 7;
+    }
+    return 0;
+}
+
+// buf = dir + "/" + name, with the sysroot in front of an absolute dir and
+// $ORIGIN replaced by the directory of origin.  False if the result is too
+// long, or dir uses a token ($LIB, $PLATFORM) that isn't expanded.
+static bool
+build_path( struct deps *d, char *buf, char const *dir, size_t len,
+        struct dep_lib const *origin, char const *name ){
+    size_t n = 0;
+
+    if( 0 == len ){
+        dir = ".";
+        len = 1;
+    }else if( '/' == dir[0] && !put( buf, &n, d->sysroot, strlen( d->sysroot ) ) ){
+        return false;
+    }
+    for( size_t i = 0; i < len; ){
+        if( '$' != dir[i] ){
+            if( !put( buf, &n, dir + i, 1 ) ){
+                return false;
+            }
+            i++;
+            continue;
+        }
+        size_t tlen = origin_token( dir + i, len - i );
+        if( 0 == tlen || NULL == origin ){
+            return false;
+        }
+        char const *slash = strrchr( origin->path, '/' );
+        if( !( slash ? put( buf, &n, origin->path, slash - origin->path )
+                     : put( buf, &n, ".", 1 ) ) ){
+            return false;
+        }
+        i += tlen;
+    }
+    if( !put( buf, &n, "/", 1 ) || !put( buf, &n, name, strlen( name ) + 1 ) ){
+        return false;
+    }
+    return true;
+}
+
+// The library at path if it can satisfy a dependency of req.
+static struct dep_lib *
+candidate( struct deps *d, struct dep_lib const *req, char const *path ){
+    struct dep_lib *lib = lib_get( d, path );
+    if( NULL == lib || PE_OK != lib->err || lib->machine != req->machine
+            || lib->elfclass != req->elfclass ){
+        return NULL;
+    }
+    return lib;
+}
+
+// Look for name in each directory of the colon-separated list dirs.
+static struct dep_lib *
+search_dirs( struct deps *d, struct dep_lib const *req, struct dep_lib const *origin,
+        char const *dirs, char const *name ){
+    char buf[PATH_MAX];
+
+    for( char const *dir = dirs; ; ){
+        char const *end = strchr( dir, ':' );
+        size_t len = end ? (size_t)( end - dir ) : strlen( dir );
+        struct dep_lib *lib;
+        if( build_path( d, buf, dir, len, origin, name )
+                && NULL != ( lib = candidate( d, req, buf ) ) ){
+            return lib;
+        }
+        if( NULL == end ){
+            return NULL;
+        }
+        dir = end + 1;
+    }
+}
+
+// Look name up in ld.so.cache.  Entries sharing a name are tried in the
+// order ldconfig ranked them, until one can satisfy req; entries for
+// glibc-hwcaps subdirectories (non-zero hwcap) are passed over for the
+// baseline build.
+static struct dep_lib *
+cache_find( struct deps *d, struct dep_lib const *req, char const *name ){
+    struct ld_cache const *c = &d->cache;
+    struct dep_lib *lib;
+    char buf[PATH_MAX];
+
+    if( NULL == c->slots ){
+        return NULL;
+    }
+    for( size_t j = hash_str( name ) & c->mask; c->slots[j]; j = ( j + 1 ) & c->mask ){
+        struct ld_cache_entry e;
+        size_t len = 0;
+        cache_entry( c, c->slots[j] - 1, &e );
+        char const *key = pe_string( c->base, c->base_len, e.key );
+        char const *value = pe_string( c->base, c->base_len, e.value );
+        if( 0 != strcmp( key, name ) || 0 != e.hwcap || !cache_flags_match( e.flags, req )
+                || NULL == value ){
+            continue;
+        }
+        if( put( buf, &len, d->sysroot, strlen( d->sysroot ) )
+                && put( buf, &len, value, strlen( value ) + 1 )
+                && ( lib = candidate( d, req, buf ) ) ){
+            return lib;
+        }
+    }
+    return NULL;
+}
+
+// Find name for chain[0], whose loaders back to the root are chain[1..n).
+static struct dep_lib *
+resolve( struct deps *d, char const *name, struct dep_lib const *const *chain, size_t n ){
+    struct dep_lib const *req = chain[0];
+    struct dep_lib *lib;
+    char buf[PATH_MAX];
+    size_t len = 0;
+
+    if( strchr( name, '/' ) ){
+        if( ( '/' == name[0] && !put( buf, &len, d->sysroot, strlen( d->sysroot ) ) )
+                || !put( buf, &len, name, strlen( name ) + 1 ) ){
+            return NULL;
+        }
+        return candidate( d, req, buf );
+    }
+    if( NULL == req->runpath ){
+        for( size_t i = 0; i < n; i++ ){
+            if( chain[i]->rpath && ( lib = search_dirs( d, req, chain[i], chain[i]->rpath, name ) ) ){
+                return lib;
+            }
+        }
+    }
+    if( d->ld_library_path && ( lib = search_dirs( d, req, NULL, d->ld_library_path, name ) ) ){
+        return lib;
+    }
+    if( req->runpath && ( lib = search_dirs( d, req, req, req->runpath, name ) ) ){
+        return lib;
+    }
+    if( req->nodeflib ){
+        return NULL;
+    }
+    if( ( lib = cache_find( d, req, name ) ) ){
+        return lib;
+    }
+    return search_dirs( d, req, NULL, DEPS_SYSTEM_DIRS, name );
+}
+
+/* Prefetching.  Each library's dependencies are resolved as if it were a
+ * root, i.e. with only its own DT_RPATH; that is the answer in the actual
+ * closure unless an ancestor's DT_RPATH gets there first, in which case
+ * deps_closure() loads the difference itself.
+ */
+static void prefetch_task( void *arg );
+
+static void
+prefetch( struct dep_lib *lib ){
+    if( NULL != lib && PE_OK == lib->err && lib->nneeded
+            && !atomic_exchange( &lib->prefetched, true ) ){
+        pool_submit( lib->d->pool, prefetch_task, lib );
+    }
+}
+
+static void
+prefetch_task( void *arg ){
+    struct dep_lib const *lib = arg;
+
+    for( size_t i = 0; i < lib->nneeded; i++ ){
+        prefetch( resolve( lib->d, lib->needed[i], &lib, 1 ) );
+    }
+}
+
+static void
+root_task( void *arg ){
+    struct root_task *t = arg;
+
+    prefetch( lib_get( t->d, t->path ) );
+    free( t );
+}
+
+/* Interface */
+
+struct deps *
+deps_create( struct pool *p, char const *sysroot ){
+    struct deps *d = calloc( 1, sizeof( struct deps ) );
+    char const *llp = getenv( "LD_LIBRARY_PATH" );
+    char cache_path[PATH_MAX];
+    size_t len = 0;
+
+    assert( NULL != d );
+    d->pool = p;
+    d->sysroot = strdup( sysroot ? sysroot : "" );
+    d->ld_library_path = llp && *llp ? strdup( llp ) : NULL;
+    pthread_mutex_init( &d->lock, NULL );
+    pthread_cond_init( &d->loaded, NULL );
+    d->paths_mask = 1023;
+    d->paths = calloc( d->paths_mask + 1, sizeof( struct path_slot ) );
+    d->inos_mask = 1023;
+    d->inos = calloc( d->inos_mask + 1, sizeof( struct ino_slot ) );
+    assert( NULL != d->sysroot && NULL != d->paths && NULL != d->inos );
+
+    if( put( cache_path, &len, d->sysroot, strlen( d->sysroot ) )
+            && put( cache_path, &len, LD_CACHE_PATH, sizeof( LD_CACHE_PATH ) ) ){
+        cache_open( &d->cache, cache_path );
+    }
+    return d;
+}
+
+void
+deps_destroy( struct deps *d ){
+    for( struct dep_lib *lib = d->libs, *next; lib; lib = next ){
+        next = lib->next;
+        free( lib->path );
+        free( lib->strs );
+        free( lib->needed );
+        free( lib );
+    }
+    for( size_t i = 0; i <= d->paths_mask; i++ ){
+        free( d->paths[i].path );
+    }
+    for( size_t i = 0; i < d->nroots; i++ ){
+        free( d->roots[i] );
+    }
+    free( d->roots );
+    free( d->paths );
+    free( d->inos );
+    cache_close( &d->cache );
+    pthread_mutex_destroy( &d->lock );
+    pthread_cond_destroy( &d->loaded );
+    free( d->ld_library_path );
+    free( d->sysroot );
+    free( d );
+}
+
+void
+deps_add_root( struct deps *d, char const *path ){
+    struct root_task *t = malloc( sizeof( struct root_task ) );
+    char *copy = strdup( path );
+
+    assert( NULL != t && NULL != copy );
+    pthread_mutex_lock( &d->lock );
+    if( d->nroots == d->roots_cap ){
+        d->roots_cap = d->roots_cap ? 2 * d->roots_cap : 64;
+        d->roots = realloc( d->roots, d->roots_cap * sizeof( char * ) );
+        assert( NULL != d->roots );
+    }
+    d->roots[ d->nroots++ ] = copy;
+    pthread_mutex_unlock( &d->lock );
+
+    *t = (struct root_task){ d, copy };
+    pool_submit( d->pool, root_task, t );
+}
+
+static int
+cmp_path( void const *a, void const *b ){
+    return strcmp( *(char * const *)a, *(char * const *)b );
+}
+
+char const *const *
+deps_roots( struct deps *d, size_t *n, bool sorted ){
+    pthread_mutex_lock( &d->lock );
+    if( sorted ){
+        qsort( d->roots, d->nroots, sizeof( char * ), cmp_path );
+    }
+    *n = d->nroots;
+    pthread_mutex_unlock( &d->lock );
+    return (char const *const *)d->roots;
+}
+
+int
+deps_closure( struct deps *d, char const *root, struct deps_entry **entries, size_t *n ){
+    struct dep_lib *r = lib_get( d, root );
+    struct dep_lib **loaded;            // Load order, root first
+    size_t *parent;                     // Index in loaded of each one's loader
+    struct dep_lib const **chain;
+    struct deps_entry *out = NULL;
+    size_t nloaded = 1, cap = 16, nout = 0, outcap = 0;
+
+    *entries = NULL;
+    *n = 0;
+    if( NULL == r ){
+        return PE_ERR_OPEN;
+    }
+    if( PE_OK != r->err ){
+        return r->err;
+    }
+    loaded = malloc( cap * sizeof( *loaded ) );
+    parent = malloc( cap * sizeof( *parent ) );
+    chain = malloc( cap * sizeof( *chain ) );
+    assert( NULL != loaded && NULL != parent && NULL != chain );
+    loaded[0] = r;
+    parent[0] = 0;
+
+    // Breadth first, as the loader does.
+    for( size_t i = 0; i < nloaded; i++ ){
+        struct dep_lib *lib = loaded[i];
+        for( size_t k = 0; k < lib->nneeded; k++ ){
+            char const *name = lib->needed[k];
+            bool seen = false;
+
+            // Already satisfied by a soname, or already asked for by name
+            // (whether or not it was found).
+            for( size_t j = 0; j < nloaded && !seen; j++ ){
+                seen = loaded[j]->soname && 0 == strcmp( loaded[j]->soname, name );
+            }
+            for( size_t j = 0; j < nout && !seen; j++ ){
+                seen = 0 == strcmp( out[j].name, name );
+            }
+            if( seen ){
+                continue;
+            }
+
+            size_t depth = 0;
+            for( size_t j = i; ; j = parent[j] ){
+                chain[ depth++ ] = loaded[j];
+                if( 0 == j ){
+                    break;
+                }
+            }
+            struct dep_lib *found = resolve( d, name, chain, depth );
+
+            // The same file under another name is not loaded twice.
+            for( size_t j = 0; j < nloaded && found; j++ ){
+                if( found == loaded[j] ){
+                    found = NULL;
+                    seen = true;
+                }
+            }
+            if( nout == outcap ){
+                outcap = outcap ? 2 * outcap : 16;
+                out = realloc( out, outcap * sizeof( *out ) );
+                assert( NULL != out );
+            }
+            if( seen ){
+                continue;
+            }
+            out[ nout++ ] = (struct deps_entry){ name, found ? found->path : NULL, lib->path };
+            if( NULL == found ){
+                continue;
+            }
+            if( nloaded == cap ){
+                cap *= 2;
+                loaded = realloc( loaded, cap * sizeof( *loaded ) );
+                parent = realloc( parent, cap * sizeof( *parent ) );
+                chain = realloc( chain, cap * sizeof( *chain ) );
+                assert( NULL != loaded && NULL != parent && NULL != chain );
+            }
+            loaded[ nloaded ] = found;
+            parent[ nloaded ] = i;
+            nloaded++;
+        }
+    }
+    free( loaded );
+    free( parent );
+    free( chain );
+    *entries = out;
+    *n = nout;
+    return PE_OK;
+}
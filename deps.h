@@ -0,0 +1,65 @@
+/* deps.h
+ *
+ * DT_NEEDED closure resolution, following the search order of the glibc
+ * dynamic loader:
+ *
+ *   1. A name containing a slash is used as a path.
+ *   2. DT_RPATH of the object and of every object that loaded it, back to
+ *      the root, unless the object has DT_RUNPATH.
+ *   3. LD_LIBRARY_PATH.
+ *   4. DT_RUNPATH of the object.
+ *   5. /etc/ld.so.cache, then the system directories (DEPS_SYSTEM_DIRS),
+ *      unless the object is marked DF_1_NODEFLIB.
+ *
+ * $ORIGIN in search paths expands to the directory of the object.  A name
+ * that matches the DT_SONAME of something already in the closure is not
+ * searched for again, and candidates built for a different machine are
+ * skipped.  glibc-hwcaps subdirectories are not searched.
+ *
+ * Libraries are shared between roots.  Each is opened, parsed and reduced
+ * to the few strings resolution needs exactly once, however many roots
+ * reach it and under however many paths, and the file is unmapped again
+ * straight away.  Adding a root loads it and its dependencies on the pool
+ * in parallel; resolving a closure afterwards is a walk over cached
+ * entries.
+ */
+#ifndef DEPS_H
+#define DEPS_H
+
+#include <stddef.h>     // size_t
+#include <stdbool.h>    // bool
+#include "pool.h"
+
+#ifndef DEPS_SYSTEM_DIRS
+#define DEPS_SYSTEM_DIRS "/lib64:/usr/lib64:/lib:/usr/lib"
+#endif
+
+struct deps;
+
+// One library in a closure, in load order.  path is NULL if name could not
+// be found.  parent is the path of the object whose DT_NEEDED named it.
+struct deps_entry {
+    char const *name;
+    char const *path;
+    char const *parent;
+};
+
+// sysroot, if not NULL, is prepended to every absolute search directory and
+// to the ld.so.cache path, for resolving inside an unpacked image.
+struct deps *deps_create( struct pool *p, char const *sysroot );
+void deps_destroy( struct deps *d );
+
+// Queue path as a root and start loading its dependencies.  Safe to call
+// from pool workers.  Wait for the pool before calling deps_closure().
+void deps_add_root( struct deps *d, char const *path );
+
+// The roots added so far, sorted by path if sorted is set, otherwise in the
+// order they were added.
+char const *const *deps_roots( struct deps *d, size_t *n, bool sorted );
+
+// Resolve the closure of root (not including root itself).  Returns a
+// PE_* code for root; on PE_OK *entries is a malloc'd array of *n entries
+// whose strings live as long as d.
+int deps_closure( struct deps *d, char const *root, struct deps_entry **entries, size_t *n );
+
+#endif // DEPS_H
@@ -0,0 +1,273 @@
+/* dynamic.c
+ *
+ * PT_DYNAMIC decoding, see libparse_elf.h.
+ *
+ * The dynamic section is found through the program headers, not the
+ * section headers, since that is what the loader uses and stripped or
+ * sectionless files still have it.  Addresses it contains (DT_STRTAB and
+ * friends) are virtual addresses and are turned into file offsets through
+ * the PT_LOAD segments.
+ */
+
+#include <string.h>     // memchr(3)
+#include <stdbool.h>    // bool
+#include "libparse_elf.h"
+#include "variant.h"
+
+int
+pe_vaddr_offset( struct pe_file const *f, uint64_t vaddr, uint64_t *off ){
+    for( size_t i = 0; i < pe_phnum( f ); i++ ){
+        Elf64_Phdr const *ph = pe_phdr( f, i );
+        if( PT_LOAD == ph->p_type && vaddr >= ph->p_vaddr
+                && vaddr - ph->p_vaddr < ph->p_filesz ){
+            *off = ph->p_offset + ( vaddr - ph->p_vaddr );
+            return PE_OK;
+        }
+    }
+    return PE_ERR_RANGE;
+}
+
+// Like pe_vaddr_offset(), also giving the bytes of file image from there
+// to the end of the segment.
+static int
+vaddr_range( struct pe_file const *f, uint64_t vaddr, uint64_t *off, uint64_t *avail ){
+    for( size_t i = 0; i < pe_phnum( f ); i++ ){
+        Elf64_Phdr const *ph = pe_phdr( f, i );
+        if( PT_LOAD == ph->p_type && vaddr >= ph->p_vaddr
+                && vaddr - ph->p_vaddr < ph->p_filesz ){
+            *off = ph->p_offset + ( vaddr - ph->p_vaddr );
+            *avail = ph->p_filesz - ( vaddr - ph->p_vaddr );
+            if( *off > pe_size( f ) ){
+                return PE_ERR_TRUNCATED;
+            }
+            if( *avail > pe_size( f ) - *off ){
+                *avail = pe_size( f ) - *off;
+            }
+            return PE_OK;
+        }
+    }
+    return PE_ERR_RANGE;
+}
+
+int
+pe_dynamic( struct pe_file const *f, Elf64_Dyn const **dyn, size_t *count ){
+    int rc;
+
+    *dyn = NULL;
+    *count = 0;
+    if( pe_dynamic_converted( f, dyn, count, &rc ) ){
+        return rc;
+    }
+    for( size_t i = 0; i < pe_phnum( f ); i++ ){
+        Elf64_Phdr const *ph = pe_phdr( f, i );
+        if( PT_DYNAMIC != ph->p_type ){
+            continue;
+        }
+        unsigned char const *p;
+        if( PE_OK != ( rc = pe_file_range( f, ph->p_offset, ph->p_filesz, &p ) ) ){
+            return rc;
+        }
+        Elf64_Dyn const *d = (Elf64_Dyn const *)p;
+        size_t n = ph->p_filesz / sizeof( Elf64_Dyn ), end = 0;
+        // The array ends at DT_NULL; anything after it is padding.
+        while( end < n && DT_NULL != d[end].d_tag ){
+            end++;
+        }
+        *dyn = d;
+        *count = end;
+        return PE_OK;
+    }
+    return PE_ERR_RANGE;
+}
+
+uint64_t
+pe_dynamic_value( Elf64_Dyn const *dyn, size_t count, int64_t tag, uint64_t dflt ){
+    for( size_t i = 0; i < count; i++ ){
+        if( dyn[i].d_tag == tag ){
+            return dyn[i].d_un.d_val;
+        }
+    }
+    return dflt;
+}
+
+int
+pe_dynamic_strtab( struct pe_file const *f, unsigned char const **tab, size_t *len ){
+    Elf64_Dyn const *dyn;
+    size_t count;
+    uint64_t addr, size, off;
+    int rc;
+
+    *tab = NULL;
+    *len = 0;
+    if( PE_OK != pe_dynamic( f, &dyn, &count ) ){
+        return PE_ERR_RANGE;
+    }
+    addr = pe_dynamic_value( dyn, count, DT_STRTAB, 0 );
+    size = pe_dynamic_value( dyn, count, DT_STRSZ, 0 );
+    if( 0 == addr || PE_OK != pe_vaddr_offset( f, addr, &off ) ){
+        return PE_ERR_RANGE;
+    }
+    if( PE_OK != ( rc = pe_file_range( f, off, size, tab ) ) ){
+        return rc;
+    }
+    *len = size;
+    return PE_OK;
+}
+
+char const *
+pe_string( unsigned char const *tab, size_t len, uint64_t off ){
+    if( NULL == tab || off >= len || NULL == memchr( tab + off, 0, len - off ) ){
+        return NULL;
+    }
+    return (char const *)tab + off;
+}
+
+bool
+pe_dtag_is_string( int64_t tag ){
+    switch( tag ){
+        case DT_NEEDED:
+        case DT_SONAME:
+        case DT_RPATH:
+        case DT_RUNPATH:
+        case DT_AUXILIARY:
+        case DT_FILTER:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The table at the address in tag addr_tag whose size is in size_tag.
+static int
+dynamic_table( struct pe_file const *f, int64_t addr_tag, int64_t size_tag,
+        unsigned char const **data, size_t *len ){
+    Elf64_Dyn const *dyn;
+    size_t count;
+    uint64_t addr, size, off, avail;
+    int rc;
+
+    *data = NULL;
+    *len = 0;
+    if( PE_OK != pe_dynamic( f, &dyn, &count ) ){
+        return PE_ERR_RANGE;
+    }
+    addr = pe_dynamic_value( dyn, count, addr_tag, 0 );
+    size = pe_dynamic_value( dyn, count, size_tag, 0 );
+    if( 0 == addr || 0 == size ){
+        return PE_ERR_RANGE;
+    }
+    if( PE_OK != vaddr_range( f, addr, &off, &avail ) || size > avail ){
+        return PE_ERR_TRUNCATED;
+    }
+    if( PE_OK != ( rc = pe_file_range( f, off, size, data ) ) ){
+        return rc;
+    }
+    *len = size;
+    return PE_OK;
+}
+
+int
+pe_dynamic_relocs( struct pe_file const *f, int64_t tag, struct pe_reloc_iter *it ){
+    Elf64_Dyn const *dyn;
+    size_t count, len;
+    unsigned char const *data;
+    enum pe_variant v;
+    bool rela;
+    int rc;
+
+    *it = (struct pe_reloc_iter){ 0 };
+    switch( tag ){
+        case DT_RELA:
+            rc = dynamic_table( f, DT_RELA, DT_RELASZ, &data, &len );
+            rela = true;
+            break;
+        case DT_REL:
+            rc = dynamic_table( f, DT_REL, DT_RELSZ, &data, &len );
+            rela = false;
+            break;
+        case DT_JMPREL:
+            rc = dynamic_table( f, DT_JMPREL, DT_PLTRELSZ, &data, &len );
+            pe_dynamic( f, &dyn, &count );
+            rela = DT_RELA == pe_dynamic_value( dyn, count, DT_PLTREL, DT_RELA );
+            break;
+        default:
+            return PE_ERR_RANGE;
+    }
+    if( PE_OK != rc ){
+        return rc;
+    }
+    v = pe_variant( f );
+    return pe_reloc_table( v, data, len, rela,
+            rela ? pe_variant_sizes[v].rela : pe_variant_sizes[v].rel, it );
+}
+
+int
+pe_dynamic_relr( struct pe_file const *f, unsigned char const **data, size_t *len ){
+    return dynamic_table( f, DT_RELR, DT_RELRSZ, data, len );
+}
+
+int
+pe_dynamic_data( struct pe_file const *f, int64_t tag, unsigned char const **data, size_t *len ){
+    Elf64_Dyn const *dyn;
+    size_t count;
+    uint64_t addr, off, avail;
+    int rc;
+
+    *data = NULL;
+    *len = 0;
+    if( PE_OK != pe_dynamic( f, &dyn, &count ) ){
+        return PE_ERR_RANGE;
+    }
+    if( 0 == ( addr = pe_dynamic_value( dyn, count, tag, 0 ) ) ){
+        return PE_ERR_RANGE;
+    }
+    if( PE_OK != vaddr_range( f, addr, &off, &avail ) ){
+        return PE_ERR_TRUNCATED;
+    }
+    if( PE_OK != ( rc = pe_file_range( f, off, avail, data ) ) ){
+        return rc;
+    }
+    *len = avail;
+    return PE_OK;
+}
+
+int
+pe_dynamic_symtab( struct pe_file const *f, unsigned char const **syms, size_t *nsyms,
+        size_t *entsize ){
+    Elf64_Dyn const *dyn;
+    size_t count, min = pe_sym_entsize( pe_variant( f ) );
+    uint64_t addr, off, avail;
+    int rc;
+
+    *syms = NULL;
+    *nsyms = 0;
+    *entsize = min;
+    if( PE_OK != pe_dynamic( f, &dyn, &count ) ){
+        return PE_ERR_RANGE;
+    }
+    // The dynamic section doesn't say how many symbols there are; use the
+    // section header when there is one, else whatever fits in the segment.
+    for( size_t i = 0; i < pe_shnum( f ); i++ ){
+        Elf64_Shdr const *sh = pe_shdr( f, i );
+        size_t len;
+        if( SHT_DYNSYM == sh->sh_type && sh->sh_entsize >= min
+                && PE_OK == pe_section_data( f, sh, syms, &len ) ){
+            *entsize = sh->sh_entsize;
+            *nsyms = len / *entsize;
+            return PE_OK;
+        }
+    }
+    addr = pe_dynamic_value( dyn, count, DT_SYMTAB, 0 );
+    if( 0 == addr || PE_OK != vaddr_range( f, addr, &off, &avail ) ){
+        return PE_ERR_RANGE;
+    }
+    if( ( *entsize = pe_dynamic_value( dyn, count, DT_SYMENT, min ) ) < min ){
+        *entsize = min;
+        return PE_ERR_UNSUPPORTED;
+    }
+    *nsyms = avail / *entsize;
+    if( PE_OK != ( rc = pe_file_range( f, off, *nsyms * *entsize, syms ) ) ){
+        *nsyms = 0;
+    }
+    return rc;
+}
@@ -0,0 +1,271 @@
+/* dynhash.c
+ *
+ * Name lookups through a file's own dynamic symbol hash table, see
+ * libparse_elf.h.
+ *
+ * Nothing here builds an index: a lookup hashes the name, checks the GNU
+ * Bloom filter (which answers most "no" queries from one word), then walks
+ * one bucket's chain.  Only the chain entries and the candidate symbols and
+ * names are touched, never the whole of .dynsym or .dynstr.
+ *
+ * Both tables come from untrusted files, so every index read from them is
+ * checked against the section it points into.
+ *
+ * The lookup functions are stamped out once per variant: Bloom filter words
+ * are address-sized and everything is in the file's byte order.
+ */
+
+#include <string.h>     // memcmp(3), strlen(3)
+#include <stdbool.h>    // bool
+#include "libparse_elf.h"
+#include "variant.h"
+
+// Layout of an SHT_GNU_HASH section: a header of four words, the Bloom
+// filter, the buckets, then one chain word per hashed symbol.
+struct gnu_hash_hdr {
+    uint32_t nbuckets;
+    uint32_t symoffset;     // First symbol in the table
+    uint32_t bloom_size;    // In address-sized words
+    uint32_t bloom_shift;
+};
+
+static uint32_t
+gnu_hash( char const *s ){
+    uint32_t h = 5381;
+    for( ; *s; s++ ){
+        h = h * 33 + (unsigned char)*s;
+    }
+    return h;
+}
+
+static uint32_t
+sysv_hash( char const *s ){
+    uint32_t h = 0, g;
+    for( ; *s; s++ ){
+        h = ( h << 4 ) + (unsigned char)*s;
+        g = h & 0xf0000000;
+        h ^= g >> 24;
+        h &= ~g;
+    }
+    return h;
+}
+
+// Word i of a table, in the file's byte order.  For the fixed parts of the
+// table; the lookup loops use their variant's own decoder.
+static uint32_t
+read32( struct pe_dynhash const *h, unsigned char const *p, size_t i ){
+    switch( h->variant ){
+#define READ32( sfx, id, bits, enc ) \
+        case id: return pe_u32_##sfx( p + 4 * i );
+        PE_VARIANTS( READ32 )
+#undef READ32
+    }
+    return 0;
+}
+
+// Locate the hash table of the given type together with the symbol and
+// string tables it hangs off, the way the loader does: through the dynamic
+// section.  The hash table and symbols run to the end of their segment as
+// far as we know; the bounds checks below and in the lookups keep reads
+// inside that.
+static int
+dynamic_table( struct pe_file const *f, uint32_t type, struct pe_dynhash *h ){
+    size_t nsyms, entsize;
+
+    if( PE_OK != pe_dynamic_data( f, SHT_GNU_HASH == type ? DT_GNU_HASH : DT_HASH, &h->hash, &h->hash_len ) ){
+        return PE_ERR_RANGE;
+    }
+    if( PE_OK != pe_dynamic_symtab( f, &h->syms, &nsyms, &entsize )
+            || PE_OK != pe_dynamic_strtab( f, &h->strs, &h->strs_len ) ){
+        return PE_ERR_TRUNCATED;
+    }
+    h->sym_entsize = entsize;
+    h->syms_len = nsyms * entsize;
+    h->nsyms = nsyms;
+    return PE_OK;
+}
+
+// The same through section headers, for files with no (or a broken)
+// dynamic section.
+static int
+section_table( struct pe_file const *f, uint32_t type, struct pe_dynhash *h ){
+    Elf64_Shdr const *hsh = NULL, *ssh, *strsh;
+    int rc;
+
+    for( size_t i = 0; i < pe_shnum( f ) && NULL == hsh; i++ ){
+        if( type == pe_shdr( f, i )->sh_type ){
+            hsh = pe_shdr( f, i );
+        }
+    }
+    if( NULL == hsh || hsh->sh_link >= pe_shnum( f ) ){
+        return PE_ERR_RANGE;
+    }
+    ssh = pe_shdr( f, hsh->sh_link );
+    if( ssh->sh_link >= pe_shnum( f ) ){
+        return PE_ERR_RANGE;
+    }
+    strsh = pe_shdr( f, ssh->sh_link );
+    if( ssh->sh_entsize < pe_sym_entsize( pe_variant( f ) ) ){
+        return PE_ERR_UNSUPPORTED;
+    }
+    if( PE_OK != ( rc = pe_section_data( f, hsh, &h->hash, &h->hash_len ) )
+            || PE_OK != ( rc = pe_section_data( f, ssh, &h->syms, &h->syms_len ) )
+            || PE_OK != ( rc = pe_section_data( f, strsh, &h->strs, &h->strs_len ) ) ){
+        return rc;
+    }
+    h->sym_entsize = ssh->sh_entsize;
+    h->nsyms = h->syms_len / ssh->sh_entsize;
+    return PE_OK;
+}
+
+// Check the fixed parts of a located table once so lookups only need to
+// check what they read from buckets and chains.
+static int
+check_table( struct pe_dynhash *h ){
+    if( SHT_GNU_HASH == h->type ){
+        struct gnu_hash_hdr hdr;
+        size_t bloom_words = pe_variant_sizes[ h->variant ].word / 4;   // In 32-bit words
+        if( h->hash_len < sizeof( hdr ) ){
+            return PE_ERR_TRUNCATED;
+        }
+        hdr.nbuckets = read32( h, h->hash, 0 );
+        hdr.symoffset = read32( h, h->hash, 1 );
+        hdr.bloom_size = read32( h, h->hash, 2 );
+        hdr.bloom_shift = read32( h, h->hash, 3 );
+        size_t words = ( h->hash_len - sizeof( hdr ) ) / 4;
+        // The second Bloom bit is hash >> bloom_shift of a 32-bit hash.
+        if( 0 == hdr.nbuckets || 0 == hdr.bloom_size
+                || ( hdr.bloom_size & ( hdr.bloom_size - 1 ) )
+                || hdr.bloom_shift >= 32
+                || words < bloom_words * (uint64_t)hdr.bloom_size + hdr.nbuckets ){
+            return PE_ERR_TRUNCATED;
+        }
+        h->nbuckets = hdr.nbuckets;
+        h->symoffset = hdr.symoffset;
+        h->bloom_size = hdr.bloom_size;
+        h->bloom_shift = hdr.bloom_shift;
+        h->bloom = h->hash + sizeof( hdr );
+        h->buckets = h->bloom + 4 * bloom_words * hdr.bloom_size;
+        h->chains = h->buckets + 4 * (size_t)hdr.nbuckets;
+        h->nchains = words - bloom_words * hdr.bloom_size - hdr.nbuckets;
+    }else{
+        uint32_t nb[2];
+        if( h->hash_len < sizeof( nb ) ){
+            return PE_ERR_TRUNCATED;
+        }
+        nb[0] = read32( h, h->hash, 0 );
+        nb[1] = read32( h, h->hash, 1 );
+        if( 0 == nb[0] || ( h->hash_len - sizeof( nb ) ) / 4 < (uint64_t)nb[0] + nb[1] ){
+            return PE_ERR_TRUNCATED;
+        }
+        h->nbuckets = nb[0];
+        h->buckets = h->hash + sizeof( nb );
+        h->chains = h->buckets + 4 * (size_t)nb[0];
+        h->nchains = nb[1];
+    }
+    return PE_OK;
+}
+
+int
+pe_dynhash_open( struct pe_file const *f, struct pe_dynhash *h ){
+    static struct {
+        int (*locate)( struct pe_file const *f, uint32_t type, struct pe_dynhash *h );
+        uint32_t type;
+    } const tries[] = {
+        { dynamic_table, SHT_GNU_HASH },    { dynamic_table, SHT_HASH },
+        { section_table, SHT_GNU_HASH },    { section_table, SHT_HASH },
+    };
+    int rc = PE_ERR_RANGE;
+
+    // Fall through to the next place to look both when a table is missing
+    // and when it doesn't check out.
+    for( size_t i = 0; i < sizeof( tries ) / sizeof( tries[0] ); i++ ){
+        int try_rc;
+        *h = (struct pe_dynhash){ .type = tries[i].type, .variant = pe_variant( f ) };
+        if( PE_OK == ( try_rc = tries[i].locate( f, tries[i].type, h ) )
+                && PE_OK == ( try_rc = check_table( h ) ) ){
+            return PE_OK;
+        }
+        rc = PE_ERR_RANGE == rc ? try_rc : rc;
+    }
+    *h = (struct pe_dynhash){ 0 };
+    return rc;
+}
+
+#define LOOKUP( sfx, id, bits, enc ) \
+/* Symbol i if it exists, is defined and is called key. */ \
+static bool \
+match_##sfx( struct pe_dynhash const *h, size_t i, char const *key, size_t keylen, \
+        Elf64_Sym *sym ){ \
+    if( i >= h->nsyms ){ \
+        return false; \
+    } \
+    pe_sym_##sfx( h->syms + i * h->sym_entsize, sym ); \
+    return SHN_UNDEF != sym->st_shndx \
+        && sym->st_name < h->strs_len \
+        && h->strs_len - sym->st_name > keylen \
+        && 0 == memcmp( h->strs + sym->st_name, key, keylen ) \
+        && 0 == h->strs[ sym->st_name + keylen ]; \
+} \
+static bool \
+gnu_lookup_##sfx( struct pe_dynhash const *h, char const *key, Elf64_Sym *sym ){ \
+    uint32_t hash = gnu_hash( key ), i; \
+    size_t keylen = strlen( key ); \
+    uint64_t word, mask; \
+\
+    /* Two bits of one Bloom filter word rule out almost every miss. */ \
+    word = pe_word_##sfx( h->bloom + bits / 8 * ( ( hash / bits ) & ( h->bloom_size - 1 ) ) ); \
+    mask = ( 1ull << ( hash % bits ) ) | ( 1ull << ( ( hash >> h->bloom_shift ) % bits ) ); \
+    if( ( word & mask ) != mask ){ \
+        return false; \
+    } \
+\
+    i = pe_u32_##sfx( h->buckets + 4 * (size_t)( hash % h->nbuckets ) ); \
+    if( i < h->symoffset ){ \
+        return false; \
+    } \
+    /* A chain runs until an entry with the low bit set.  The stored hashes \
+       drop that bit, so compare without it before touching the symbol. */ \
+    for( ; i - h->symoffset < h->nchains; i++ ){ \
+        uint32_t chain_hash = pe_u32_##sfx( h->chains + 4 * (size_t)( i - h->symoffset ) ); \
+        if( ( chain_hash | 1 ) == ( hash | 1 ) && match_##sfx( h, i, key, keylen, sym ) ){ \
+            return true; \
+        } \
+        if( chain_hash & 1 ){ \
+            break; \
+        } \
+    } \
+    return false; \
+} \
+static bool \
+sysv_lookup_##sfx( struct pe_dynhash const *h, char const *key, Elf64_Sym *sym ){ \
+    size_t keylen = strlen( key ); \
+    uint32_t i = pe_u32_##sfx( h->buckets + 4 * (size_t)( sysv_hash( key ) % h->nbuckets ) ); \
+\
+    /* Bound the walk by the chain count so a cyclic chain can't hang us. */ \
+    for( size_t steps = 0; STN_UNDEF != i && i < h->nchains && steps < h->nchains; steps++ ){ \
+        if( match_##sfx( h, i, key, keylen, sym ) ){ \
+            return true; \
+        } \
+        i = pe_u32_##sfx( h->chains + 4 * (size_t)i ); \
+    } \
+    return false; \
+}
+
+PE_VARIANTS( LOOKUP )
+
+bool
+pe_dynhash_lookup( struct pe_dynhash const *h, char const *name, Elf64_Sym *sym ){
+    Elf64_Sym scratch;
+
+    sym = sym ? sym : &scratch;
+    switch( h->variant ){
+#define LOOKUP_CASE( sfx, id, bits, enc ) \
+        case id: \
+            return SHT_GNU_HASH == h->type ? \
+                    gnu_lookup_##sfx( h, name, sym ) : sysv_lookup_##sfx( h, name, sym );
+        PE_VARIANTS( LOOKUP_CASE )
+#undef LOOKUP_CASE
+    }
+    return false;
+}
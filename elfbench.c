@@ -0,0 +1,290 @@
+/* elfbench.c
+ *
+ * Timing driver for the parse phases, run over files made by mkelf (see
+ * tests/bench.sh and `make bench`).
+ *
+ *     elfbench [-n <reps>] <file> [<file> ...]
+ *
+ * Each phase is the library work behind one part of parse_elf's output:
+ *
+ *   open      pe_open(): map the file, check and (if needed) convert the
+ *             ELF header and both header tables
+ *   phdrs     read every program header
+ *   shdrs     read every section header and resolve its name
+ *   shtypes   name every section's sh_type as the listing does: a table
+ *             lookup, with "Invalid:(...)" formatted only for unknown types
+ *   shtypes_eager
+ *             the same, the way it was done before the tables: the
+ *             "Invalid:(...)" text formatted for every row, then a chain
+ *             of comparisons; kept as the baseline for shtypes
+ *   strtabs   index every SHT_STRTAB section
+ *   symbols   build the address index of .symtab and .dynsym
+ *   relocs    count every SHT_REL / SHT_RELA section by type and symbol
+ *
+ * and runs <reps> times (default 5) per file; the fastest run is reported,
+ * with the bytes of the tables the phase reads and the entries in them, as
+ * MB/s and millions of entries per second.  Open has no bytes, since
+ * mapping doesn't read the file, and its one entry is the file: its rate
+ * is files per second.  Formatting the output is not timed: this measures
+ * the parse loops, not printf(3); tests/bench.sh times the whole listing
+ * separately.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>      // printf(3), fprintf(3)
+#include <stdlib.h>     // calloc(3), free(3), strtoul(3), exit(3)
+#include <string.h>     // strlen(3)
+#include <stdint.h>     // uint64_t and friends
+#include <inttypes.h>   // PRIu64
+#include <unistd.h>     // getopt(3)
+#include <time.h>       // clock_gettime(3)
+#include <stdbool.h>    // bool
+#include <elf.h>        // SHT_*
+#include "libparse_elf.h"
+#include "strtab.h"
+
+// What one run of a phase went through.
+struct work {
+    uint64_t entries;
+    uint64_t bytes;
+};
+
+static uint64_t volatile sink;      // Keeps results the compiler could drop
+
+static void
+phase_phdrs( struct pe_file const *f, struct work *w ){
+    uint64_t sum = 0;
+
+    for( size_t i = 0; i < pe_phnum( f ); i++ ){
+        Elf64_Phdr const *ph = pe_phdr( f, i );
+        sum += ph->p_type + ph->p_offset + ph->p_filesz + ph->p_memsz;
+    }
+    w->entries = pe_phnum( f );
+    w->bytes = pe_phnum( f ) * pe_ehdr( f )->e_phentsize;
+    sink = sum;
+}
+
+static void
+phase_shdrs( struct pe_file const *f, struct work *w ){
+    uint64_t sum = 0;
+
+    for( size_t i = 0; i < pe_shnum( f ); i++ ){
+        Elf64_Shdr const *sh = pe_shdr( f, i );
+        char const *name = pe_section_name( f, sh );
+        sum += sh->sh_type + sh->sh_offset + sh->sh_size + ( name ? strlen( name ) : 0 );
+    }
+    w->entries = pe_shnum( f );
+    w->bytes = pe_shnum( f ) * pe_ehdr( f )->e_shentsize;
+    sink = sum;
+}
+
+static void
+phase_shtypes( struct pe_file const *f, struct work *w ){
+    char buf[64];
+    uint64_t sum = 0;
+
+    for( size_t i = 0; i < pe_shnum( f ); i++ ){
+        uint32_t type = pe_shdr( f, i )->sh_type;
+        char const *name = pe_shtype_name( type );
+        if( NULL == name ){
+            snprintf(buf, sizeof( buf ), "Invalid:(%#12"PRIx32")", type);
+            name = buf;
+        }
+        sum += name[0];
+    }
+    w->entries = pe_shnum( f );
+    w->bytes = pe_shnum( f ) * pe_ehdr( f )->e_shentsize;
+    sink = sum;
+}
+
+static void
+phase_shtypes_eager( struct pe_file const *f, struct work *w ){
+    char buf[64];
+    uint64_t sum = 0;
+
+    for( size_t i = 0; i < pe_shnum( f ); i++ ){
+        uint32_t type = pe_shdr( f, i )->sh_type;
+        snprintf(buf, sizeof( buf ), "Invalid:(%#12"PRIx32")", type);
+        char const *name =
+            type == SHT_NULL     ? "NULL"    :
+            type == SHT_PROGBITS ? "PROGBITS":
+            type == SHT_SYMTAB   ? "SYMTAB"  :
+            type == SHT_STRTAB   ? "STRTAB"  :
+            type == SHT_RELA     ? "RELA"    :
+            type == SHT_HASH     ? "HASH"    :
+            type == SHT_DYNAMIC  ? "DYNAMIC" :
+            type == SHT_NOTE     ? "NOTE"    :
+            type == SHT_NOBITS   ? "NOBITS"  :
+            type == SHT_REL      ? "REL"     :
+            type == SHT_SHLIB    ? "SHLIB"   :
+            type == SHT_DYNSYM   ? "DYNSYM"  :
+            buf;
+        sum += name[0];
+    }
+    w->entries = pe_shnum( f );
+    w->bytes = pe_shnum( f ) * pe_ehdr( f )->e_shentsize;
+    sink = sum;
+}
+
+static void
+phase_strtabs( struct pe_file const *f, struct work *w ){
+    for( size_t i = 0; i < pe_shnum( f ); i++ ){
+        Elf64_Shdr const *sh = pe_shdr( f, i );
+        unsigned char const *data;
+        size_t len, count;
+        if( SHT_STRTAB != sh->sh_type || PE_OK != pe_section_data( f, sh, &data, &len ) ){
+            continue;
+        }
+        free( strtab_index( data, len, &count ) );
+        w->entries += count;
+        w->bytes += len;
+    }
+}
+
+static void
+phase_symbols( struct pe_file const *f, struct work *w ){
+    static uint32_t const tables[] = { SHT_SYMTAB, SHT_DYNSYM };
+
+    for( size_t t = 0; t < sizeof( tables ) / sizeof( tables[0] ); t++ ){
+        struct pe_symtab *st;
+        if( PE_OK != pe_symtab_build( f, tables[t], &st ) ){
+            continue;
+        }
+        w->entries += pe_symtab_count( st );
+        pe_symtab_free( st );
+    }
+}
+
+// The symbol tables' size, which pe_symtab_build() doesn't report; found
+// outside the timed run, which a scan of a million sections would skew.
+static void
+size_symbols( struct pe_file const *f, struct work *w ){
+    for( size_t i = 0; i < pe_shnum( f ); i++ ){
+        Elf64_Shdr const *sh = pe_shdr( f, i );
+        if( SHT_SYMTAB == sh->sh_type || SHT_DYNSYM == sh->sh_type ){
+            w->bytes += sh->sh_size;
+        }
+    }
+}
+
+static void
+phase_relocs( struct pe_file const *f, struct work *w ){
+    static struct pe_reloc_hist h;
+
+    for( size_t i = 0; i < pe_shnum( f ); i++ ){
+        Elf64_Shdr const *sh = pe_shdr( f, i );
+        struct pe_reloc_iter it;
+        if( ( SHT_REL != sh->sh_type && SHT_RELA != sh->sh_type )
+                || PE_OK != pe_reloc_begin( f, sh, &it ) ){
+            continue;
+        }
+        h = (struct pe_reloc_hist){ 0 };
+        pe_reloc_count( it, &h );
+        w->entries += h.count;
+        w->bytes += sh->sh_size;
+    }
+}
+
+static struct {
+    char const *name;
+    void (*run)( struct pe_file const *f, struct work *w );
+    void (*size)( struct pe_file const *f, struct work *w );   // Untimed, may be NULL
+} const phases[] = {
+    { "phdrs",   phase_phdrs,   NULL },
+    { "shdrs",   phase_shdrs,   NULL },
+    { "shtypes", phase_shtypes, NULL },
+    { "shtypes_eager", phase_shtypes_eager, NULL },
+    { "strtabs", phase_strtabs, NULL },
+    { "symbols", phase_symbols, size_symbols },
+    { "relocs",  phase_relocs,  NULL },
+};
+
+static double
+now( void ){
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Phases that read no bytes get "-" for them and for MB/s.
+static void
+report( char const *path, char const *phase, struct work const *w, double best ){
+    printf("%-32s %-13s %12"PRIu64" ", path, phase, w->entries);
+    if( w->bytes ){
+        printf("%12"PRIu64" %10.3f %10.1f", w->bytes, best * 1e3, best > 0 ? w->bytes / best / 1e6 : 0.0);
+    }else{
+        printf("%12s %10.3f %10s", "-", best * 1e3, "-");
+    }
+    printf(" %10.2f\n", best > 0 ? w->entries / best / 1e6 : 0.0);
+}
+
+// Time every phase over path; false if it can't be opened.
+static bool
+bench_file( char const *path, unsigned reps ){
+    struct pe_file *f;
+    struct work w = { 0 };
+    double best = 1e300, t;
+    int rc;
+
+    for( unsigned r = 0; r < reps; r++ ){
+        t = now();
+        rc = pe_open( path, &f );
+        t = now() - t;
+        if( PE_OK != rc ){
+            fprintf(stderr, "elfbench: %s: %s\n", path, pe_strerror( rc ));
+            return false;
+        }
+        best = t < best ? t : best;
+        w = (struct work){ .entries = 1 };
+        if( r + 1 < reps ){
+            pe_close( f );
+        }
+    }
+    report( path, "open", &w, best );
+
+    for( size_t p = 0; p < sizeof( phases ) / sizeof( phases[0] ); p++ ){
+        best = 1e300;
+        for( unsigned r = 0; r < reps; r++ ){
+            w = (struct work){ 0 };
+            t = now();
+            phases[p].run( f, &w );
+            t = now() - t;
+            best = t < best ? t : best;
+        }
+        if( phases[p].size ){
+            phases[p].size( f, &w );
+        }
+        report( path, phases[p].name, &w, best );
+    }
+    pe_close( f );
+    return true;
+}
+
+static void
+usage( void ){
+    fprintf(stderr, "Usage:  elfbench [-n <reps>] <file> [<file> ...]\n");
+    exit(-1);
+}
+
+int
+main( int argc, char **argv ){
+    unsigned reps = 5;
+    bool ok = true;
+    int c;
+
+    while( -1 != ( c = getopt( argc, argv, "n:" ) ) ){
+        switch( c ){
+            case 'n': reps = strtoul( optarg, NULL, 10 ); break;
+            default: usage();
+        }
+    }
+    if( optind == argc || 0 == reps ){
+        usage();
+    }
+    printf("%-32s %-13s %12s %12s %10s %10s %10s\n",
+            "file", "phase", "entries", "bytes", "best ms", "MB/s", "Mentries/s");
+    for( int i = optind; i < argc; i++ ){
+        ok = bench_file( argv[i], reps ) && ok;
+    }
+    return ok ? 0 : 1;
+}
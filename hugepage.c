@@ -0,0 +1,69 @@
+/* hugepage.c
+ *
+ * Huge-page eligibility of PT_LOAD segments, see libparse_elf.h.
+ *
+ * A 2 MiB window of a file mapping can only be backed by a huge page
+ * (khugepaged with CONFIG_READ_ONLY_THP_FOR_FS, or MADV_COLLAPSE) if it
+ * is 2 MiB aligned in the address space, lies wholly inside the mapping,
+ * and maps a 2 MiB aligned stretch of the file.  So the segment's vaddr
+ * and offset must agree modulo 2 MiB, and the load base must not disturb
+ * that: ET_EXEC loads at its link address, and ET_DYN is placed at a
+ * multiple of the largest PT_LOAD p_align.
+ */
+
+#include <stdbool.h>    // bool
+#include "libparse_elf.h"
+
+static uint64_t
+align_down( uint64_t v, uint64_t a ){
+    return v & ~( a - 1 );
+}
+
+// Rounded up, saturating rather than wrapping at the top of the space.
+static uint64_t
+align_up( uint64_t v, uint64_t a ){
+    return v > UINT64_MAX - ( a - 1 ) ? align_down( UINT64_MAX, a ) : align_down( v + a - 1, a );
+}
+
+uint64_t
+pe_load_align( struct pe_file const *f ){
+    uint64_t align = 0;
+
+    for( size_t i = 0; i < pe_phnum( f ); i++ ){
+        Elf64_Phdr const *ph = pe_phdr( f, i );
+        if( PT_LOAD == ph->p_type && ph->p_align > align ){
+            align = ph->p_align;
+        }
+    }
+    return align > PE_PAGE_SZ ? align : PE_PAGE_SZ;
+}
+
+void
+pe_huge_pages( struct pe_file const *f, Elf64_Phdr const *ph, struct pe_huge *hp ){
+    uint64_t start = align_down( ph->p_vaddr, PE_PAGE_SZ );
+    uint64_t end = align_up( ph->p_vaddr + ph->p_memsz, PE_PAGE_SZ );
+    uint64_t file_end = align_up( ph->p_vaddr + ph->p_filesz, PE_PAGE_SZ );
+    uint64_t huge_start = align_up( start, PE_HUGE_PAGE_SZ );
+    uint64_t huge_end = align_down( file_end, PE_HUGE_PAGE_SZ );
+
+    *hp = (struct pe_huge){ 0 };
+    if( ph->p_memsz > UINT64_MAX - ph->p_vaddr ){
+        return;
+    }
+    hp->offset_aligned = 0 == ph->p_offset % PE_HUGE_PAGE_SZ;
+    hp->vaddr_aligned = 0 == ph->p_vaddr % PE_HUGE_PAGE_SZ;
+    hp->congruent = ph->p_offset % PE_HUGE_PAGE_SZ == ph->p_vaddr % PE_HUGE_PAGE_SZ;
+    hp->base_aligned = ET_EXEC == pe_ehdr( f )->e_type
+            || pe_load_align( f ) >= PE_HUGE_PAGE_SZ;
+
+    hp->tlb_4k = ( end - start ) / PE_PAGE_SZ;
+    hp->tlb_2m = end > start ?
+            ( align_up( end, PE_HUGE_PAGE_SZ ) - align_down( start, PE_HUGE_PAGE_SZ ) ) / PE_HUGE_PAGE_SZ : 0;
+    // Only the file-backed part can use file THP; the rest of memsz is
+    // anonymous bss.
+    if( hp->congruent && hp->base_aligned && huge_end > huge_start ){
+        hp->huge_pages = ( huge_end - huge_start ) / PE_HUGE_PAGE_SZ;
+    }
+    hp->eligible = 0 != hp->huge_pages;
+    hp->tlb_mixed = hp->tlb_4k - hp->huge_pages * ( PE_HUGE_PAGE_SZ / PE_PAGE_SZ ) + hp->huge_pages;
+}
@@ -0,0 +1,988 @@
+/* libparse_elf.c
+ *
+ * Reentrant ELF parsing library, see libparse_elf.h.
+ */
+
+#define _GNU_SOURCE     // O_DIRECT
+#include <stdlib.h>     // calloc(3), realloc(3), free(3), posix_memalign(3)
+#include <string.h>     // memcmp(3), memchr(3), strcmp(3), strdup(3)
+#include <stdint.h>     // uint64_t and friends
+#include <stdbool.h>    // bool, true, false
+#include <sys/types.h>  // open(2), fstat(2)
+#include <sys/stat.h>   // open(2), fstat(2)
+#include <fcntl.h>      // open(2), O_DIRECT
+#include <unistd.h>     // pread(2), close(2)
+#include <sys/mman.h>   // mmap(2), munmap(2)
+#include <pthread.h>    // pthread_mutex_lock(3)
+#include <stdatomic.h>  // atomic_load_explicit(3)
+#include <errno.h>      // errno
+#include "libparse_elf.h"
+#include "variant.h"
+#include "bswap.h"
+
+// One slot of the section name index.  index is the section index plus one,
+// so a zeroed slot is empty.
+struct name_slot {
+    uint32_t hash;
+    uint32_t index;
+};
+
+// A piece of a PE_IO_LAZY file, mapped on first use.
+struct window {
+    uint64_t off;
+    uint64_t len;
+    unsigned char const *addr;
+};
+
+#define PE_LAZY_CHUNK (64 * 1024)   // Windows are aligned to this
+
+struct pe_file {
+    char *path;
+    unsigned char const *map_addr;  // The whole file, NULL for PE_IO_LAZY
+    size_t map_size;                // Length of the file
+    bool mapped;                    // map_addr is from mmap(2), not the arena
+    size_t arena_cap;               // Otherwise the size of the buffer
+    size_t bytes_read;              // By read(2)-style calls, not faults
+
+    // PE_IO_LAZY only.
+    int fd;
+    pthread_mutex_t window_lock;
+    struct window *windows;
+    size_t nwindows, windows_cap;
+
+    // pe_open_stream() only: what was kept of the stream.
+    unsigned char *head;            // Bytes [0, head_len)
+    size_t head_len;
+    unsigned char *tail;            // Bytes [tail_off, map_size)
+    size_t tail_off;
+
+    enum pe_variant variant;
+    Elf64_Ehdr const *ehdr;
+    unsigned char const *phdrs;     // phnum entries of phent bytes
+    unsigned char const *shdrs;     // And of shent bytes
+    size_t phent, shent;            // e_phentsize and e_shentsize, or
+                                    // sizeof for converted tables
+    size_t phnum;
+    size_t shnum;
+
+    // Files that aren't PE_NATIVE, or whose tables are misaligned: the
+    // headers and dynamic array in native form, converted at open.
+    bool converted;
+    Elf64_Ehdr ehdr_native;
+    Elf64_Phdr *phdrs_native;
+    Elf64_Shdr *shdrs_native;
+    Elf64_Dyn *dyn_native;
+    size_t dyn_count;
+    int dyn_rc;                     // What pe_dynamic() says
+
+    size_t shstrndx;                // Section holding section names
+    unsigned char const *shstrtab;  // Its contents, NULL if there is none
+    size_t shstrtab_len;
+
+    // Built on the first pe_section_by_name() call.
+    pthread_mutex_t name_lock;
+    struct name_slot *_Atomic name_index;
+    size_t name_mask;               // Slot count - 1
+};
+
+// True if [off, off + count * entsize) lies inside a file of size bytes.
+static bool
+table_fits( size_t size, uint64_t off, uint64_t count, uint64_t entsize ){
+    if( 0 == count ){
+        return true;
+    }
+    if( off > size || entsize > ( size - off ) / count ){
+        return false;
+    }
+    return true;
+}
+
+// True if p can be dereferenced as a struct needing align bytes.
+static bool
+aligned( void const *p, size_t align ){
+    return 0 == (uintptr_t)p % align;
+}
+
+// Converters from the file's header tables to native ones, one per variant.
+struct convert {
+    void (*ehdr)( unsigned char const *p, Elf64_Ehdr *d );
+    void (*phdr)( unsigned char const *p, Elf64_Phdr *d );
+    void (*shdr)( unsigned char const *p, Elf64_Shdr *d );
+    void (*dyn)( unsigned char const *p, Elf64_Dyn *d );
+};
+
+#define CONVERT( sfx, id, bits, enc ) \
+    [id] = { pe_ehdr_##sfx, pe_phdr_##sfx, pe_shdr_##sfx, pe_dyn_##sfx },
+
+static struct convert const converters[] = {
+    PE_VARIANTS( CONVERT )
+};
+
+// The dynamic array of a converted file, converted once so that pe_dynamic()
+// can hand out Elf64_Dyn like it does for native files.
+static void
+convert_dynamic( struct pe_file *f ){
+    struct convert const *cv = &converters[ f->variant ];
+    size_t entsize = pe_variant_sizes[ f->variant ].dyn;
+
+    f->dyn_rc = PE_ERR_RANGE;
+    for( size_t i = 0; i < f->phnum; i++ ){
+        Elf64_Phdr const *ph = pe_phdr( f, i );
+        unsigned char const *p;
+        size_t n, end = 0;
+        Elf64_Dyn d;
+
+        if( PT_DYNAMIC != ph->p_type ){
+            continue;
+        }
+        if( PE_OK != ( f->dyn_rc = pe_file_range( f, ph->p_offset, ph->p_filesz, &p ) ) ){
+            return;
+        }
+        n = ph->p_filesz / entsize;
+        while( end < n && ( cv->dyn( p + end * entsize, &d ), DT_NULL != d.d_tag ) ){
+            end++;
+        }
+        if( NULL == ( f->dyn_native = malloc( end * sizeof( Elf64_Dyn ) + 1 ) ) ){
+            f->dyn_rc = PE_ERR_NOMEM;
+            return;
+        }
+        if( PE_SWAPPED == f->variant ){
+            bswap_table( BSWAP_DYN, f->dyn_native, p, end );
+        }else{
+            for( size_t j = 0; j < end; j++ ){
+                cv->dyn( p + j * entsize, &f->dyn_native[j] );
+            }
+        }
+        f->dyn_count = end;
+        return;
+    }
+}
+
+static int
+check_headers( struct pe_file *f ){
+    struct pe_variant_sizes const *sz;
+    struct convert const *cv;
+    Elf64_Ehdr const *e;
+    Elf64_Shdr sh0 = { 0 };
+    unsigned char const *p, *ident;
+    int rc;
+
+    if( PE_OK != ( rc = pe_file_range( f, 0, EI_NIDENT, &ident ) ) ){
+        return rc;
+    }
+    switch( ident[EI_CLASS] << 8 | ident[EI_DATA] ){
+        case ELFCLASS64 << 8 | ELFDATA2LSB: f->variant = PE_ELF64_LSB; break;
+        case ELFCLASS64 << 8 | ELFDATA2MSB: f->variant = PE_ELF64_MSB; break;
+        case ELFCLASS32 << 8 | ELFDATA2LSB: f->variant = PE_ELF32_LSB; break;
+        case ELFCLASS32 << 8 | ELFDATA2MSB: f->variant = PE_ELF32_MSB; break;
+        default: return PE_ERR_UNSUPPORTED;
+    }
+    sz = &pe_variant_sizes[ f->variant ];
+    cv = &converters[ f->variant ];
+    if( PE_OK != ( rc = pe_file_range( f, 0, sz->ehdr, &p ) ) ){
+        return rc;
+    }
+    // Fuzzed or hand-made files put tables at any offset, and arena and
+    // stream buffers only promise malloc(3) alignment, so a native file whose
+    // tables can't be cast in place takes the same converting path as the
+    // other variants; the native decoders are plain memcpy(3)s.
+    f->converted = PE_NATIVE != f->variant || !aligned( p, _Alignof( Elf64_Ehdr ) );
+    if( !f->converted ){
+        f->ehdr = e = (Elf64_Ehdr const *)p;
+    }else{
+        cv->ehdr( p, &f->ehdr_native );
+        f->ehdr = e = &f->ehdr_native;
+    }
+
+    // Counts too big for the header fields live in section 0: e_shnum is 0
+    // and sh_size has the section count, e_phnum is PN_XNUM and sh_info has
+    // the segment count, e_shstrndx is SHN_XINDEX and sh_link has the index.
+    if( e->e_shoff && e->e_shentsize >= sz->shdr
+            && ( 0 == e->e_shnum || PN_XNUM == e->e_phnum || SHN_XINDEX == e->e_shstrndx ) ){
+        if( PE_OK != ( rc = pe_file_range( f, e->e_shoff, sz->shdr, &p ) ) ){
+            return rc;
+        }
+        cv->shdr( p, &sh0 );
+    }
+    f->shnum = 0 == e->e_shnum && e->e_shoff ? sh0.sh_size : e->e_shnum;
+    f->phnum = PN_XNUM == e->e_phnum && e->e_shoff ? sh0.sh_info : e->e_phnum;
+    // The name index numbers sections in 32 bits.
+    if( f->shnum >= UINT32_MAX ){
+        return PE_ERR_UNSUPPORTED;
+    }
+
+    f->phent = e->e_phentsize;
+    if( f->phnum && e->e_phentsize < sz->phdr ){
+        return PE_ERR_UNSUPPORTED;
+    }
+    if( !table_fits( f->map_size, e->e_phoff, f->phnum, e->e_phentsize ) ){
+        return PE_ERR_TRUNCATED;
+    }
+    if( f->phnum && PE_OK != ( rc = pe_file_range( f, e->e_phoff, f->phnum * e->e_phentsize, &f->phdrs ) ) ){
+        return rc;
+    }
+
+    f->shent = e->e_shentsize;
+    if( f->shnum && e->e_shentsize < sz->shdr ){
+        return PE_ERR_UNSUPPORTED;
+    }
+    if( !table_fits( f->map_size, e->e_shoff, f->shnum, e->e_shentsize ) ){
+        return PE_ERR_TRUNCATED;
+    }
+    if( f->shnum && PE_OK != ( rc = pe_file_range( f, e->e_shoff, f->shnum * e->e_shentsize, &f->shdrs ) ) ){
+        return rc;
+    }
+
+    if( !f->converted ){
+        f->converted = !aligned( f->phdrs, _Alignof( Elf64_Phdr ) ) || f->phent % _Alignof( Elf64_Phdr )
+                    || !aligned( f->shdrs, _Alignof( Elf64_Shdr ) ) || f->shent % _Alignof( Elf64_Shdr );
+    }
+    if( !f->converted ){
+        // The tables themselves are fine; the dynamic array may not be.
+        for( size_t i = 0; i < f->phnum; i++ ){
+            Elf64_Phdr const *ph = pe_phdr( f, i );
+            if( PT_DYNAMIC == ph->p_type ){
+                f->converted = PE_OK == pe_file_range( f, ph->p_offset, ph->p_filesz, &p )
+                            && !aligned( p, _Alignof( Elf64_Dyn ) );
+                break;
+            }
+        }
+        if( f->converted ){
+            convert_dynamic( f );
+        }
+    }else{
+        f->phdrs_native = malloc( f->phnum * sizeof( Elf64_Phdr ) + 1 );
+        f->shdrs_native = malloc( f->shnum * sizeof( Elf64_Shdr ) + 1 );
+        if( NULL == f->phdrs_native || NULL == f->shdrs_native ){
+            return PE_ERR_NOMEM;
+        }
+        // Packed tables of the other byte order convert in one pass.
+        if( PE_SWAPPED == f->variant && sizeof( Elf64_Phdr ) == f->phent ){
+            bswap_table( BSWAP_PHDR, f->phdrs_native, f->phdrs, f->phnum );
+        }else{
+            for( size_t i = 0; i < f->phnum; i++ ){
+                cv->phdr( f->phdrs + i * f->phent, &f->phdrs_native[i] );
+            }
+        }
+        if( PE_SWAPPED == f->variant && sizeof( Elf64_Shdr ) == f->shent ){
+            bswap_table( BSWAP_SHDR, f->shdrs_native, f->shdrs, f->shnum );
+        }else{
+            for( size_t i = 0; i < f->shnum; i++ ){
+                cv->shdr( f->shdrs + i * f->shent, &f->shdrs_native[i] );
+            }
+        }
+        f->phdrs = (unsigned char const *)f->phdrs_native;
+        f->phent = sizeof( Elf64_Phdr );
+        f->shdrs = (unsigned char const *)f->shdrs_native;
+        f->shent = sizeof( Elf64_Shdr );
+        convert_dynamic( f );
+    }
+
+    // A missing or broken section name table is not fatal; names just
+    // don't resolve.
+    f->shstrndx = SHN_XINDEX == e->e_shstrndx ? sh0.sh_link : e->e_shstrndx;
+    if( SHN_UNDEF != f->shstrndx && f->shstrndx < f->shnum ){
+        pe_section_data( f, pe_shdr( f, f->shstrndx ), &f->shstrtab, &f->shstrtab_len );
+    }
+    return PE_OK;
+}
+
+static char const *const io_names[] = {
+    [PE_IO_MMAP]        = "mmap",
+    [PE_IO_POPULATE]    = "populate",
+    [PE_IO_SEQUENTIAL]  = "sequential",
+    [PE_IO_WILLNEED]    = "willneed",
+    [PE_IO_PREAD]       = "pread",
+    [PE_IO_DIRECT]      = "direct",
+    [PE_IO_LAZY]        = "lazy",
+};
+
+char const *
+pe_io_name( unsigned v ){
+    return v < sizeof( io_names ) / sizeof( io_names[0] ) ? io_names[v] : NULL;
+}
+
+/* The read strategies need a buffer the size of the file.  Allocations that
+ * large come straight from mmap(2) in malloc, so every file would pay page
+ * faults for a fresh buffer.  Instead each thread keeps the buffer of the
+ * last file it closed and hands it to the next file it opens if it is big
+ * enough.  Buffers are page aligned, as O_DIRECT needs.
+ */
+struct arena {
+    void *buf;
+    size_t cap;
+};
+
+static pthread_key_t arena_key;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+
+static void
+arena_destroy( void *p ){
+    struct arena *a = p;
+    free( a->buf );
+    free( a );
+}
+
+static void
+arena_init( void ){
+    pthread_key_create( &arena_key, arena_destroy );
+}
+
+static struct arena *
+arena_get( void ){
+    struct arena *a;
+
+    pthread_once( &arena_once, arena_init );
+    a = pthread_getspecific( arena_key );
+    if( NULL == a && NULL != ( a = calloc( 1, sizeof( struct arena ) ) ) ){
+        pthread_setspecific( arena_key, a );
+    }
+    return a;
+}
+
+static void *
+arena_take( size_t size, size_t *cap ){
+    struct arena *a = arena_get();
+    void *buf;
+
+    if( a && a->buf && a->cap >= size ){
+        buf = a->buf;
+        *cap = a->cap;
+        a->buf = NULL;
+        return buf;
+    }
+    *cap = ( size + PE_PAGE_SZ - 1 ) & ~( PE_PAGE_SZ - 1 );
+    if( 0 == *cap ){
+        *cap = PE_PAGE_SZ;
+    }
+    if( 0 != posix_memalign( &buf, PE_PAGE_SZ, *cap ) ){
+        return NULL;
+    }
+    return buf;
+}
+
+static void
+arena_give( void *buf, size_t cap ){
+    struct arena *a = arena_get();
+
+    if( a && ( NULL == a->buf || a->cap < cap ) ){
+        free( a->buf );
+        a->buf = buf;
+        a->cap = cap;
+    }else{
+        free( buf );
+    }
+}
+
+// Read the whole file into an arena buffer.  O_DIRECT needs the offset,
+// length and buffer aligned, so it reads whole pages and takes the short
+// read at the end of the file.
+static int
+read_file( struct pe_file *f, int fd, size_t size, bool direct ){
+    size_t cap, off = 0;
+    unsigned char *buf;
+    ssize_t n;
+
+    if( direct ){
+        fd = open( f->path, O_RDONLY | O_CLOEXEC | O_DIRECT );
+        if( -1 == fd ){
+            return PE_ERR_OPEN;
+        }
+    }
+    buf = arena_take( size, &cap );
+    if( NULL == buf ){
+        if( direct ){
+            close( fd );
+        }
+        return PE_ERR_NOMEM;
+    }
+    while( off < size ){
+        size_t want = direct ? ( ( size - off + PE_PAGE_SZ - 1 ) & ~( PE_PAGE_SZ - 1 ) ) : size - off;
+        n = pread( fd, buf + off, want, off );
+        if( n <= 0 ){
+            break;
+        }
+        off += n;
+        f->bytes_read += n;
+    }
+    if( direct ){
+        close( fd );
+    }
+    f->map_addr = buf;
+    f->map_size = off < size ? off : size;
+    f->arena_cap = cap;
+    return off < size ? PE_ERR_TRUNCATED : PE_OK;
+}
+
+static int
+map_file( struct pe_file *f, int fd, size_t size, enum pe_io io ){
+    void *map = mmap(
+            NULL,           // Allow the OS to pick the location of the map.
+            size,           // File size in bytes.
+            PROT_READ,      // Map may not be modified.
+            MAP_PRIVATE     // Map not shared with other processes.
+            | ( PE_IO_POPULATE == io ? MAP_POPULATE : 0 ),
+            fd,             // File descriptor.
+            0);             // Offset into the file to start mapping.
+
+    if( MAP_FAILED == map ){
+        return PE_ERR_MAP;
+    }
+    f->map_addr = map;
+    f->map_size = size;
+    f->mapped = true;
+    if( PE_IO_SEQUENTIAL == io ){
+        madvise( map, size, MADV_SEQUENTIAL );
+    }else if( PE_IO_WILLNEED == io ){
+        madvise( map, size, MADV_WILLNEED );
+    }
+    return PE_OK;
+}
+
+int
+pe_open( char const *path, struct pe_file **fp ){
+    return pe_open_io( path, PE_IO_MMAP, fp );
+}
+
+int
+pe_open_io( char const *path, enum pe_io io, struct pe_file **fp ){
+    int fd, rc;
+    struct stat s;
+    unsigned char magic[SELFMAG];
+    struct pe_file *f;
+
+    *fp = NULL;
+
+    // 1. Get a valid file descriptor.
+    fd = open( path, O_RDONLY | O_CLOEXEC );
+    if( -1 == fd ){
+        return PE_ERR_OPEN;
+    }
+
+    // 2. Check the magic number.  Most files in a directory tree are not
+    //    ELF, and a pread is far cheaper than a mmap plus a page fault.
+    if( SELFMAG != pread( fd, magic, SELFMAG, 0 )
+            || 0 != memcmp( magic, ELFMAG, SELFMAG ) ){
+        close( fd );
+        return PE_ERR_NOT_ELF;
+    }
+
+    // 3. Get the size of the file.
+    if( -1 == fstat( fd, &s ) ){
+        close( fd );
+        return PE_ERR_OPEN;
+    }
+
+    f = calloc( 1, sizeof( struct pe_file ) );
+    if( NULL == f || NULL == ( f->path = strdup( path ) ) ){
+        free( f );
+        close( fd );
+        return PE_ERR_NOMEM;
+    }
+    pthread_mutex_init( &f->name_lock, NULL );
+    pthread_mutex_init( &f->window_lock, NULL );
+    f->bytes_read = SELFMAG;
+    f->fd = -1;
+
+    // 4. Map or read the file.  A map holds its own reference to the file;
+    //    lazy windows are mapped later, so they keep the descriptor.
+    if( PE_IO_LAZY == io ){
+        f->fd = fd;
+        f->map_size = s.st_size;
+        rc = PE_OK;
+    }else{
+        if( PE_IO_PREAD == io || PE_IO_DIRECT == io ){
+            rc = read_file( f, fd, s.st_size, PE_IO_DIRECT == io );
+        }else{
+            rc = map_file( f, fd, s.st_size, io );
+        }
+        close( fd );
+    }
+    if( PE_OK != rc ){
+        pe_close( f );
+        return rc;
+    }
+
+    rc = check_headers( f );
+    if( PE_OK != rc ){
+        pe_close( f );
+        return rc;
+    }
+    *fp = f;
+    return PE_OK;
+}
+
+/* Streams.  The head of the stream is kept up to half the window, which
+ * covers the ELF header and, in practice, the program headers.  Past that
+ * only the last half window is kept, in a ring, since the section header
+ * table is normally at the end of the file.  Anything in between is gone
+ * by the time the section headers say where things are, and reads of it
+ * fail with PE_ERR_RANGE.
+ */
+#define PE_STREAM_CHUNK (1 << 20)
+
+// read(2) until n bytes or end of stream.
+static ssize_t
+read_full( int fd, unsigned char *buf, size_t n ){
+    size_t got = 0;
+    ssize_t r;
+
+    while( got < n ){
+        r = read( fd, buf + got, n - got );
+        if( -1 == r && EINTR == errno ){
+            continue;
+        }
+        if( r < 0 ){
+            return -1;
+        }
+        if( 0 == r ){
+            break;
+        }
+        got += r;
+    }
+    return got;
+}
+
+// Fill the head, up to limit bytes.  *eof is set if the stream ended.
+static int
+stream_head( struct pe_file *f, int fd, size_t limit, bool *eof ){
+    size_t cap = 0;
+    ssize_t n;
+
+    *eof = false;
+    do{
+        if( f->head_len == cap ){
+            size_t grow = cap ? 2 * cap : PE_STREAM_CHUNK;
+            unsigned char *p;
+            grow = grow < limit ? grow : limit;
+            if( grow == cap ){
+                return PE_OK;       // Full; the rest goes to the tail
+            }
+            if( NULL == ( p = realloc( f->head, grow ) ) ){
+                return PE_ERR_NOMEM;
+            }
+            f->head = p;
+            cap = grow;
+        }
+        n = read_full( fd, f->head + f->head_len,
+                cap - f->head_len < PE_STREAM_CHUNK ? cap - f->head_len : PE_STREAM_CHUNK );
+        if( n < 0 ){
+            return PE_ERR_OPEN;
+        }
+        // Reject non-ELF input as soon as the magic number is in.
+        if( f->head_len < SELFMAG && f->head_len + n >= SELFMAG
+                && 0 != memcmp( f->head, ELFMAG, SELFMAG ) ){
+            return PE_ERR_NOT_ELF;
+        }
+        f->head_len += n;
+    }while( n > 0 );
+    *eof = true;
+    return PE_OK;
+}
+
+// Read the rest of the stream through a ring of cap bytes.  If none of it
+// had to be dropped it is appended to the head, so that a stream that fits
+// in the window is one contiguous buffer.
+static int
+stream_tail( struct pe_file *f, int fd, size_t cap ){
+    unsigned char *ring = malloc( cap );
+    uint64_t total = 0;             // Bytes past the head
+    size_t pos;
+    ssize_t n;
+
+    if( NULL == ring ){
+        return PE_ERR_NOMEM;
+    }
+    do{
+        pos = total % cap;
+        n = read_full( fd, ring + pos, cap - pos < PE_STREAM_CHUNK ? cap - pos : PE_STREAM_CHUNK );
+        if( n < 0 ){
+            free( ring );
+            return PE_ERR_OPEN;
+        }
+        total += n;
+    }while( n > 0 );
+
+    if( total <= cap ){
+        unsigned char *p = realloc( f->head, f->head_len + total );
+        if( NULL == p ){
+            free( ring );
+            return PE_ERR_NOMEM;
+        }
+        memcpy( p + f->head_len, ring, total );
+        free( ring );
+        f->head = p;
+        f->head_len += total;
+        f->map_size = f->head_len;
+        return PE_OK;
+    }
+    // Unroll the ring so the tail is contiguous.
+    pos = total % cap;
+    f->tail = malloc( cap );
+    if( NULL == f->tail ){
+        free( ring );
+        return PE_ERR_NOMEM;
+    }
+    memcpy( f->tail, ring + pos, cap - pos );
+    memcpy( f->tail + ( cap - pos ), ring, pos );
+    free( ring );
+    f->tail_off = f->head_len + ( total - cap );
+    f->map_size = f->head_len + total;
+    return PE_OK;
+}
+
+int
+pe_open_stream( int fd, char const *name, size_t window, struct pe_file **fp ){
+    struct pe_file *f;
+    bool eof;
+    int rc;
+
+    *fp = NULL;
+    f = calloc( 1, sizeof( struct pe_file ) );
+    if( NULL == f || NULL == ( f->path = strdup( name ) ) ){
+        free( f );
+        return PE_ERR_NOMEM;
+    }
+    pthread_mutex_init( &f->name_lock, NULL );
+    pthread_mutex_init( &f->window_lock, NULL );
+    f->fd = -1;
+    window = window < 2 * PE_STREAM_CHUNK ? 2 * PE_STREAM_CHUNK : window;
+
+    rc = stream_head( f, fd, window / 2, &eof );
+    f->map_size = f->head_len;
+    if( PE_OK == rc && f->head_len < SELFMAG ){
+        rc = PE_ERR_NOT_ELF;
+    }
+    if( PE_OK == rc && !eof ){
+        rc = stream_tail( f, fd, window / 2 );
+    }
+    f->bytes_read = f->map_size;
+    if( PE_OK == rc ){
+        rc = check_headers( f );
+    }
+    if( PE_OK != rc ){
+        pe_close( f );
+        return rc;
+    }
+    *fp = f;
+    return PE_OK;
+}
+
+void
+pe_close( struct pe_file *f ){
+    if( NULL == f ){
+        return;
+    }
+    if( f->mapped ){
+        munmap( (void *)f->map_addr, f->map_size );
+    }else if( f->map_addr ){
+        arena_give( (void *)f->map_addr, f->arena_cap );
+    }
+    for( size_t i = 0; i < f->nwindows; i++ ){
+        munmap( (void *)f->windows[i].addr, f->windows[i].len );
+    }
+    free( f->windows );
+    free( f->phdrs_native );
+    free( f->shdrs_native );
+    free( f->dyn_native );
+    free( f->head );
+    free( f->tail );
+    if( -1 != f->fd ){
+        close( f->fd );
+    }
+    pthread_mutex_destroy( &f->window_lock );
+    pthread_mutex_destroy( &f->name_lock );
+    free( atomic_load( &f->name_index ) );
+    free( f->path );
+    free( f );
+}
+
+size_t
+pe_bytes_read( struct pe_file const *f ){
+    return f->bytes_read;
+}
+
+// Map the PE_LAZY_CHUNK-aligned window around [off, off + len).  Called
+// with window_lock held.
+static unsigned char const *
+window_map( struct pe_file *f, uint64_t off, uint64_t len ){
+    uint64_t start = off & ~(uint64_t)( PE_LAZY_CHUNK - 1 );
+    uint64_t end = ( off + len + PE_LAZY_CHUNK - 1 ) & ~(uint64_t)( PE_LAZY_CHUNK - 1 );
+    void *map;
+
+    end = end < f->map_size ? end : f->map_size;
+    if( f->nwindows == f->windows_cap ){
+        size_t cap = f->windows_cap ? 2 * f->windows_cap : 8;
+        struct window *w = realloc( f->windows, cap * sizeof( struct window ) );
+        if( NULL == w ){
+            return NULL;
+        }
+        f->windows = w;
+        f->windows_cap = cap;
+    }
+    map = mmap( NULL, end - start, PROT_READ, MAP_PRIVATE, f->fd, start );
+    if( MAP_FAILED == map ){
+        return NULL;
+    }
+    f->windows[ f->nwindows++ ] = (struct window){ start, end - start, map };
+    return (unsigned char const *)map + ( off - start );
+}
+
+int
+pe_file_range( struct pe_file const *cf, uint64_t off, uint64_t len, unsigned char const **p ){
+    struct pe_file *f = (struct pe_file *)cf;   // Windows are a cache.
+    static unsigned char const empty[1];
+
+    *p = NULL;
+    if( !table_fits( f->map_size, off, 1, len ) ){
+        return PE_ERR_TRUNCATED;
+    }
+    if( f->map_addr ){
+        *p = f->map_addr + off;
+        return PE_OK;
+    }
+    if( f->head ){
+        if( off + len <= f->head_len ){
+            *p = f->head + off;
+        }else if( f->tail && off >= f->tail_off ){
+            *p = f->tail + ( off - f->tail_off );
+        }
+        return *p ? PE_OK : PE_ERR_RANGE;
+    }
+    if( 0 == len || 0 == f->map_size ){
+        *p = empty;
+        return PE_OK;
+    }
+    pthread_mutex_lock( &f->window_lock );
+    for( size_t i = 0; i < f->nwindows && NULL == *p; i++ ){
+        struct window const *w = &f->windows[i];
+        if( off >= w->off && off - w->off <= w->len && len <= w->len - ( off - w->off ) ){
+            *p = w->addr + ( off - w->off );
+        }
+    }
+    if( NULL == *p ){
+        *p = window_map( f, off, len );
+    }
+    pthread_mutex_unlock( &f->window_lock );
+    return *p ? PE_OK : PE_ERR_MAP;
+}
+
+char const *
+pe_strerror( int err ){
+    switch( err ){
+        case PE_OK:              return "Success";
+        case PE_ERR_OPEN:        return "Unable to open file";
+        case PE_ERR_NOT_ELF:     return "Not an ELF file";
+        case PE_ERR_UNSUPPORTED: return "Unsupported ELF class or encoding";
+        case PE_ERR_TRUNCATED:   return "Truncated ELF file";
+        case PE_ERR_MAP:         return "Unable to map file";
+        case PE_ERR_NOMEM:       return "Out of memory";
+        case PE_ERR_RANGE:       return "Out of range";
+        default:                 return "Unknown error";
+    }
+}
+
+char const *
+pe_path( struct pe_file const *f ){
+    return f->path;
+}
+
+unsigned char const *
+pe_data( struct pe_file const *f ){
+    return f->map_addr;
+}
+
+size_t
+pe_size( struct pe_file const *f ){
+    return f->map_size;
+}
+
+enum pe_variant
+pe_variant( struct pe_file const *f ){
+    return f->variant;
+}
+
+size_t
+pe_sym_entsize( enum pe_variant v ){
+    return pe_variant_sizes[v].sym;
+}
+
+size_t
+pe_dyn_entsize( enum pe_variant v ){
+    return pe_variant_sizes[v].dyn;
+}
+
+void
+pe_sym_read( enum pe_variant v, unsigned char const *p, Elf64_Sym *sym ){
+    switch( v ){
+#define SYM_READ( sfx, id, bits, enc ) \
+        case id: pe_sym_##sfx( p, sym ); break;
+        PE_VARIANTS( SYM_READ )
+#undef SYM_READ
+    }
+}
+
+bool
+pe_dynamic_converted( struct pe_file const *f, Elf64_Dyn const **dyn, size_t *count, int *rc ){
+    if( !f->converted ){
+        return false;
+    }
+    *dyn = f->dyn_native;
+    *count = f->dyn_count;
+    *rc = f->dyn_rc;
+    return true;
+}
+
+Elf64_Ehdr const *
+pe_ehdr( struct pe_file const *f ){
+    return f->ehdr;
+}
+
+size_t
+pe_phnum( struct pe_file const *f ){
+    return f->phnum;
+}
+
+size_t
+pe_phdr_offset( struct pe_file const *f, size_t i ){
+    Elf64_Ehdr const *e = pe_ehdr( f );
+    return e->e_phoff + i * e->e_phentsize;
+}
+
+Elf64_Phdr const *
+pe_phdr( struct pe_file const *f, size_t i ){
+    if( i >= f->phnum ){
+        return NULL;
+    }
+    return (Elf64_Phdr const *)( f->phdrs + i * f->phent );
+}
+
+size_t
+pe_shnum( struct pe_file const *f ){
+    return f->shnum;
+}
+
+size_t
+pe_shdr_offset( struct pe_file const *f, size_t i ){
+    Elf64_Ehdr const *e = pe_ehdr( f );
+    return e->e_shoff + i * e->e_shentsize;
+}
+
+Elf64_Shdr const *
+pe_shdr( struct pe_file const *f, size_t i ){
+    if( i >= f->shnum ){
+        return NULL;
+    }
+    return (Elf64_Shdr const *)( f->shdrs + i * f->shent );
+}
+
+int
+pe_section_data( struct pe_file const *f, Elf64_Shdr const *sh,
+        unsigned char const **data, size_t *len ){
+    int rc;
+
+    *data = NULL;
+    *len = 0;
+    if( SHT_NOBITS == sh->sh_type || !table_fits( f->map_size, sh->sh_offset, 1, sh->sh_size ) ){
+        return PE_ERR_RANGE;
+    }
+    if( PE_OK != ( rc = pe_file_range( f, sh->sh_offset, sh->sh_size, data ) ) ){
+        return rc;
+    }
+    *len = sh->sh_size;
+    return PE_OK;
+}
+
+size_t
+pe_shstrndx( struct pe_file const *f ){
+    return f->shstrndx;
+}
+
+char const *
+pe_section_name( struct pe_file const *f, Elf64_Shdr const *sh ){
+    if( NULL == f->shstrtab || sh->sh_name >= f->shstrtab_len ){
+        return NULL;
+    }
+    // The name must be terminated inside the table.
+    if( NULL == memchr( f->shstrtab + sh->sh_name, 0, f->shstrtab_len - sh->sh_name ) ){
+        return NULL;
+    }
+    return (char const *)f->shstrtab + sh->sh_name;
+}
+
+// FNV-1a.  Section names are short, so something cheap is enough.
+static uint32_t
+name_hash( char const *s ){
+    uint32_t h = 2166136261u;
+    for( ; *s; s++ ){
+        h = ( h ^ (unsigned char)*s ) * 16777619u;
+    }
+    return h;
+}
+
+// Open-addressed table at a load factor of at most one half.  Sections are
+// inserted in index order and never displace an existing entry with the
+// same name, so lookups find the first section of a given name.
+static struct name_slot *
+build_name_index( struct pe_file *f ){
+    size_t nslots = 16;
+    struct name_slot *slots;
+
+    while( nslots < 2 * f->shnum ){
+        nslots *= 2;
+    }
+    slots = calloc( nslots, sizeof( struct name_slot ) );
+    if( NULL == slots ){
+        return NULL;
+    }
+    for( size_t i = 0; i < f->shnum; i++ ){
+        char const *name = pe_section_name( f, pe_shdr( f, i ) );
+        if( NULL == name ){
+            continue;
+        }
+        uint32_t h = name_hash( name );
+        for( size_t j = h & ( nslots - 1 ); ; j = ( j + 1 ) & ( nslots - 1 ) ){
+            if( 0 == slots[j].index ){
+                slots[j] = (struct name_slot){ h, (uint32_t)( i + 1 ) };
+                break;
+            }
+            if( slots[j].hash == h
+                    && 0 == strcmp( name, pe_section_name( f, pe_shdr( f, slots[j].index - 1 ) ) ) ){
+                break;
+            }
+        }
+    }
+    f->name_mask = nslots - 1;
+    return slots;
+}
+
+Elf64_Shdr const *
+pe_section_by_name( struct pe_file const *cf, char const *name ){
+    struct pe_file *f = (struct pe_file *)cf;   // The index is a cache.
+    struct name_slot *slots = atomic_load_explicit( &f->name_index, memory_order_acquire );
+    uint32_t h;
+
+    if( NULL == slots ){
+        pthread_mutex_lock( &f->name_lock );
+        slots = atomic_load_explicit( &f->name_index, memory_order_relaxed );
+        if( NULL == slots ){
+            slots = build_name_index( f );
+            atomic_store_explicit( &f->name_index, slots, memory_order_release );
+        }
+        pthread_mutex_unlock( &f->name_lock );
+        if( NULL == slots ){
+            return NULL;
+        }
+    }
+
+    h = name_hash( name );
+    for( size_t j = h & f->name_mask; slots[j].index; j = ( j + 1 ) & f->name_mask ){
+        if( slots[j].hash == h ){
+            Elf64_Shdr const *sh = pe_shdr( f, slots[j].index - 1 );
+            if( 0 == strcmp( name, pe_section_name( f, sh ) ) ){
+                return sh;
+            }
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,392 @@
+/* libparse_elf.h
+ *
+ * Reentrant ELF parsing library.  All state for a file lives in an opaque
+ * struct pe_file, so any number of files can be open at once on any number
+ * of threads.  A single pe_file may be read from several threads at once;
+ * opening and closing it must not race with anything else using it.
+ *
+ * Functions that can fail return a PE_* code (PE_OK is zero) rather than
+ * asserting; pe_strerror() turns a code into text.
+ */
+#ifndef LIBPARSE_ELF_H
+#define LIBPARSE_ELF_H
+
+#include <stddef.h>     // size_t, ptrdiff_t
+#include <stdint.h>     // uint32_t
+#include <stdbool.h>    // bool
+#include <string.h>     // memcpy(3)
+#include <elf.h>        // Elf64_*
+
+enum pe_err {
+    PE_OK = 0,
+    PE_ERR_OPEN,            // open(2) or fstat(2) failed, see errno
+    PE_ERR_NOT_ELF,         // No ELF magic number
+    PE_ERR_UNSUPPORTED,     // ELF class or data encoding not handled
+    PE_ERR_TRUNCATED,       // A header or table runs past the end of the file
+    PE_ERR_MAP,             // mmap(2) failed, see errno
+    PE_ERR_NOMEM,           // Memory allocation failed
+    PE_ERR_RANGE,           // Index or offset out of range
+};
+
+struct pe_file;
+
+// Open and map path.  On success *f is set and must be released with
+// pe_close().  On failure *f is NULL.
+int pe_open( char const *path, struct pe_file **f );
+
+// As pe_open(), choosing how the file gets into memory:
+//
+//   PE_IO_MMAP        mmap(2), pages faulted in as they are touched
+//   PE_IO_POPULATE    mmap(2) with MAP_POPULATE, everything faulted up front
+//   PE_IO_SEQUENTIAL  mmap(2), then madvise(MADV_SEQUENTIAL)
+//   PE_IO_WILLNEED    mmap(2), then madvise(MADV_WILLNEED)
+//   PE_IO_PREAD       pread(2) of the whole file into a buffer
+//   PE_IO_DIRECT      The same with O_DIRECT, bypassing the page cache
+//   PE_IO_LAZY        Nothing up front; the headers, the header tables and
+//                     each range asked for are mapped on first use
+//
+// The read strategies reuse one page-aligned buffer per thread from file to
+// file.  pe_bytes_read() is what f took through pread(2), including the
+// magic number check; faults on a mapping aren't counted.
+enum pe_io {
+    PE_IO_MMAP = 0,
+    PE_IO_POPULATE,
+    PE_IO_SEQUENTIAL,
+    PE_IO_WILLNEED,
+    PE_IO_PREAD,
+    PE_IO_DIRECT,
+    PE_IO_LAZY,
+};
+
+int pe_open_io( char const *path, enum pe_io io, struct pe_file **f );
+size_t pe_bytes_read( struct pe_file const *f );
+
+// Read a file from a pipe or other unmappable descriptor, to the end, under
+// the given name.  Non-ELF input is rejected as soon as the magic number has
+// arrived.  Streams up to window bytes are kept whole.  Of longer ones only
+// the first and last half window survive; that covers the ELF header,
+// program headers and (normally, at the end) the section header table, but
+// ranges in the dropped middle give PE_ERR_RANGE.
+int pe_open_stream( int fd, char const *name, size_t window, struct pe_file **f );
+
+// ELF class and data encoding, from e_ident.  Every file is presented in
+// Elf64 form in host byte order whatever its variant: the headers and the
+// dynamic array are converted once at open, and table walkers (symbols,
+// relocations, RELR, hash tables) are specialized per variant so they pick
+// a decoder once per table rather than testing per field.  Code reading
+// raw table entries itself uses the pe_*_read() decoders below, which take
+// the entry sizes of the file's own class.
+enum pe_variant {
+    PE_ELF64_LSB = 0,
+    PE_ELF64_MSB,
+    PE_ELF32_LSB,
+    PE_ELF32_MSB,
+};
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PE_NATIVE PE_ELF64_LSB
+#else
+#define PE_NATIVE PE_ELF64_MSB
+#endif
+
+enum pe_variant pe_variant( struct pe_file const *f );
+
+// Size of one symbol / dynamic entry in a file of variant v, and the symbol
+// at p decoded.
+size_t pe_sym_entsize( enum pe_variant v );
+size_t pe_dyn_entsize( enum pe_variant v );
+void pe_sym_read( enum pe_variant v, unsigned char const *p, Elf64_Sym *sym );
+
+// Unmap and free everything belonging to f.  f may be NULL.
+void pe_close( struct pe_file *f );
+
+char const *pe_strerror( int err );
+
+// The path f was opened with, the raw file contents (NULL for a file opened
+// with PE_IO_LAZY) and the file size.
+char const *pe_path( struct pe_file const *f );
+unsigned char const *pe_data( struct pe_file const *f );
+size_t pe_size( struct pe_file const *f );
+
+// Bytes [off, off + len) of the file, mapping them first under PE_IO_LAZY.
+// Works for any file, so code that wants part of the file should use this
+// rather than pe_data().  PE_ERR_TRUNCATED if the range isn't all inside
+// the file, PE_ERR_MAP if it can't be mapped.
+int pe_file_range( struct pe_file const *f, uint64_t off, uint64_t len, unsigned char const **p );
+
+Elf64_Ehdr const *pe_ehdr( struct pe_file const *f );
+
+// Program and section header iteration:
+//
+//     for( size_t i = 0; i < pe_phnum( f ); i++ ){
+//         Elf64_Phdr const *ph = pe_phdr( f, i );
+//         ...
+//     }
+//
+// Both tables are bounds-checked by pe_open(), so for i below the count the
+// accessors never return NULL.  Entries are located using e_phentsize and
+// e_shentsize, not sizeof; for a file that isn't PE_NATIVE they are
+// converted copies, and those fields still describe the file.  The counts
+// follow extended numbering: when e_shnum is 0 or e_phnum is PN_XNUM the
+// real count is section 0's sh_size or sh_info.
+size_t pe_phnum( struct pe_file const *f );
+Elf64_Phdr const *pe_phdr( struct pe_file const *f, size_t i );
+size_t pe_shnum( struct pe_file const *f );
+Elf64_Shdr const *pe_shdr( struct pe_file const *f, size_t i );
+
+// File offset of program / section header i, as shown in listings.
+size_t pe_phdr_offset( struct pe_file const *f, size_t i );
+size_t pe_shdr_offset( struct pe_file const *f, size_t i );
+
+// Contents of a section.  Returns PE_ERR_RANGE for SHT_NOBITS sections and
+// for sections that extend past the end of the file, otherwise whatever
+// pe_file_range() said (e.g. PE_ERR_MAP for a lazy window that failed, or
+// PE_ERR_RANGE for part of a stream that wasn't kept).
+int pe_section_data( struct pe_file const *f, Elf64_Shdr const *sh,
+        unsigned char const **data, size_t *len );
+
+// Index of the section holding section names (e_shstrndx, or section 0's
+// sh_link when e_shstrndx is SHN_XINDEX).  SHN_UNDEF if there is none.
+size_t pe_shstrndx( struct pe_file const *f );
+
+// Name of a section, or NULL if it can't be resolved.
+char const *pe_section_name( struct pe_file const *f, Elf64_Shdr const *sh );
+
+// First section with the given name, or NULL.  The first call builds a hash
+// index of all section names, after which lookups are O(1).  Safe to call
+// from several threads at once.
+Elf64_Shdr const *pe_section_by_name( struct pe_file const *f, char const *name );
+
+// Address-sorted index over the symbols of the first section of type
+// sh_type (SHT_SYMTAB or SHT_DYNSYM).  Only symbols that name an address are
+// kept: undefined, absolute, section, file and TLS symbols are dropped.  The
+// index is independent of f's lifetime except for names, which point into
+// f's mapping.  Returns PE_ERR_RANGE if there is no such section.
+struct pe_symtab;
+
+struct pe_sym {
+    uint64_t value;
+    uint64_t size;
+    uint32_t name;          // Offset into the linked string table
+    uint8_t info;           // ELF64_ST_TYPE / ELF64_ST_BIND
+    uint32_t shndx;         // SHN_XINDEX resolved through SHT_SYMTAB_SHNDX
+};
+
+int pe_symtab_build( struct pe_file const *f, uint32_t sh_type, struct pe_symtab **st );
+void pe_symtab_free( struct pe_symtab *st );
+
+// Entries are numbered in address order, 0 to pe_symtab_count() - 1.
+size_t pe_symtab_count( struct pe_symtab const *st );
+void pe_symtab_get( struct pe_symtab const *st, size_t i, struct pe_sym *sym );
+char const *pe_symtab_name( struct pe_symtab const *st, size_t i );
+
+// The entry covering addr: the last one starting at or below addr, provided
+// addr is inside it (or equal to its value, for zero-sized symbols).  -1 if
+// there is none.  Only that nearest entry is checked: an address past its
+// end is not found even if an earlier, larger symbol overlaps it.
+ptrdiff_t pe_symtab_lookup( struct pe_symtab const *st, uint64_t addr );
+
+// Name lookups through the file's own dynamic symbol hash table: the one
+// DT_GNU_HASH (else DT_HASH) points at, as the loader finds it, or for files
+// without a usable dynamic section the SHT_GNU_HASH (else SHT_HASH)
+// section.  No index is built; a miss usually costs one Bloom filter word,
+// a hit one chain walk.
+// pe_dynhash_open() fills in *h, which holds pointers into f's mapping and
+// needs no freeing.  Returns PE_ERR_RANGE if f has neither table.
+struct pe_dynhash {
+    uint32_t type;                  // SHT_GNU_HASH or SHT_HASH
+    enum pe_variant variant;
+    unsigned char const *hash, *syms, *strs;
+    size_t hash_len, syms_len, strs_len;
+    size_t sym_entsize, nsyms;
+
+    uint32_t nbuckets;
+    uint32_t symoffset;             // GNU only
+    uint32_t bloom_size;            // GNU only, in address-sized words
+    uint32_t bloom_shift;           // GNU only
+    unsigned char const *bloom;     // GNU only
+    unsigned char const *buckets;
+    unsigned char const *chains;
+    size_t nchains;
+};
+
+int pe_dynhash_open( struct pe_file const *f, struct pe_dynhash *h );
+
+// Whether name is a defined dynamic symbol.  If so and sym isn't NULL the
+// symbol is decoded into *sym.
+bool pe_dynhash_lookup( struct pe_dynhash const *h, char const *name, Elf64_Sym *sym );
+
+// Dynamic linking information, located through PT_DYNAMIC.
+//
+// pe_vaddr_offset() maps a virtual address to a file offset through the
+// PT_LOAD segments (PE_ERR_RANGE if no segment has it in its file image).
+// pe_dynamic() returns the entries of the dynamic array up to, but not
+// including, DT_NULL, pointing into f's mapping (or, for a file that isn't
+// PE_NATIVE, into a copy converted at open); PE_ERR_RANGE if there is no
+// PT_DYNAMIC.  pe_dynamic_value() returns the first entry with the given
+// tag, or dflt.  pe_dynamic_strtab() locates DT_STRTAB / DT_STRSZ, for
+// DT_NEEDED and other string-valued entries (pe_dtag_is_string()).
+int pe_vaddr_offset( struct pe_file const *f, uint64_t vaddr, uint64_t *off );
+int pe_dynamic( struct pe_file const *f, Elf64_Dyn const **dyn, size_t *count );
+uint64_t pe_dynamic_value( Elf64_Dyn const *dyn, size_t count, int64_t tag, uint64_t dflt );
+int pe_dynamic_strtab( struct pe_file const *f, unsigned char const **tab, size_t *len );
+bool pe_dtag_is_string( int64_t tag );
+
+// The NUL-terminated string at off in the len-byte table tab, or NULL if off
+// is out of range or the string runs off the end of the table.
+char const *pe_string( unsigned char const *tab, size_t len, uint64_t off );
+
+// Relocations, decoded one entry at a time straight from the mapping.
+//
+//     struct pe_reloc_iter it;
+//     struct pe_reloc r;
+//     if( PE_OK == pe_reloc_begin( f, sh, &it ) ){
+//         while( pe_reloc_next( &it, &r ) ){
+//             ...
+//         }
+//     }
+//
+// pe_reloc_begin() takes an SHT_REL or SHT_RELA section; pe_reloc_table()
+// takes a raw table, e.g. one found through DT_RELA / DT_RELASZ, in a file
+// of the given variant.  Either one picks the decoder for the table's
+// variant, so pe_reloc_next() doesn't look at the variant per entry.  Only
+// call pe_reloc_next() on an iterator they set up successfully.
+struct pe_reloc {
+    uint64_t offset;
+    uint32_t type;
+    uint32_t sym;
+    int64_t addend;                 // 0 for REL
+};
+
+struct pe_reloc_iter {
+    unsigned char const *p;
+    unsigned char const *end;
+    size_t entsize;
+    bool rela;
+    enum pe_variant variant;
+    bool (*next)( struct pe_reloc_iter *it, struct pe_reloc *r );
+};
+
+int pe_reloc_begin( struct pe_file const *f, Elf64_Shdr const *sh, struct pe_reloc_iter *it );
+int pe_reloc_table( enum pe_variant v, unsigned char const *data, size_t len, bool rela,
+        size_t entsize, struct pe_reloc_iter *it );
+
+static inline bool
+pe_reloc_next( struct pe_reloc_iter *it, struct pe_reloc *r ){
+    return it->next( it, r );
+}
+
+// Per-type and per-symbol counts, accumulated by pe_reloc_count() in a
+// single pass over it.  Zero the struct first; to count references per
+// symbol, point sym_refs at nsyms zeroed counters for the symbol table the
+// relocations refer to (the section's sh_link).
+#define PE_RELOC_NTYPES 2048        // r_type values counted individually
+
+struct pe_reloc_hist {
+    uint64_t count;
+    uint64_t by_type[PE_RELOC_NTYPES];
+    uint64_t other_type;            // r_type >= PE_RELOC_NTYPES
+    uint64_t no_symbol;             // Symbol index 0
+    uint64_t bad_symbol;            // Symbol index >= nsyms
+    uint32_t *sym_refs;
+    size_t nsyms;
+};
+
+void pe_reloc_count( struct pe_reloc_iter it, struct pe_reloc_hist *h );
+
+// Number of relocations packed into an SHT_RELR / DT_RELR table, and the
+// addresses they relocate.  Entries are address-sized words of variant v.
+typedef void (*pe_relr_fn)( uint64_t addr, void *arg );
+uint64_t pe_relr_count( enum pe_variant v, unsigned char const *data, size_t len );
+void pe_relr_foreach( enum pe_variant v, unsigned char const *data, size_t len,
+        pe_relr_fn fn, void *arg );
+
+// The relocation tables the loader processes, found through the dynamic
+// section: tag is DT_RELA, DT_REL or DT_JMPREL (whose format is given by
+// DT_PLTREL).  PE_ERR_RANGE if the file has no such table.
+int pe_dynamic_relocs( struct pe_file const *f, int64_t tag, struct pe_reloc_iter *it );
+int pe_dynamic_relr( struct pe_file const *f, unsigned char const **data, size_t *len );
+
+// The dynamic symbol table, bounded by its section header if there is one.
+// Entries are *entsize bytes apart (sh_entsize, else DT_SYMENT), never less
+// than pe_sym_entsize(); decode them with pe_sym_read().
+int pe_dynamic_symtab( struct pe_file const *f, unsigned char const **syms, size_t *nsyms,
+        size_t *entsize );
+
+// The table at the address in tag (e.g. DT_GNU_HASH), for tables whose size
+// the dynamic section doesn't give: *len is the file image from there to
+// the end of its PT_LOAD segment.  PE_ERR_RANGE if the file has no tag.
+int pe_dynamic_data( struct pe_file const *f, int64_t tag, unsigned char const **data, size_t *len );
+
+// Whether a PT_LOAD segment can be mapped with 2 MiB pages, and how many
+// TLB entries it needs.  The tlb_* counts are the pages the segment spans
+// with 4 KiB pages only, with 2 MiB pages only, and with huge_pages 2 MiB
+// pages plus 4 KiB pages for the rest.  pe_load_align() is the alignment
+// of the load base of an ET_DYN file, the largest PT_LOAD p_align.
+#define PE_PAGE_SZ (4096ull)
+#define PE_HUGE_PAGE_SZ (2ull << 20)
+
+struct pe_huge {
+    bool offset_aligned;            // p_offset is 2 MiB aligned
+    bool vaddr_aligned;             // p_vaddr is 2 MiB aligned
+    bool congruent;                 // p_offset and p_vaddr agree mod 2 MiB
+    bool base_aligned;              // Loading keeps vaddr's 2 MiB alignment
+    bool eligible;                  // huge_pages > 0
+    uint64_t huge_pages;            // 2 MiB windows of the file image
+    uint64_t tlb_4k;
+    uint64_t tlb_2m;
+    uint64_t tlb_mixed;
+};
+
+uint64_t pe_load_align( struct pe_file const *f );
+void pe_huge_pages( struct pe_file const *f, Elf64_Phdr const *ph, struct pe_huge *hp );
+
+// Page-cache residency of a file, one byte per page as returned by
+// mincore(2), taken without reading the file.  Call it before pe_open(),
+// which pulls in the headers and whatever readahead brings with them.
+// The kernel only reports page-cache state to callers that own the file or
+// could open it for writing; for anyone else it counts only pages mapped
+// into this process, so expect next to nothing.
+//
+// pe_resident_range() counts the pages covering [off, off + len), and how
+// many of them are resident.  pe_advise() asks the kernel to read the range
+// in, or to drop it from the page cache (clean, unmapped pages only);
+// len 0 means to the end of the file.
+struct pe_residency {
+    unsigned char *vec;
+    size_t npages;
+    size_t page_size;
+};
+
+enum pe_advice {
+    PE_ADVISE_PREFETCH,
+    PE_ADVISE_EVICT,
+};
+
+int pe_mincore( char const *path, struct pe_residency *r );
+void pe_residency_free( struct pe_residency *r );
+void pe_resident_range( struct pe_residency const *r, uint64_t off, uint64_t len,
+        uint64_t *pages, uint64_t *resident );
+int pe_advise( char const *path, uint64_t off, uint64_t len, enum pe_advice advice );
+
+// Descriptions of enumerated header fields (e_ident[EI_CLASS], EI_DATA,
+// EI_VERSION / e_version, EI_OSABI, e_type, e_machine, p_type, sh_type,
+// a symbol's type and binding, d_tag, and relocation types, which depend
+// on e_machine).
+// These are plain table lookups; unknown values return NULL and it is up to
+// the caller to format them.
+char const *pe_class_name( unsigned v );
+char const *pe_data_name( unsigned v );
+char const *pe_version_name( uint32_t v );
+char const *pe_osabi_name( unsigned v );
+char const *pe_etype_name( unsigned v );
+char const *pe_machine_name( unsigned v );
+char const *pe_ptype_name( uint32_t v );
+char const *pe_shtype_name( uint32_t v );
+char const *pe_symtype_name( unsigned v );
+char const *pe_symbind_name( unsigned v );
+char const *pe_dtag_name( int64_t v );
+char const *pe_reloc_type_name( unsigned machine, uint32_t v );
+char const *pe_io_name( unsigned v );               // enum pe_io
+
+#endif // LIBPARSE_ELF_H
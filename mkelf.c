@@ -0,0 +1,492 @@
+/* mkelf.c
+ *
+ * Synthetic ELF writer.  Produces a small shared object in any of the four
+ * class / data encoding combinations, with the same contents in each: the
+ * same section indices, symbol names, values and sizes, relocation types
+ * and symbol references, and dynamic entries.  Only the field widths, the
+ * byte order and therefore the offsets differ, so the output of parse_elf
+ * over the variants can be compared record for record.
+ *
+ *     mkelf [-c 32|64] [-e lsb|msb] [-n <symbols>] [-r <relocs>]
+ *           [-H gnu|sysv] [-S <sections>] [-P <segments>] [-T <bytes>]
+ *           [-X] -o <file>
+ *
+ * Layout, in file order: ELF header, program headers (PT_LOAD over the
+ * whole file plus .bss, PT_DYNAMIC), .dynsym, .dynstr, the hash table,
+ * .rela.dyn, .dynamic, .symtab, .shstrtab, section headers.  The counts
+ * can be scaled up to build benchmark inputs (see tests/bench.sh): -P adds
+ * that many PT_NULL program headers, -T a .strtab section of about that
+ * many bytes of short strings, and -S that many empty sections named
+ * .text.0, .text.1, ... after all the others.  With SHN_LORESERVE sections
+ * or PN_XNUM segments or more, or when -X asks for it regardless, the
+ * file uses extended numbering: e_shnum, e_phnum and e_shstrndx defer to
+ * section 0, and .symtab's section indices move to a .symtab_shndx
+ * section (placed after .symtab, numbered right after .shstrtab).  Symbols are
+ * objects in .bss, 16 bytes apart.  Relocations alternate between
+ * R_*_RELATIVE and R_*_GLOB_DAT against successive symbols.  e_machine is
+ * EM_X86_64 or EM_386 whatever the byte order, so the relocation types
+ * mean the same thing in every variant.
+ */
+
+#include <stdio.h>      // fprintf(3), fopen(3), fwrite(3)
+#include <stdlib.h>     // calloc(3), free(3), strtoull(3), exit(3)
+#include <string.h>     // memcpy(3), strcmp(3), strlen(3)
+#include <stdint.h>     // uint64_t and friends
+#include <stdbool.h>    // bool
+#include <getopt.h>     // getopt(3)
+#include <assert.h>     // assert(3)
+#include <elf.h>        // Elf32_*, Elf64_*
+
+// Section indices, the same in every variant.
+enum {
+    S_NULL, S_DYNSYM, S_DYNSTR, S_HASH, S_RELA, S_DYNAMIC, S_BSS, S_SYMTAB, S_SHSTRTAB,
+    S_COUNT
+};
+
+struct image {
+    unsigned char *buf;
+    size_t len;
+    unsigned bits;              // 32 or 64
+    bool msb;
+};
+
+static void
+put( struct image *im, size_t off, uint64_t v, unsigned size ){
+    assert( off + size <= im->len );
+    for( unsigned i = 0; i < size; i++ ){
+        unsigned shift = 8 * ( im->msb ? size - 1 - i : i );
+        im->buf[ off + i ] = (unsigned char)( v >> shift );
+    }
+}
+
+// An address-sized field.
+static unsigned
+word( struct image const *im ){
+    return im->bits / 8;
+}
+
+static size_t
+put_ehdr( struct image *im, Elf64_Ehdr const *e ){
+    size_t o = EI_NIDENT, w = word( im );
+
+    memcpy( im->buf, e->e_ident, EI_NIDENT );
+    put( im, o, e->e_type, 2 );         o += 2;
+    put( im, o, e->e_machine, 2 );      o += 2;
+    put( im, o, e->e_version, 4 );      o += 4;
+    put( im, o, e->e_entry, w );        o += w;
+    put( im, o, e->e_phoff, w );        o += w;
+    put( im, o, e->e_shoff, w );        o += w;
+    put( im, o, e->e_flags, 4 );        o += 4;
+    put( im, o, e->e_ehsize, 2 );       o += 2;
+    put( im, o, e->e_phentsize, 2 );    o += 2;
+    put( im, o, e->e_phnum, 2 );        o += 2;
+    put( im, o, e->e_shentsize, 2 );    o += 2;
+    put( im, o, e->e_shnum, 2 );        o += 2;
+    put( im, o, e->e_shstrndx, 2 );     o += 2;
+    return o;
+}
+
+// p_flags moves: after p_type in ELF64, after p_memsz in ELF32.
+static void
+put_phdr( struct image *im, size_t o, Elf64_Phdr const *p ){
+    size_t w = word( im );
+
+    put( im, o, p->p_type, 4 );         o += 4;
+    if( 64 == im->bits ){
+        put( im, o, p->p_flags, 4 );    o += 4;
+    }
+    put( im, o, p->p_offset, w );       o += w;
+    put( im, o, p->p_vaddr, w );        o += w;
+    put( im, o, p->p_paddr, w );        o += w;
+    put( im, o, p->p_filesz, w );       o += w;
+    put( im, o, p->p_memsz, w );        o += w;
+    if( 32 == im->bits ){
+        put( im, o, p->p_flags, 4 );    o += 4;
+    }
+    put( im, o, p->p_align, w );
+}
+
+static void
+put_shdr( struct image *im, size_t o, Elf64_Shdr const *s ){
+    size_t w = word( im );
+
+    put( im, o, s->sh_name, 4 );        o += 4;
+    put( im, o, s->sh_type, 4 );        o += 4;
+    put( im, o, s->sh_flags, w );       o += w;
+    put( im, o, s->sh_addr, w );        o += w;
+    put( im, o, s->sh_offset, w );      o += w;
+    put( im, o, s->sh_size, w );        o += w;
+    put( im, o, s->sh_link, 4 );        o += 4;
+    put( im, o, s->sh_info, 4 );        o += 4;
+    put( im, o, s->sh_addralign, w );   o += w;
+    put( im, o, s->sh_entsize, w );
+}
+
+// st_value and st_size come after st_name in ELF32, last in ELF64.
+static void
+put_sym( struct image *im, size_t o, Elf64_Sym const *s ){
+    put( im, o, s->st_name, 4 );        o += 4;
+    if( 32 == im->bits ){
+        put( im, o, s->st_value, 4 );   o += 4;
+        put( im, o, s->st_size, 4 );    o += 4;
+    }
+    put( im, o, s->st_info, 1 );        o += 1;
+    put( im, o, s->st_other, 1 );       o += 1;
+    put( im, o, s->st_shndx, 2 );       o += 2;
+    if( 64 == im->bits ){
+        put( im, o, s->st_value, 8 );   o += 8;
+        put( im, o, s->st_size, 8 );
+    }
+}
+
+static void
+put_dyn( struct image *im, size_t o, int64_t tag, uint64_t val ){
+    put( im, o, (uint64_t)tag, word( im ) );
+    put( im, o + word( im ), val, word( im ) );
+}
+
+static void
+put_rela( struct image *im, size_t o, uint64_t offset, uint32_t sym, uint32_t type, int64_t addend ){
+    uint64_t info = 64 == im->bits ? ELF64_R_INFO( (uint64_t)sym, type ) : ELF32_R_INFO( sym, type );
+
+    put( im, o, offset, word( im ) );
+    put( im, o + word( im ), info, word( im ) );
+    put( im, o + 2 * word( im ), (uint64_t)addend, word( im ) );
+}
+
+static uint32_t
+gnu_hash( char const *s ){
+    uint32_t h = 5381;
+    for( ; *s; s++ ){
+        h = h * 33 + (unsigned char)*s;
+    }
+    return h;
+}
+
+static uint32_t
+sysv_hash( char const *s ){
+    uint32_t h = 0, g;
+    for( ; *s; s++ ){
+        h = ( h << 4 ) + (unsigned char)*s;
+        g = h & 0xf0000000;
+        h ^= g >> 24;
+        h &= ~g;
+    }
+    return h;
+}
+
+static size_t
+align( size_t v, size_t a ){
+    return ( v + a - 1 ) & ~( a - 1 );
+}
+
+static void
+usage( void ){
+    fprintf(stderr, "Usage:  mkelf [-c 32|64] [-e lsb|msb] [-n <symbols>] [-r <relocs>]\n");
+    fprintf(stderr, "              [-H gnu|sysv] [-S <sections>] [-P <segments>] [-T <bytes>]\n");
+    fprintf(stderr, "              [-X] -o <file>\n");
+    exit(-1);
+}
+
+// Symbol names, ordered for the hash table: GNU hash wants each bucket's
+// symbols together, in bucket order.
+struct name {
+    char str[24];
+    uint32_t hash;
+};
+
+static uint32_t sort_nbuckets;          // qsort(3) has no context argument
+
+static int
+cmp_bucket( void const *a, void const *b ){
+    uint32_t x = ( (struct name const *)a )->hash % sort_nbuckets;
+    uint32_t y = ( (struct name const *)b )->hash % sort_nbuckets;
+    return x < y ? -1 : x > y;
+}
+
+int
+main( int argc, char **argv ){
+    struct image im = { .bits = 64 };
+    char const *path = NULL;
+    size_t nsyms = 16, nrelocs = 32, nextra = 0, nnull = 0, strtab_len = 0;
+    bool gnu = true, xnum = false;
+    int c;
+
+    while( -1 != ( c = getopt( argc, argv, "c:e:n:r:H:S:P:T:Xo:" ) ) ){
+        switch( c ){
+            case 'c': im.bits = strtoul( optarg, NULL, 10 ); break;
+            case 'e': im.msb = 0 == strcmp( optarg, "msb" ); break;
+            case 'n': nsyms = strtoull( optarg, NULL, 10 ); break;
+            case 'r': nrelocs = strtoull( optarg, NULL, 10 ); break;
+            case 'H': gnu = 0 != strcmp( optarg, "sysv" ); break;
+            case 'S': nextra = strtoull( optarg, NULL, 10 ); break;
+            case 'P': nnull = strtoull( optarg, NULL, 10 ); break;
+            case 'T': strtab_len = strtoull( optarg, NULL, 10 ); break;
+            case 'X': xnum = true; break;
+            case 'o': path = optarg; break;
+            default: usage();
+        }
+    }
+    if( NULL == path || ( 32 != im.bits && 64 != im.bits ) ){
+        usage();
+    }
+
+    bool b64 = 64 == im.bits;
+    size_t w = word( &im );
+    size_t ehsz = b64 ? sizeof( Elf64_Ehdr ) : sizeof( Elf32_Ehdr );
+    size_t phsz = b64 ? sizeof( Elf64_Phdr ) : sizeof( Elf32_Phdr );
+    size_t shsz = b64 ? sizeof( Elf64_Shdr ) : sizeof( Elf32_Shdr );
+    size_t symsz = b64 ? sizeof( Elf64_Sym ) : sizeof( Elf32_Sym );
+    size_t relasz = b64 ? sizeof( Elf64_Rela ) : sizeof( Elf32_Rela );
+    size_t dynsz = 2 * w;
+    char const soname[] = "libsynthetic.so";
+    // .strtab and .symtab_shndx are named even when absent, so the string
+    // tables stay the same either way.
+    char const fixed_names[] =
+            "\0.dynsym\0.dynstr\0.gnu.hash\0.hash\0.rela.dyn\0.dynamic\0.bss\0.symtab\0.shstrtab"
+            "\0.strtab\0.symtab_shndx";
+    static uint32_t const fixed_name[S_COUNT] = { 0, 1, 9, 17, 33, 43, 52, 57, 65 };
+
+    // 0. Sections: the fixed ones, .symtab_shndx if numbering is extended,
+    // .strtab if asked for, then the extra ones.  shname[] has the offset
+    // of each one's name.
+    size_t nphdr = 2 + nnull;
+    xnum = xnum || S_COUNT + 2 + nextra >= SHN_LORESERVE || nphdr >= PN_XNUM;
+    size_t s_xndx = S_COUNT, s_strtab = s_xndx + xnum, s_extra = s_strtab + !!strtab_len;
+    size_t nsecs = s_extra + nextra;
+    uint32_t *shname = calloc( nsecs, sizeof( uint32_t ) );
+    char *shstrtab = malloc( sizeof( fixed_names ) + 32 * nextra );
+    size_t shstrtab_len = sizeof( fixed_names );
+    assert( NULL != shname && NULL != shstrtab );
+    memcpy( shname, fixed_name, sizeof( fixed_name ) );
+    memcpy( shstrtab, fixed_names, sizeof( fixed_names ) );
+    if( xnum ){
+        shname[s_xndx] = sizeof( fixed_names ) - sizeof( ".symtab_shndx" );
+    }
+    if( strtab_len ){
+        shname[s_strtab] = sizeof( fixed_names ) - sizeof( ".symtab_shndx" ) - sizeof( ".strtab" );
+    }
+    for( size_t i = 0; i < nextra; i++ ){
+        shname[ s_extra + i ] = shstrtab_len;
+        shstrtab_len += sprintf(shstrtab + shstrtab_len, ".text.%zu", i) + 1;
+    }
+
+    // 1. Names and, for the hash table, their order.
+    struct name *names = calloc( nsyms + 1, sizeof( struct name ) );
+    size_t dynstr_len = 1 + sizeof( soname );
+    assert( NULL != names );
+    for( size_t i = 0; i < nsyms; i++ ){
+        snprintf(names[i].str, sizeof( names[i].str ), "sym%zu", i);
+        names[i].hash = gnu ? gnu_hash( names[i].str ) : sysv_hash( names[i].str );
+        dynstr_len += strlen( names[i].str ) + 1;
+    }
+    uint32_t nbuckets = nsyms / 4 + 1;
+    uint32_t bloom_size = 1, bloom_shift = 6;
+    while( bloom_size * im.bits < nsyms ){
+        bloom_size *= 2;
+    }
+    if( gnu ){
+        sort_nbuckets = nbuckets;
+        qsort( names, nsyms, sizeof( struct name ), cmp_bucket );
+    }
+
+    // 2. Lay the file out.
+    size_t dynsym_len = ( nsyms + 1 ) * symsz;
+    size_t hash_len = gnu ? 16 + bloom_size * w + 4 * nbuckets + 4 * nsyms
+                          : 8 + 4 * nbuckets + 4 * ( nsyms + 1 );
+    size_t rela_len = nrelocs * relasz;
+    size_t ndyn = 9;
+    size_t off[S_COUNT] = { 0 }, len[S_COUNT] = { 0 };
+    size_t o = align( ehsz, 8 ) + nphdr * phsz;
+    len[S_DYNSYM] = dynsym_len;     off[S_DYNSYM] = o = align( o, 8 );  o += dynsym_len;
+    len[S_DYNSTR] = dynstr_len;     off[S_DYNSTR] = o;                  o += dynstr_len;
+    len[S_HASH] = hash_len;         off[S_HASH] = o = align( o, 8 );    o += hash_len;
+    len[S_RELA] = rela_len;         off[S_RELA] = o = align( o, 8 );    o += rela_len;
+    len[S_DYNAMIC] = ndyn * dynsz;  off[S_DYNAMIC] = o = align( o, 8 ); o += ndyn * dynsz;
+    len[S_SYMTAB] = dynsym_len;     off[S_SYMTAB] = o = align( o, 8 );  o += dynsym_len;
+    size_t xndx_len = xnum ? 4 * ( nsyms + 1 ) : 0, xndx_off = o;       o += xndx_len;
+    size_t strtab_off = o;                                              o += strtab_len;
+    len[S_SHSTRTAB] = shstrtab_len; off[S_SHSTRTAB] = o;                o += shstrtab_len;
+    size_t shoff = align( o, 8 );
+    im.len = shoff + nsecs * shsz;
+    im.buf = calloc( 1, im.len );
+    assert( NULL != im.buf );
+    // Addresses equal file offsets; .bss follows the file image.
+    uint64_t bss = align( im.len, 4096 );
+    len[S_BSS] = 16 * ( nsyms ? nsyms : 1 );
+    off[S_BSS] = im.len;
+
+    // 3. Headers.
+    Elf64_Ehdr e = {
+        .e_ident = { ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3,
+                b64 ? ELFCLASS64 : ELFCLASS32, im.msb ? ELFDATA2MSB : ELFDATA2LSB, EV_CURRENT },
+        .e_type = ET_DYN, .e_machine = b64 ? EM_X86_64 : EM_386, .e_version = EV_CURRENT,
+        .e_phoff = align( ehsz, 8 ), .e_shoff = shoff, .e_ehsize = ehsz,
+        .e_phentsize = phsz, .e_phnum = nphdr, .e_shentsize = shsz, .e_shnum = nsecs,
+        .e_shstrndx = S_SHSTRTAB,
+    };
+    if( xnum ){
+        e.e_shnum = 0;
+        e.e_phnum = PN_XNUM;
+        e.e_shstrndx = SHN_XINDEX;
+    }
+    put_ehdr( &im, &e );
+    put_phdr( &im, e.e_phoff, &(Elf64_Phdr){ .p_type = PT_LOAD, .p_flags = PF_R | PF_W,
+            .p_filesz = im.len, .p_memsz = bss + len[S_BSS], .p_align = 4096 } );
+    put_phdr( &im, e.e_phoff + phsz, &(Elf64_Phdr){ .p_type = PT_DYNAMIC, .p_flags = PF_R | PF_W,
+            .p_offset = off[S_DYNAMIC], .p_vaddr = off[S_DYNAMIC], .p_paddr = off[S_DYNAMIC],
+            .p_filesz = len[S_DYNAMIC], .p_memsz = len[S_DYNAMIC], .p_align = w } );
+    for( size_t i = 2; i < nphdr; i++ ){
+        put_phdr( &im, e.e_phoff + i * phsz, &(Elf64_Phdr){ .p_type = PT_NULL } );
+    }
+
+    static uint32_t const shtype[S_COUNT] = {
+        SHT_NULL, SHT_DYNSYM, SHT_STRTAB, SHT_GNU_HASH, SHT_RELA, SHT_DYNAMIC, SHT_NOBITS,
+        SHT_SYMTAB, SHT_STRTAB };
+    for( unsigned i = 0; i < S_COUNT; i++ ){
+        Elf64_Shdr sh = {
+            .sh_name = S_HASH == i && !gnu ? shname[i] + 10 : shname[i],
+            .sh_type = S_HASH == i && !gnu ? SHT_HASH : shtype[i],
+            .sh_offset = off[i], .sh_size = len[i],
+            .sh_addr = S_BSS == i ? bss : S_SYMTAB == i || S_SHSTRTAB == i ? 0 : off[i],
+            .sh_addralign = S_DYNSTR == i || S_SHSTRTAB == i ? 1 : w,
+        };
+        if( S_NULL == i ){
+            sh = (Elf64_Shdr){ 0 };
+            if( xnum ){
+                sh.sh_size = nsecs;
+                sh.sh_link = S_SHSTRTAB;
+                sh.sh_info = nphdr;
+            }
+        }
+        switch( i ){
+            case S_DYNSYM:  case S_SYMTAB:
+                sh.sh_link = S_DYNSTR; sh.sh_info = 1; sh.sh_entsize = symsz; break;
+            case S_HASH:    sh.sh_link = S_DYNSYM; sh.sh_entsize = gnu ? 0 : 4; break;
+            case S_RELA:    sh.sh_link = S_DYNSYM; sh.sh_entsize = relasz; break;
+            case S_DYNAMIC: sh.sh_link = S_DYNSTR; sh.sh_entsize = dynsz; break;
+        }
+        put_shdr( &im, shoff + i * shsz, &sh );
+    }
+    if( xnum ){
+        put_shdr( &im, shoff + s_xndx * shsz, &(Elf64_Shdr){ .sh_name = shname[s_xndx],
+                .sh_type = SHT_SYMTAB_SHNDX, .sh_offset = xndx_off, .sh_size = xndx_len,
+                .sh_link = S_SYMTAB, .sh_addralign = 4, .sh_entsize = 4 } );
+    }
+    if( strtab_len ){
+        put_shdr( &im, shoff + s_strtab * shsz, &(Elf64_Shdr){ .sh_name = shname[s_strtab],
+                .sh_type = SHT_STRTAB, .sh_offset = strtab_off, .sh_size = strtab_len,
+                .sh_addralign = 1 } );
+        // Strings of up to 12 bytes with their NULs, the last one cut
+        // short to fit.
+        o = strtab_off + 1;
+        for( size_t i = 0, room; o < strtab_off + strtab_len; i++ ){
+            room = strtab_off + strtab_len - o;
+            size_t n = snprintf((char *)im.buf + o, room < 12 ? room : 12, "s%zu", i) + 1;
+            o += n < room ? n : room;
+        }
+    }
+    for( size_t i = s_extra; i < nsecs; i++ ){
+        put_shdr( &im, shoff + i * shsz, &(Elf64_Shdr){ .sh_name = shname[i],
+                .sh_type = SHT_PROGBITS, .sh_flags = SHF_ALLOC | SHF_EXECINSTR,
+                .sh_offset = off[S_SHSTRTAB], .sh_addralign = 1 } );
+    }
+    memcpy( im.buf + off[S_SHSTRTAB], shstrtab, shstrtab_len );
+
+    // 4. Symbols and their names.
+    size_t str = 1 + sizeof( soname );
+    memcpy( im.buf + off[S_DYNSTR] + 1, soname, sizeof( soname ) );
+    for( size_t i = 0; i < nsyms; i++ ){
+        Elf64_Sym s = {
+            .st_name = str, .st_info = ELF64_ST_INFO( STB_GLOBAL, STT_OBJECT ),
+            .st_shndx = S_BSS, .st_value = bss + 16 * i, .st_size = 16,
+        };
+        size_t n = strlen( names[i].str ) + 1;
+        memcpy( im.buf + off[S_DYNSTR] + str, names[i].str, n );
+        str += n;
+        put_sym( &im, off[S_DYNSYM] + ( i + 1 ) * symsz, &s );
+        if( xnum ){
+            s.st_shndx = SHN_XINDEX;
+            put( &im, xndx_off + 4 * ( i + 1 ), S_BSS, 4 );
+        }
+        put_sym( &im, off[S_SYMTAB] + ( i + 1 ) * symsz, &s );
+    }
+
+    // 5. The hash table.
+    o = off[S_HASH];
+    if( gnu ){
+        put( &im, o, nbuckets, 4 );
+        put( &im, o + 4, 1, 4 );                // symoffset
+        put( &im, o + 8, bloom_size, 4 );
+        put( &im, o + 12, bloom_shift, 4 );
+        size_t bloom = o + 16, buckets = bloom + bloom_size * w, chains = buckets + 4 * nbuckets;
+        for( size_t i = 0; i < nsyms; i++ ){
+            uint32_t h = names[i].hash, b = h % nbuckets;
+            size_t at = bloom + ( ( h / im.bits ) & ( bloom_size - 1 ) ) * w;
+            uint64_t mask = ( 1ull << ( h % im.bits ) ) | ( 1ull << ( ( h >> bloom_shift ) % im.bits ) );
+            uint64_t cur = 0;
+            for( unsigned k = 0; k < w; k++ ){
+                cur |= (uint64_t)im.buf[ at + k ] << 8 * ( im.msb ? w - 1 - k : k );
+            }
+            put( &im, at, cur | mask, w );
+            if( 0 == i || names[i - 1].hash % nbuckets != b ){
+                put( &im, buckets + 4 * b, i + 1, 4 );
+            }
+            bool last = i + 1 == nsyms || names[i + 1].hash % nbuckets != b;
+            put( &im, chains + 4 * i, ( h & ~1u ) | last, 4 );
+        }
+    }else{
+        size_t buckets = o + 8, chains = buckets + 4 * nbuckets;
+        uint32_t *head = calloc( nbuckets, sizeof( uint32_t ) );
+        assert( NULL != head );
+        put( &im, o, nbuckets, 4 );
+        put( &im, o + 4, nsyms + 1, 4 );
+        for( size_t i = 0; i < nsyms; i++ ){
+            uint32_t b = names[i].hash % nbuckets;
+            put( &im, chains + 4 * ( i + 1 ), head[b], 4 );
+            head[b] = i + 1;
+        }
+        for( uint32_t b = 0; b < nbuckets; b++ ){
+            put( &im, buckets + 4 * b, head[b], 4 );
+        }
+        free( head );
+    }
+
+    // 6. Relocations into .bss.
+    for( size_t i = 0; i < nrelocs; i++ ){
+        uint64_t where = bss + ( i * w ) % len[S_BSS];
+        if( i % 2 || 0 == nsyms ){
+            put_rela( &im, off[S_RELA] + i * relasz, where, 0, R_X86_64_RELATIVE, i );
+        }else{
+            put_rela( &im, off[S_RELA] + i * relasz, where, 1 + ( i / 2 ) % nsyms, R_X86_64_GLOB_DAT, 0 );
+        }
+    }
+
+    // 7. The dynamic array.
+    struct { int64_t tag; uint64_t val; } const dyn[] = {
+        { DT_SONAME, 1 },
+        { gnu ? DT_GNU_HASH : DT_HASH, off[S_HASH] },
+        { DT_STRTAB, off[S_DYNSTR] },
+        { DT_SYMTAB, off[S_DYNSYM] },
+        { DT_STRSZ, dynstr_len },
+        { DT_SYMENT, symsz },
+        { DT_RELA, off[S_RELA] },
+        { DT_RELASZ, rela_len },
+        { DT_NULL, 0 },
+    };
+    static_assert( sizeof( dyn ) / sizeof( dyn[0] ) <= 9 );
+    for( size_t i = 0; i < sizeof( dyn ) / sizeof( dyn[0] ); i++ ){
+        put_dyn( &im, off[S_DYNAMIC] + i * dynsz, dyn[i].tag, dyn[i].val );
+    }
+
+    FILE *fp = fopen( path, "wb" );
+    if( NULL == fp || im.len != fwrite( im.buf, 1, im.len, fp ) || 0 != fclose( fp ) ){
+        fprintf(stderr, "mkelf: unable to write %s.\n", path);
+        return 1;
+    }
+    free( im.buf );
+    free( names );
+    free( shname );
+    free( shstrtab );
+    return 0;
+}
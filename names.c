@@ -0,0 +1,300 @@
+/* names.c
+ *
+ * Compile-time lookup tables for enumerated ELF header fields, see
+ * libparse_elf.h.  Each table is indexed directly by value; gaps are NULL,
+ * which callers treat as "not a value we know".
+ */
+
+#include <stddef.h>     // NULL, size_t
+#include "libparse_elf.h"
+
+#define TABLE_LOOKUP( table, v ) \
+    ( (v) < sizeof( table ) / sizeof( table[0] ) ? table[ (v) ] : NULL )
+
+static char const *const class_names[] = {
+    [ELFCLASSNONE]  = "No class",
+    [ELFCLASS32]    = "32-bit architecture",
+    [ELFCLASS64]    = "64-bit architecture",
+};
+
+static char const *const data_names[] = {
+    [ELFDATANONE]   = "Unknown data format",
+    [ELFDATA2LSB]   = "Two's complement, little-endian",
+    [ELFDATA2MSB]   = "Two's complement, big endian",
+};
+
+static char const *const version_names[] = {
+    [EV_NONE]       = "Invalid version",
+    [EV_CURRENT]    = "Current version",
+};
+
+static char const *const osabi_names[256] = {
+    [ELFOSABI_SYSV]         = "SYSV",   // Also ELFOSABI_NONE
+    [ELFOSABI_HPUX]         = "HPUX",
+    [ELFOSABI_NETBSD]       = "NETBSD",
+    [ELFOSABI_LINUX]        = "Linux",
+    [ELFOSABI_SOLARIS]      = "Solaris",
+    [ELFOSABI_IRIX]         = "Irix",
+    [ELFOSABI_FREEBSD]      = "FreeBSD",
+    [ELFOSABI_TRU64]        = "Tru64",
+    [ELFOSABI_ARM]          = "Arm",
+    [ELFOSABI_STANDALONE]   = "Standalone",
+};
+
+static char const *const etype_names[] = {
+    [ET_NONE]   = "Unknown type",
+    [ET_REL]    = "A relocatable file",
+    [ET_EXEC]   = "An executable file",
+    [ET_DYN]    = "An shared object",
+    [ET_CORE]   = "A core file",
+};
+
+static char const *const machine_names[] = {
+    [EM_NONE]           = "Unknown machine",
+    [EM_M32]            = "AT&T WE 32100",
+    [EM_SPARC]          = "Sun Microsystems SPARC",
+    [EM_386]            = "Intel 80386",
+    [EM_68K]            = "Motorola 68000",
+    [EM_88K]            = "Motorola 88000",
+    [EM_860]            = "Intel 80860",
+    [EM_MIPS]           = "MIPS RS3000 (big endian only)",
+    [EM_PARISC]         = "HP/PA",
+    [EM_SPARC32PLUS]    = "SPARC with enhanced instruction set",
+    [EM_PPC]            = "PowerPC",
+    [EM_PPC64]          = "PowerPC 64-bit",
+    [EM_S390]           = "IBM S/390",
+    [EM_ARM]            = "Advanced RISC Machines",
+    [EM_SH]             = "Renesas SuperH",
+    [EM_SPARCV9]        = "SPARC v9 64-bit",
+    [EM_IA_64]          = "Intel Itanium",
+    [EM_X86_64]         = "AMD x86-64",
+    [EM_VAX]            = "DEC Vax",
+};
+
+static char const *const ptype_names[] = {
+    [PT_NULL]       = "NULL",
+    [PT_LOAD]       = "LOAD",
+    [PT_DYNAMIC]    = "DYNAMIC",
+    [PT_INTERP]     = "INTERP",
+    [PT_NOTE]       = "NOTE",
+    [PT_SHLIB]      = "SHLIB",
+    [PT_PHDR]       = "PHDR",
+};
+
+static char const *const shtype_names[] = {
+    [SHT_NULL]      = "NULL",
+    [SHT_PROGBITS]  = "PROGBITS",
+    [SHT_SYMTAB]    = "SYMTAB",
+    [SHT_STRTAB]    = "STRTAB",
+    [SHT_RELA]      = "RELA",
+    [SHT_HASH]      = "HASH",
+    [SHT_DYNAMIC]   = "DYNAMIC",
+    [SHT_NOTE]      = "NOTE",
+    [SHT_NOBITS]    = "NOBITS",
+    [SHT_REL]       = "REL",
+    [SHT_SHLIB]     = "SHLIB",
+    [SHT_DYNSYM]    = "DYNSYM",
+};
+
+static char const *const symtype_names[] = {
+    [STT_NOTYPE]    = "NOTYPE",
+    [STT_OBJECT]    = "OBJECT",
+    [STT_FUNC]      = "FUNC",
+    [STT_SECTION]   = "SECTION",
+    [STT_FILE]      = "FILE",
+    [STT_COMMON]    = "COMMON",
+    [STT_TLS]       = "TLS",
+    [STT_GNU_IFUNC] = "IFUNC",
+};
+
+static char const *const dtag_names[] = {
+    [DT_NULL]           = "NULL",
+    [DT_NEEDED]         = "NEEDED",
+    [DT_PLTRELSZ]       = "PLTRELSZ",
+    [DT_PLTGOT]         = "PLTGOT",
+    [DT_HASH]           = "HASH",
+    [DT_STRTAB]         = "STRTAB",
+    [DT_SYMTAB]         = "SYMTAB",
+    [DT_RELA]           = "RELA",
+    [DT_RELASZ]         = "RELASZ",
+    [DT_RELAENT]        = "RELAENT",
+    [DT_STRSZ]          = "STRSZ",
+    [DT_SYMENT]         = "SYMENT",
+    [DT_INIT]           = "INIT",
+    [DT_FINI]           = "FINI",
+    [DT_SONAME]         = "SONAME",
+    [DT_RPATH]          = "RPATH",
+    [DT_SYMBOLIC]       = "SYMBOLIC",
+    [DT_REL]            = "REL",
+    [DT_RELSZ]          = "RELSZ",
+    [DT_RELENT]         = "RELENT",
+    [DT_PLTREL]         = "PLTREL",
+    [DT_DEBUG]          = "DEBUG",
+    [DT_TEXTREL]        = "TEXTREL",
+    [DT_JMPREL]         = "JMPREL",
+    [DT_BIND_NOW]       = "BIND_NOW",
+    [DT_INIT_ARRAY]     = "INIT_ARRAY",
+    [DT_FINI_ARRAY]     = "FINI_ARRAY",
+    [DT_INIT_ARRAYSZ]   = "INIT_ARRAYSZ",
+    [DT_FINI_ARRAYSZ]   = "FINI_ARRAYSZ",
+    [DT_RUNPATH]        = "RUNPATH",
+    [DT_FLAGS]          = "FLAGS",
+    [DT_PREINIT_ARRAY]  = "PREINIT_ARRAY",
+    [DT_PREINIT_ARRAYSZ]= "PREINIT_ARRAYSZ",
+    [DT_SYMTAB_SHNDX]   = "SYMTAB_SHNDX",
+    [DT_RELRSZ]         = "RELRSZ",
+    [DT_RELR]           = "RELR",
+    [DT_RELRENT]        = "RELRENT",
+};
+
+static char const *const x86_64_reloc_names[] = {
+    [R_X86_64_NONE]             = "R_X86_64_NONE",
+    [R_X86_64_64]               = "R_X86_64_64",
+    [R_X86_64_PC32]             = "R_X86_64_PC32",
+    [R_X86_64_GOT32]            = "R_X86_64_GOT32",
+    [R_X86_64_PLT32]            = "R_X86_64_PLT32",
+    [R_X86_64_COPY]             = "R_X86_64_COPY",
+    [R_X86_64_GLOB_DAT]         = "R_X86_64_GLOB_DAT",
+    [R_X86_64_JUMP_SLOT]        = "R_X86_64_JUMP_SLOT",
+    [R_X86_64_RELATIVE]         = "R_X86_64_RELATIVE",
+    [R_X86_64_GOTPCREL]         = "R_X86_64_GOTPCREL",
+    [R_X86_64_32]               = "R_X86_64_32",
+    [R_X86_64_32S]              = "R_X86_64_32S",
+    [R_X86_64_16]               = "R_X86_64_16",
+    [R_X86_64_PC16]             = "R_X86_64_PC16",
+    [R_X86_64_8]                = "R_X86_64_8",
+    [R_X86_64_PC8]              = "R_X86_64_PC8",
+    [R_X86_64_DTPMOD64]         = "R_X86_64_DTPMOD64",
+    [R_X86_64_DTPOFF64]         = "R_X86_64_DTPOFF64",
+    [R_X86_64_TPOFF64]          = "R_X86_64_TPOFF64",
+    [R_X86_64_TLSGD]            = "R_X86_64_TLSGD",
+    [R_X86_64_TLSLD]            = "R_X86_64_TLSLD",
+    [R_X86_64_DTPOFF32]         = "R_X86_64_DTPOFF32",
+    [R_X86_64_GOTTPOFF]         = "R_X86_64_GOTTPOFF",
+    [R_X86_64_TPOFF32]          = "R_X86_64_TPOFF32",
+    [R_X86_64_PC64]             = "R_X86_64_PC64",
+    [R_X86_64_GOTOFF64]         = "R_X86_64_GOTOFF64",
+    [R_X86_64_GOTPC32]          = "R_X86_64_GOTPC32",
+    [R_X86_64_GOT64]            = "R_X86_64_GOT64",
+    [R_X86_64_GOTPCREL64]       = "R_X86_64_GOTPCREL64",
+    [R_X86_64_GOTPC64]          = "R_X86_64_GOTPC64",
+    [R_X86_64_GOTPLT64]         = "R_X86_64_GOTPLT64",
+    [R_X86_64_PLTOFF64]         = "R_X86_64_PLTOFF64",
+    [R_X86_64_SIZE32]           = "R_X86_64_SIZE32",
+    [R_X86_64_SIZE64]           = "R_X86_64_SIZE64",
+    [R_X86_64_GOTPC32_TLSDESC]  = "R_X86_64_GOTPC32_TLSDESC",
+    [R_X86_64_TLSDESC_CALL]     = "R_X86_64_TLSDESC_CALL",
+    [R_X86_64_TLSDESC]          = "R_X86_64_TLSDESC",
+    [R_X86_64_IRELATIVE]        = "R_X86_64_IRELATIVE",
+    [R_X86_64_RELATIVE64]       = "R_X86_64_RELATIVE64",
+    [R_X86_64_GOTPCRELX]        = "R_X86_64_GOTPCRELX",
+    [R_X86_64_REX_GOTPCRELX]    = "R_X86_64_REX_GOTPCRELX",
+};
+
+static char const *const symbind_names[] = {
+    [STB_LOCAL]      = "LOCAL",
+    [STB_GLOBAL]     = "GLOBAL",
+    [STB_WEAK]       = "WEAK",
+    [STB_GNU_UNIQUE] = "UNIQUE",
+};
+
+char const *
+pe_class_name( unsigned v ){
+    return TABLE_LOOKUP( class_names, v );
+}
+
+char const *
+pe_data_name( unsigned v ){
+    return TABLE_LOOKUP( data_names, v );
+}
+
+char const *
+pe_version_name( uint32_t v ){
+    return TABLE_LOOKUP( version_names, v );
+}
+
+char const *
+pe_osabi_name( unsigned v ){
+    return TABLE_LOOKUP( osabi_names, v );
+}
+
+char const *
+pe_etype_name( unsigned v ){
+    return TABLE_LOOKUP( etype_names, v );
+}
+
+char const *
+pe_machine_name( unsigned v ){
+    return TABLE_LOOKUP( machine_names, v );
+}
+
+char const *
+pe_ptype_name( uint32_t v ){
+    if( v < sizeof( ptype_names ) / sizeof( ptype_names[0] ) ){
+        return ptype_names[v];
+    }
+    // See /usr/include/elf.h for details
+    if( v >= PT_LOPROC && v <= PT_HIPROC ){
+        return "Processor-specific";
+    }
+    switch( v ){
+        case PT_GNU_EH_FRAME:   return "GNU_EH_FRAME";
+        case PT_GNU_STACK:      return "GNU_STACK";
+        case PT_GNU_RELRO:      return "GNU_RELRO";
+        default:                return NULL;
+    }
+}
+
+char const *
+pe_shtype_name( uint32_t v ){
+    if( v < sizeof( shtype_names ) / sizeof( shtype_names[0] ) ){
+        return shtype_names[v];
+    }
+    switch( v ){
+        case SHT_RELR:          return "RELR";
+        case SHT_SYMTAB_SHNDX:  return "SYMTAB_SHNDX";
+        case SHT_GNU_HASH:      return "GNU_HASH";
+        case SHT_GNU_verdef:    return "VERDEF";
+        case SHT_GNU_verneed:   return "VERNEED";
+        case SHT_GNU_versym:    return "VERSYM";
+        default:                return NULL;
+    }
+}
+
+char const *
+pe_symtype_name( unsigned v ){
+    return TABLE_LOOKUP( symtype_names, v );
+}
+
+char const *
+pe_symbind_name( unsigned v ){
+    return TABLE_LOOKUP( symbind_names, v );
+}
+
+char const *
+pe_dtag_name( int64_t v ){
+    if( v >= 0 && (uint64_t)v < sizeof( dtag_names ) / sizeof( dtag_names[0] ) ){
+        return dtag_names[v];
+    }
+    switch( v ){
+        case DT_GNU_HASH:       return "GNU_HASH";
+        case DT_VERSYM:         return "VERSYM";
+        case DT_RELACOUNT:      return "RELACOUNT";
+        case DT_RELCOUNT:       return "RELCOUNT";
+        case DT_FLAGS_1:        return "FLAGS_1";
+        case DT_VERDEF:         return "VERDEF";
+        case DT_VERDEFNUM:      return "VERDEFNUM";
+        case DT_VERNEED:        return "VERNEED";
+        case DT_VERNEEDNUM:     return "VERNEEDNUM";
+        default:                return NULL;
+    }
+}
+
+// Only x86-64 relocation types are named so far.
+char const *
+pe_reloc_type_name( unsigned machine, uint32_t v ){
+    switch( machine ){
+        case EM_X86_64:     return TABLE_LOOKUP( x86_64_reloc_names, v );
+        default:            return NULL;
+    }
+}
@@ -0,0 +1,107 @@
+/* obuf.c
+ *
+ * Buffered output, see obuf.h.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>      // vsnprintf(3)
+#include <stdlib.h>     // malloc(3), realloc(3), free(3)
+#include <stdarg.h>     // va_list
+#include <assert.h>     // assert(3)
+#include <errno.h>      // errno, EINTR
+#include <unistd.h>     // write(2)
+#include "obuf.h"
+
+static void
+write_all( int fd, char const *p, size_t n ){
+    while( n > 0 ){
+        ssize_t rc = write( fd, p, n );
+        if( -1 == rc && EINTR == errno ){
+            continue;
+        }
+        assert( -1 != rc );
+        p += rc;
+        n -= rc;
+    }
+}
+
+void
+ob_init_fd( struct obuf *ob, int fd ){
+    ob->buf = malloc( OBUF_FD_SZ );
+    assert( NULL != ob->buf );
+    ob->len = 0;
+    ob->cap = OBUF_FD_SZ;
+    ob->fd = fd;
+}
+
+void
+ob_init_mem( struct obuf *ob ){
+    ob->buf = malloc( OBUF_MEM_SZ );
+    assert( NULL != ob->buf );
+    ob->len = 0;
+    ob->cap = OBUF_MEM_SZ;
+    ob->fd = -1;
+}
+
+void
+ob_free( struct obuf *ob ){
+    if( -1 != ob->fd ){
+        ob_flush( ob );
+    }
+    free( ob->buf );
+    ob->buf = NULL;
+    ob->len = ob->cap = 0;
+}
+
+void
+ob_flush( struct obuf *ob ){
+    if( -1 != ob->fd && ob->len ){
+        write_all( ob->fd, ob->buf, ob->len );
+        ob->len = 0;
+    }
+}
+
+void
+ob_make_room( struct obuf *ob, size_t n ){
+    if( -1 != ob->fd ){
+        ob_flush( ob );
+        if( n <= ob->cap ){
+            return;
+        }
+    }
+    while( ob->cap - ob->len < n ){
+        ob->cap *= 2;
+    }
+    ob->buf = realloc( ob->buf, ob->cap );
+    assert( NULL != ob->buf );
+}
+
+void
+ob_write( struct obuf *ob, void const *p, size_t n ){
+    if( -1 != ob->fd && n >= ob->cap / 2 ){
+        ob_flush( ob );
+        write_all( ob->fd, p, n );
+        return;
+    }
+    ob_reserve( ob, n );
+    memcpy( ob->buf + ob->len, p, n );
+    ob->len += n;
+}
+
+void
+ob_printf( struct obuf *ob, char const *fmt, ... ){
+    va_list ap;
+    int n;
+
+    va_start( ap, fmt );
+    n = vsnprintf( ob->buf + ob->len, ob->cap - ob->len, fmt, ap );
+    va_end( ap );
+    assert( n >= 0 );
+    if( (size_t)n >= ob->cap - ob->len ){
+        ob_reserve( ob, n + 1 );
+        va_start( ap, fmt );
+        vsnprintf( ob->buf + ob->len, ob->cap - ob->len, fmt, ap );
+        va_end( ap );
+    }
+    ob->len += n;
+}
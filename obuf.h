@@ -0,0 +1,149 @@
+/* obuf.h
+ *
+ * Buffered output with hand-rolled integer formatting.  An obuf either
+ * drains to a file descriptor with write(2) whenever it fills, or (fd -1)
+ * grows in memory until the owner takes the contents.  The fmt_* helpers
+ * reproduce the printf conversions used by the table printers exactly:
+ *
+ *     fmt_hex( dst, v, w, false )     %#<w>x
+ *     fmt_hex( dst, v, w, true )      %#0<w>x
+ *     fmt_udec( dst, v, w )           %<w>u
+ *
+ * including printf's habit of dropping the 0x prefix for zero.
+ */
+#ifndef OBUF_H
+#define OBUF_H
+
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint64_t
+#include <stdbool.h>    // bool
+#include <string.h>     // memcpy(3), memset(3)
+
+#define OBUF_FD_SZ (1 << 20)        // Buffer size when draining to an fd
+#define OBUF_MEM_SZ (64 * 1024)     // Initial size of an in-memory buffer
+
+struct obuf {
+    char *buf;
+    size_t len;
+    size_t cap;
+    int fd;             // Drain target, or -1 to accumulate in memory
+};
+
+void ob_init_fd( struct obuf *ob, int fd );
+void ob_init_mem( struct obuf *ob );
+void ob_free( struct obuf *ob );
+
+// Write out everything buffered (fd mode only).
+void ob_flush( struct obuf *ob );
+
+// Out-of-line half of ob_reserve().
+void ob_make_room( struct obuf *ob, size_t n );
+
+// Write n bytes, bypassing the buffer for large blocks in fd mode.
+void ob_write( struct obuf *ob, void const *p, size_t n );
+
+__attribute__((format(printf, 2, 3)))
+void ob_printf( struct obuf *ob, char const *fmt, ... );
+
+// Make room for at least n more bytes, flushing or growing as needed.
+static inline void
+ob_reserve( struct obuf *ob, size_t n ){
+    if( ob->cap - ob->len < n ){
+        ob_make_room( ob, n );
+    }
+}
+
+static inline void
+ob_putc( struct obuf *ob, char c ){
+    ob_reserve( ob, 1 );
+    ob->buf[ ob->len++ ] = c;
+}
+
+static inline void
+ob_puts( struct obuf *ob, char const *s ){
+    ob_write( ob, s, strlen( s ) );
+}
+
+// Worst case for any fmt_* call: 20 decimal digits or 0x + 16 hex digits,
+// plus padding.
+#define FMT_MAX( width ) ( (width) > 20 ? (size_t)(width) : (size_t)20 )
+
+// Right-align the len bytes at src in a field of width, writing to dst.
+static inline size_t
+fmt_pad( char *dst, char const *src, size_t len, unsigned width, char pad ){
+    size_t npad = width > len ? width - len : 0;
+    memset( dst, pad, npad );
+    memcpy( dst + npad, src, len );
+    return npad + len;
+}
+
+static inline size_t
+fmt_hex( char *dst, uint64_t v, unsigned width, bool zero_pad ){
+    static char const digits[] = "0123456789abcdef";
+    char tmp[16];
+    size_t n = ( 63 - __builtin_clzll( v | 1 ) ) / 4 + 1;
+
+    for( size_t i = n; i > 0; v >>= 4 ){
+        tmp[--i] = digits[ v & 0xf ];
+    }
+    if( 1 == n && '0' == tmp[0] ){
+        return fmt_pad( dst, tmp, 1, width, zero_pad ? '0' : ' ' );
+    }
+    if( zero_pad ){
+        dst[0] = '0';
+        dst[1] = 'x';
+        return 2 + fmt_pad( dst + 2, tmp, n, width > 2 ? width - 2 : 0, '0' );
+    }
+    size_t npad = width > n + 2 ? width - ( n + 2 ) : 0;
+    memset( dst, ' ', npad );
+    dst[npad] = '0';
+    dst[npad+1] = 'x';
+    memcpy( dst + npad + 2, tmp, n );
+    return npad + 2 + n;
+}
+
+static inline size_t
+fmt_udec( char *dst, uint64_t v, unsigned width ){
+    static char const pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char tmp[20];
+    size_t i = sizeof( tmp );
+
+    while( v >= 100 ){
+        unsigned r = v % 100;
+        v /= 100;
+        tmp[--i] = pairs[ 2*r + 1 ];
+        tmp[--i] = pairs[ 2*r ];
+    }
+    if( v >= 10 ){
+        tmp[--i] = pairs[ 2*v + 1 ];
+        tmp[--i] = pairs[ 2*v ];
+    }else{
+        tmp[--i] = '0' + v;
+    }
+    return fmt_pad( dst, tmp + i, sizeof( tmp ) - i, width, ' ' );
+}
+
+static inline void
+ob_hex( struct obuf *ob, uint64_t v, unsigned width, bool zero_pad ){
+    ob_reserve( ob, FMT_MAX( width ) );
+    ob->len += fmt_hex( ob->buf + ob->len, v, width, zero_pad );
+}
+
+static inline void
+ob_udec( struct obuf *ob, uint64_t v, unsigned width ){
+    ob_reserve( ob, FMT_MAX( width ) );
+    ob->len += fmt_udec( ob->buf + ob->len, v, width );
+}
+
+// %<width>s
+static inline void
+ob_str( struct obuf *ob, char const *s, unsigned width ){
+    size_t len = strlen( s );
+    ob_reserve( ob, len > width ? len : width );
+    ob->len += fmt_pad( ob->buf + ob->len, s, len, width, ' ' );
+}
+
+#endif // OBUF_H
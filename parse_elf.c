@@ -14,34 +14,158 @@
  *      https://en.cpprefernce.com
  */
 
-#include <stdio.h>      // printf(3), fprintf(3)
+#define _GNU_SOURCE     // getopt_long(3), IOV_MAX under -std=c2x
+#include <stdio.h>      // printf(3), fprintf(3), snprintf(3)
 #include <getopt.h>     // getopt_long(3)
-#include <stdlib.h>     // exit(3), malloc(3)
-#include <string.h>     // strlen(3)
+#include <stdlib.h>     // exit(3), malloc(3), strtoul(3)
+#include <string.h>     // memchr(3)
 #include <assert.h>     // assert(3)
-#include <sys/types.h>  // open(2), fstat(2)
-#include <sys/stat.h>   // open(2), fstat(2)
-#include <fcntl.h>      // open(2)
-#include <unistd.h>     // fstat(2)
-#include <sys/mman.h>   // mmap(2)
+#include <sys/types.h>  // stat(2)
+#include <sys/stat.h>   // stat(2)
+#include <unistd.h>     // sysconf(3)
+#include <sys/uio.h>    // writev(2)
+#include <limits.h>     // IOV_MAX
 #include <stdint.h>     // uint64_t and friends
 #include <inttypes.h>   // PRIu64 and friends
 #include <stdbool.h>    // bool, true, false
+#include <pthread.h>    // pthread_mutex_lock(3) and friends
+#include <stdatomic.h>  // atomic_fetch_add(3)
+#include <time.h>       // clock_gettime(3)
+#include <sys/resource.h> // getrusage(2)
 #include <elf.h>
+#include "pool.h"
+#include "walk.h"
+#include "deps.h"
+#include "startup.h"
+#include "strtab.h"
+#include "libparse_elf.h"
+#include "obuf.h"
+#include "records.h"
+#include "stats.h"
 
-static char *pathname;                  // Name of the file to be parsed
-static unsigned char const *map_addr;   // Location of the memory map of the file
+// Output state.  Thread-local so that batch mode can run one file per pool
+// worker without the parse_* functions needing to know about it; the file
+// itself is passed in as a libparse_elf context.
+static _Thread_local struct obuf *out;              // Where parse_* output goes
 #define ERR_BUF_SZ (1023)
-char err_buf[ERR_BUF_SZ+1];
+static _Thread_local char err_buf[ERR_BUF_SZ+1];
+
+// Return name, or if the value had no name, v formatted with fmt into
+// err_buf.  Only the (rare) invalid values pay for an snprintf.
+static char const *
+or_invalid( char const *name, char const *fmt, uint64_t v ){
+    if( name ){
+        return name;
+    }
+    snprintf(err_buf, ERR_BUF_SZ, fmt, v);
+    return err_buf;
+}
+
+static char **filenames;                // Files named on the command line
+static int nfilenames;
+static unsigned njobs;                  // Worker threads used in batch mode
+static bool recursive;                  // Walk directory operands
+static enum rec_format format;          // --format, REC_TEXT by default
+static bool symbols;                    // --symbols
+static char const *lookup_name;         // --lookup, or NULL
+static bool lookup_addr;                // --address given
+static uint64_t address;                // Its argument
+static bool dependencies;               // --deps
+static bool startup;                    // --startup
+static bool huge_pages;                 // --huge-pages
+static bool residency;                  // --residency
+static char const *prefetch_range;      // --prefetch, or NULL
+static char const *evict_range;         // --evict, or NULL
+static int io = -1;                     // --io, or -1 for plain pe_open()
+static size_t stream_window = 256 << 20;  // --window, for "-"
+static int relocs;                      // 1 for --relocs, 2 for --reloc-list
+static char const *sysroot;             // --sysroot, or NULL
 
 void
 print_help(){
     printf("Usage:  parse_elf [-h|-v]\n");
-    printf("        parse_elf <file>\n");
+    printf("        parse_elf [-j <n>] <file> [<file> ...]\n");
+    printf("        parse_elf -r [-j <n>] <file|dir> [<file|dir> ...]\n");
+    printf("        ... | parse_elf [options] -\n");
     printf("\n");
     printf("Options:\n");
     printf("    -h      --help      Print this message and exit.\n");
     printf("    -v      --version   Print version information and exit.\n");
+    printf("    -j <n>  --jobs=<n>  Parse multiple files on <n> threads\n");
+    printf("                        (default: number of online CPUs).\n");
+    printf("    -r      --recursive Parse every ELF file found below directory\n");
+    printf("                        operands.  Non-ELF files are skipped quietly\n");
+    printf("                        and files are printed as they finish.\n");
+    printf("    -f <fmt> --format=<fmt>\n");
+    printf("                        Output format: text (default), ndjson, csv\n");
+    printf("                        or binary.  See records.h for the layouts.\n");
+    printf("    -i <how> --io=<how> Read files with mmap (default), populate\n");
+    printf("                        (MAP_POPULATE), sequential or willneed\n");
+    printf("                        (madvise), pread, direct (O_DIRECT) or lazy\n");
+    printf("                        (map only the parts used), and report bytes\n");
+    printf("                        read, page faults and time on stderr at the\n");
+    printf("                        end.\n");
+    printf("    -W <MiB> --window=<MiB>\n");
+    printf("                        How much of a file read from stdin ('-') to\n");
+    printf("                        keep (default 256).  Longer files keep their\n");
+    printf("                        first and last halves only.\n");
+    printf("    -s      --symbols   Also list .symtab and .dynsym, sorted by\n");
+    printf("                        address.\n");
+    printf("    -l <sym> --lookup=<sym>\n");
+    printf("                        Instead of the usual output, look <sym> up\n");
+    printf("                        through each file's .gnu.hash or .hash and\n");
+    printf("                        print only the files that define it.\n");
+    printf("    -a <addr> --address=<addr>\n");
+    printf("                        Instead of the usual output, print the\n");
+    printf("                        .symtab (else .dynsym) symbol containing\n");
+    printf("                        <addr> in each file, as <symbol>+<offset>.\n");
+    printf("                        Only the symbol starting nearest below\n");
+    printf("                        <addr> is checked, so an address past its\n");
+    printf("                        end but inside an earlier, larger symbol\n");
+    printf("                        is not found.\n");
+    printf("    -x      --relocs    Also summarize each relocation section: counts\n");
+    printf("                        per type and references per symbol.\n");
+    printf("    -X      --reloc-list\n");
+    printf("                        As -x, and list every relocation.\n");
+    printf("    -H      --huge-pages\n");
+    printf("                        Also check whether executable segments can\n");
+    printf("                        be mapped with 2 MiB pages, and count the\n");
+    printf("                        iTLB entries their text needs.\n");
+    printf("    -m      --residency Instead of the usual output, report how much\n");
+    printf("                        of the file, each PT_LOAD segment and each\n");
+    printf("                        section is in the page cache.  Not for '-'.\n");
+    printf("    -P <range> --prefetch=<range>\n");
+    printf("    -E <range> --evict=<range>\n");
+    printf("                        With -m, ask the kernel to read <range> in or\n");
+    printf("                        drop it from the page cache first, and report\n");
+    printf("                        residency before and after.  <range> is 'all',\n");
+    printf("                        a section name, or <offset>:<length>.\n");
+    printf("    -d      --deps      Instead of the usual output, print each\n");
+    printf("                        file's dynamic section, then resolve and\n");
+    printf("                        print its DT_NEEDED closure the way ld.so\n");
+    printf("                        would.  Libraries are loaded once however\n");
+    printf("                        many files share them.\n");
+    printf("    -c      --startup   Instead of the usual output, estimate the\n");
+    printf("                        dynamic loader's work before main() for\n");
+    printf("                        each file and every object it loads:\n");
+    printf("                        relocations, symbol lookups, constructors\n");
+    printf("                        and pages dirtied.  See startup.h.\n");
+    printf("    -R <dir> --sysroot=<dir>\n");
+    printf("                        Resolve dependencies inside <dir>, e.g. an\n");
+    printf("                        unpacked container image.\n");
+    printf("    -t <fmt> --stats=<fmt>\n");
+    printf("                        Time each phase of each file: wall and CPU\n");
+    printf("                        time, page faults and, where perf_event_open\n");
+    printf("                        allows, cycles, instructions and cache\n");
+    printf("                        misses.  Written to stderr: with text, a\n");
+    printf("                        summary per phase at the end; with ndjson,\n");
+    printf("                        csv or binary, \"stats\" records per file.\n");
+    printf("                        -d and -c are not timed.\n");
+    printf("    -T <file> --trace=<file>\n");
+    printf("                        Write the same phases to <file> as Chrome\n");
+    printf("                        trace events, a span per phase per file on\n");
+    printf("                        the thread that ran it; open it in Perfetto\n");
+    printf("                        or chrome://tracing.\n");
     printf("\n");
     exit(0);
 }
@@ -56,18 +180,111 @@ void
 parse_options( int argc, char **argv ){
     int c;
     int option_index=0;
+    char *end;
     static struct option long_options[] = {
-        {"help",    no_argument,    0, 'h' },
-        {"version", no_argument,    0, 'v' },
-        {0,         0,              0, 0 }};
+        {"help",    no_argument,        0, 'h' },
+        {"version", no_argument,        0, 'v' },
+        {"jobs",    required_argument,  0, 'j' },
+        {"recursive", no_argument,      0, 'r' },
+        {"format",  required_argument,  0, 'f' },
+        {"io",      required_argument,  0, 'i' },
+        {"window",  required_argument,  0, 'W' },
+        {"symbols", no_argument,        0, 's' },
+        {"lookup",  required_argument,  0, 'l' },
+        {"address", required_argument,  0, 'a' },
+        {"relocs",  no_argument,        0, 'x' },
+        {"reloc-list", no_argument,     0, 'X' },
+        {"huge-pages", no_argument,     0, 'H' },
+        {"residency", no_argument,      0, 'm' },
+        {"prefetch", required_argument, 0, 'P' },
+        {"evict",   required_argument,  0, 'E' },
+        {"deps",    no_argument,        0, 'd' },
+        {"startup", no_argument,        0, 'c' },
+        {"sysroot", required_argument,  0, 'R' },
+        {"stats",   required_argument,  0, 't' },
+        {"trace",   required_argument,  0, 'T' },
+        {0,         0,                  0, 0 }};
     while(1){
-        c = getopt_long( argc, argv, "hv", long_options, &option_index );
+        c = getopt_long( argc, argv, "hvj:rf:i:W:sl:a:xXHmP:E:dcR:t:T:", long_options, &option_index );
         if( -1 == c ){
             break;
         }
         switch(c){
             case 'h': print_help();      break;
             case 'v': print_version();   break;
+            case 'j':
+                      njobs = strtoul( optarg, &end, 10 );
+                      if( '\0' != *end || 0 == njobs ){
+                          fprintf(stderr, "%s:%s:%d Invalid job count '%s'.\n",
+                                  __FILE__, __func__, __LINE__, optarg);
+                          exit(-1);
+                      }
+                      break;
+            case 'r': recursive = true;  break;
+            case 'i':
+                      io = -1;
+                      for( int i = PE_IO_MMAP; pe_io_name( i ); i++ ){
+                          if( 0 == strcmp( optarg, pe_io_name( i ) ) ){
+                              io = i;
+                          }
+                      }
+                      if( -1 == io ){
+                          fprintf(stderr, "%s:%s:%d Unknown I/O strategy '%s'.\n",
+                                  __FILE__, __func__, __LINE__, optarg);
+                          exit(-1);
+                      }
+                      break;
+            case 'W':
+                      stream_window = strtoul( optarg, &end, 10 ) << 20;
+                      if( '\0' != *end || 0 == stream_window ){
+                          fprintf(stderr, "%s:%s:%d Invalid window size '%s'.\n",
+                                  __FILE__, __func__, __LINE__, optarg);
+                          exit(-1);
+                      }
+                      break;
+            case 's': symbols = true;    break;
+            case 'l': lookup_name = optarg; break;
+            case 'a':
+                      address = strtoull( optarg, &end, 0 );
+                      if( '\0' != *end || '\0' == *optarg ){
+                          fprintf(stderr, "%s:%s:%d Invalid address '%s'.\n",
+                                  __FILE__, __func__, __LINE__, optarg);
+                          exit(-1);
+                      }
+                      lookup_addr = true;
+                      break;
+            case 'x': relocs = relocs > 1 ? relocs : 1; break;
+            case 'X': relocs = 2;        break;
+            case 'H': huge_pages = true; break;
+            case 'm': residency = true;  break;
+            case 'P': prefetch_range = optarg; break;
+            case 'E': evict_range = optarg; break;
+            case 'd': dependencies = true; break;
+            case 'c': startup = true;    break;
+            case 'R': sysroot = optarg;  break;
+            case 't':
+                      if( -1 == ( c = rec_format_parse( optarg ) ) ){
+                          fprintf(stderr, "%s:%s:%d Unknown stats format '%s'.\n",
+                                  __FILE__, __func__, __LINE__, optarg);
+                          exit(-1);
+                      }
+                      stats_enable( c );
+                      break;
+            case 'T':
+                      if( !stats_trace( optarg ) ){
+                          fprintf(stderr, "%s:%s:%d Unable to open trace file '%s'.\n",
+                                  __FILE__, __func__, __LINE__, optarg);
+                          exit(-1);
+                      }
+                      break;
+            case 'f':
+                      if( -1 == ( c = rec_format_parse( optarg ) ) ){
+                          fprintf(stderr, "%s:%s:%d Unknown format '%s'.\n",
+                                  __FILE__, __func__, __LINE__, optarg);
+                          exit(-1);
+                      }
+                      format = c;
+                      break;
             default:
                       fprintf(stderr, "%s:%s:%d getopt_long returned unknown character code %#x.\n",
                               __FILE__, __func__, __LINE__, c);
@@ -79,145 +296,84 @@ parse_options( int argc, char **argv ){
         fprintf(stderr, "%s:%s:%d No filename specified.\n",
             __FILE__, __func__, __LINE__);
         print_help();
-    }else if( optind + 1 < argc ){
-        fprintf(stderr, "%s:%s:%d Too many filenames specified.\n",
-            __FILE__, __func__, __LINE__);
-        print_help();
-    }else if( optind + 1 == argc ){
-        pathname = calloc( strlen(argv[optind]) + 1, sizeof( char ) );
-        assert( NULL != pathname );
-        strncpy( pathname, argv[optind], strlen(argv[optind]) );
-    }else{
-        fprintf(stderr, "%s:%s:%d optind=%d, argc=%d, not sure how we got here.\n",
-            __FILE__, __func__, __LINE__, optind, argc);
-        exit(-1);
     }
-    // If we don't have a pathname, we shouldn't get here.
-    assert(pathname);
-}
-
-void
-cleanup(){
-    free(pathname);
+    filenames = &argv[optind];
+    nfilenames = argc - optind;
+    // A stream has no file for mincore(2) or fadvise(2) to look at.
+    for( int i = 0; residency && i < nfilenames; i++ ){
+        if( 0 == strcmp( filenames[i], "-" ) ){
+            fprintf(stderr, "%s:%s:%d -m can't be used with '-' (stdin).\n",
+                __FILE__, __func__, __LINE__);
+            exit(-1);
+        }
+    }
+    if( 0 == njobs ){
+        long ncpus = sysconf( _SC_NPROCESSORS_ONLN );
+        njobs = ncpus > 0 ? (unsigned)ncpus : 1;
+    }
 }
 
 void
-map_file(){
-    int fd, rc;
-    struct stat s;
-
-    // 1. Get a valid file descriptor.
-    fd = open( pathname, O_RDONLY );
-    assert( -1 != fd );
-
-    // 2. Get the size of the file.
-    rc = fstat( fd, &s );
-    assert( -1 != rc );
-
-    // 3. Map the file.
-    map_addr = mmap(
-            NULL,           // Allow the OS to pick the location of the map.
-            s.st_size,      // File size in bytes.
-            PROT_READ,      // Map may not be modified.
-            MAP_PRIVATE,    // Map not shared with other processes.
-            fd,             // File descriptor.
-            0);             // Offset into the file to start mapping.
-    assert( MAP_FAILED != map_addr );
-
-    assert(    0x7f == map_addr[0]
-            &&  'E' == map_addr[1]
-            &&  'L' == map_addr[2]
-            &&  'F' == map_addr[3]);
-}
-
-
-
-
-void
-parse_elf_header(){
-    Elf64_Ehdr *e = (Elf64_Ehdr *)map_addr;
-    printf("Elf Header\n\n");
+parse_elf_header( struct pe_file const *f ){
+    Elf64_Ehdr const *e = pe_ehdr( f );
+    char phnum[36] = "", shnum[36] = "";
+    ob_printf(out, "Elf Header\n\n");
 
     // Magic number
-    printf("%6s %24s %18s %35s %12s %6s\n", "Offset", "Name", "Value", "Meaning", "Type", "Size");
-    printf("%6s %24s %18s %35s %12s %6s\n", "======", "========================", "==================", "===================================", "===========", "======");
-    printf("%#06zx %24s %#18x %35s %12s %6zu\n", 0x0000UL, "Magic 0", e->e_ident[0], "Magic Number 0", "uint8_t", sizeof(uint8_t));
-    printf("%#06zx %24s %18c %35s %12s %6zu\n",  0x0001UL, "Magic 1", e->e_ident[1], "Magic Number 1", "uint8_t", sizeof(uint8_t));
-    printf("%#06zx %24s %18c %35s %12s %6zu\n",  0x0002UL, "Magic 2", e->e_ident[2], "Magic Number 2", "uint8_t", sizeof(uint8_t));
-    printf("%#06zx %24s %18c %35s %12s %6zu\n",  0x0003UL, "Magic 3", e->e_ident[3], "Magic Number 3", "uint8_t", sizeof(uint8_t));
+    ob_printf(out, "%6s %24s %18s %35s %12s %6s\n", "Offset", "Name", "Value", "Meaning", "Type", "Size");
+    ob_printf(out, "%6s %24s %18s %35s %12s %6s\n", "======", "========================", "==================", "===================================", "===========", "======");
+    ob_printf(out, "%#06zx %24s %#18x %35s %12s %6zu\n", 0x0000UL, "Magic 0", e->e_ident[0], "Magic Number 0", "uint8_t", sizeof(uint8_t));
+    ob_printf(out, "%#06zx %24s %18c %35s %12s %6zu\n",  0x0001UL, "Magic 1", e->e_ident[1], "Magic Number 1", "uint8_t", sizeof(uint8_t));
+    ob_printf(out, "%#06zx %24s %18c %35s %12s %6zu\n",  0x0002UL, "Magic 2", e->e_ident[2], "Magic Number 2", "uint8_t", sizeof(uint8_t));
+    ob_printf(out, "%#06zx %24s %18c %35s %12s %6zu\n",  0x0003UL, "Magic 3", e->e_ident[3], "Magic Number 3", "uint8_t", sizeof(uint8_t));
 
     // Class
-    snprintf(err_buf, ERR_BUF_SZ, "Invalid:(%"PRIu8")\n", e->e_ident[4]);
-    printf("%#06zx %24s %18u %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %18u %35s %12s %6zu\n",
             0x0004UL,
             "Class",
             e->e_ident[4],
-            e->e_ident[4] == ELFCLASSNONE ? "No class" :
-            e->e_ident[4] == ELFCLASS32   ? "32-bit architecture" :
-            e->e_ident[4] == ELFCLASS64   ? "64-bit architecture" :
-            err_buf,
+            or_invalid( pe_class_name( e->e_ident[4] ), "Invalid:(%"PRIu64")\n", e->e_ident[4] ),
             "uint8_t",
             sizeof(uint8_t));
 
     // Endianess
-    snprintf(err_buf, ERR_BUF_SZ, "Invalid:(%"PRIu8")\n", e->e_ident[5]);
-    printf("%#06zx %24s %18u %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %18u %35s %12s %6zu\n",
             0x0005UL,
             "Data",
             e->e_ident[5],
-            e->e_ident[5] == ELFDATANONE ? "Unknown data format" :
-            e->e_ident[5] == ELFDATA2LSB ? "Two's complement, little-endian" :
-            e->e_ident[5] == ELFDATA2MSB ? "Two's complement, big endian" :
-            err_buf,
+            or_invalid( pe_data_name( e->e_ident[5] ), "Invalid:(%"PRIu64")\n", e->e_ident[5] ),
             "uint8_t",
             sizeof(uint8_t));
 
     // Version
-    snprintf(err_buf, ERR_BUF_SZ, "Invalid:(%"PRIu8")\n", e->e_ident[6]);
-    printf("%#06zx %24s %18u %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %18u %35s %12s %6zu\n",
             0x0006UL,
             "Version",
             e->e_ident[6],
-            e->e_ident[6] == EV_NONE ? "Invalid version" :
-            e->e_ident[6] == EV_CURRENT ? "Current version" :
-            err_buf,
+            or_invalid( pe_version_name( e->e_ident[6] ), "Invalid:(%"PRIu64")\n", e->e_ident[6] ),
             "uint8_t",
             sizeof(uint8_t));
 
     // ABI
-    snprintf(err_buf, ERR_BUF_SZ, "Invalid:(%"PRIu8")\n", e->e_ident[7]);
-    printf("%#06zx %24s %18u %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %18u %35s %12s %6zu\n",
             0x0007UL,
             "OS ABI",
             e->e_ident[7],
-            e->e_ident[7] == ELFOSABI_NONE ? "SYSV" :
-            e->e_ident[7] == ELFOSABI_SYSV ? "SYSV" :
-            e->e_ident[7] == ELFOSABI_HPUX ? "HPUX" :
-            e->e_ident[7] == ELFOSABI_NETBSD ? "NETBSD" :
-            e->e_ident[7] == ELFOSABI_LINUX ? "Linux" :
-            e->e_ident[7] == ELFOSABI_SOLARIS ? "Solaris" :
-            e->e_ident[7] == ELFOSABI_IRIX ? "Irix" :
-            e->e_ident[7] == ELFOSABI_FREEBSD ? "FreeBSD" :
-            e->e_ident[7] == ELFOSABI_TRU64 ? "Tru64" :
-            e->e_ident[7] == ELFOSABI_ARM ? "Arm" :
-            e->e_ident[7] == ELFOSABI_STANDALONE ? "Standalone" :
-            err_buf,
+            or_invalid( pe_osabi_name( e->e_ident[7] ), "Invalid:(%"PRIu64")\n", e->e_ident[7] ),
             "uint8_t",
             sizeof(uint8_t));
 
     // ABI version
-    snprintf(err_buf, ERR_BUF_SZ, "Invalid:(%"PRIu8")\n", e->e_ident[8]);
-    printf("%#06zx %24s %18u %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %18u %35s %12s %6zu\n",
             0x0008UL,
             "ABI Version",
             e->e_ident[8],
-            e->e_ident[8] == 0 ? "Valid ABI version" :
-            err_buf,
+            or_invalid( e->e_ident[8] == 0 ? "Valid ABI version" : NULL, "Invalid:(%"PRIu64")\n", e->e_ident[8] ),
             "uint8_t",
             sizeof(uint8_t));
 
     // Padding
-    printf("%#06zx %24s %18u %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %18u %35s %12s %6zu\n",
             0x0009UL,
             "ABI Version",
             (unsigned int)e->e_ident[9] +
@@ -233,64 +389,34 @@ parse_elf_header(){
 
 
     // Object file type
-    snprintf(err_buf, ERR_BUF_SZ, "Invalid:(%"PRIu16")\n", e->e_type);
-    printf("%#06zx %24s %18u %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %18u %35s %12s %6zu\n",
             0x0010UL,
             "File type",
             e->e_type,
-            e->e_type == ET_NONE ? "Unknown type" :
-            e->e_type == ET_REL  ? "A relocatable file" :
-            e->e_type == ET_EXEC ? "An executable file" :
-            e->e_type == ET_DYN  ? "An shared object" :
-            e->e_type == ET_CORE ? "A core file" :
-            err_buf,
+            or_invalid( pe_etype_name( e->e_type ), "Invalid:(%"PRIu64")\n", e->e_type ),
             "uint16_t",
             sizeof(uint16_t));
 
     // Machine type
-    snprintf(err_buf, ERR_BUF_SZ, "Invalid:(%"PRIu16")\n", e->e_machine);
-    printf("%#06zx %24s %18u %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %18u %35s %12s %6zu\n",
             0x0012UL,
             "Machine type",
             e->e_machine,
-            e->e_machine == EM_NONE ? "Unknown machine" :
-            e->e_machine == EM_M32 ? "AT&T WE 32100" :
-            e->e_machine == EM_SPARC ? "Sun Microsystems SPARC" :
-            e->e_machine == EM_386 ? "Intel 80386" :
-            e->e_machine == EM_68K ? "Motorola 68000" :
-            e->e_machine == EM_88K ? "Motorola 88000" :
-            e->e_machine == EM_860 ? "Intel 80860" :
-            e->e_machine == EM_MIPS ? "MIPS RS3000 (big endian only)" :
-            e->e_machine == EM_PARISC ? "HP/PA" :
-            e->e_machine == EM_SPARC32PLUS ? "SPARC with enhanced instruction set" :
-            e->e_machine == EM_PPC ? "PowerPC" :
-            e->e_machine == EM_PPC64 ? "PowerPC 64-bit" :
-            e->e_machine == EM_S390 ? "IBM S/390" :
-            e->e_machine == EM_ARM ? "Advanced RISC Machines" :
-            e->e_machine == EM_SH ? "Renesas SuperH" :
-            e->e_machine == EM_SH ? "Renesas SuperH" :
-            e->e_machine == EM_SPARCV9 ? "SPARC v9 64-bit" :
-            e->e_machine == EM_IA_64 ? "Intel Itanium" :
-            e->e_machine == EM_X86_64 ? "AMD x86-64" :
-            e->e_machine == EM_VAX ? "DEC Vax" :
-            err_buf,
+            or_invalid( pe_machine_name( e->e_machine ), "Invalid:(%"PRIu64")\n", e->e_machine ),
             "uint16_t",
             sizeof(uint16_t));
 
     // File version (?)
-    snprintf(err_buf, ERR_BUF_SZ, "Invalid:(%"PRIu32")\n", e->e_version);
-    printf("%#06zx %24s %18u %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %18u %35s %12s %6zu\n",
             0x0014UL,
             "File version",
             e->e_version,
-            e->e_version == EV_NONE ? "Invalid version" :
-            e->e_version == EV_CURRENT ? "Current version" :
-            err_buf,
+            or_invalid( pe_version_name( e->e_version ), "Invalid:(%"PRIu64")\n", e->e_version ),
             "uint32_t",
             sizeof(uint32_t));
 
     // Entry point
-    printf("%#06zx %24s %#18"PRIx64" %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %#18"PRIx64" %35s %12s %6zu\n",
             0x0018UL,
             "Execution entry point",
             e->e_entry,
@@ -299,7 +425,7 @@ parse_elf_header(){
             sizeof(uint64_t));
 
     // Program header offset
-    printf("%#06zx %24s %#18"PRIx64" %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %#18"PRIx64" %35s %12s %6zu\n",
             0x0020UL,
             "Program header offset",
             e->e_phoff,
@@ -308,7 +434,7 @@ parse_elf_header(){
             sizeof(uint64_t));
 
     // Section header offset
-    printf("%#06zx %24s %#18"PRIx64" %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %#18"PRIx64" %35s %12s %6zu\n",
             0x0028UL,
             "Section header offset",
             e->e_shoff,
@@ -317,7 +443,7 @@ parse_elf_header(){
             sizeof(uint64_t));
 
     // Flags
-    printf("%#06zx %24s %#18"PRIx32" %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %#18"PRIx32" %35s %12s %6zu\n",
             0x0030UL,
             "Processor-specific flags",
             e->e_flags,
@@ -326,7 +452,7 @@ parse_elf_header(){
             sizeof(uint32_t));
 
     // Elf header size
-    printf("%#06zx %24s %#18"PRIx16" %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %#18"PRIx16" %35s %12s %6zu\n",
             0x0034UL,
             "ELF header size",
             e->e_ehsize,
@@ -335,7 +461,7 @@ parse_elf_header(){
             sizeof(uint16_t));
 
     // Size of single program header entry
-    printf("%#06zx %24s %#18"PRIx16" %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %#18"PRIx16" %35s %12s %6zu\n",
             0x0036UL,
             "Program hdr entry size",
             e->e_phentsize,
@@ -343,17 +469,24 @@ parse_elf_header(){
             "uint16_t",
             sizeof(uint16_t));
 
-    // Number of program header entries
-    printf("%#06zx %24s %#18"PRIx16" %35s %12s %6zu\n",
+    // Number of program header entries; PN_XNUM and a shnum of 0 defer to
+    // section 0.
+    if( PN_XNUM == e->e_phnum ){
+        snprintf(phnum, sizeof( phnum ), "Extended count: %zu", pe_phnum( f ));
+    }
+    if( 0 == e->e_shnum && pe_shnum( f ) ){
+        snprintf(shnum, sizeof( shnum ), "Extended count: %zu", pe_shnum( f ));
+    }
+    ob_printf(out, "%#06zx %24s %#18"PRIx16" %35s %12s %6zu\n",
             0x0038UL,
             "Program hdr entry count",
             e->e_phnum,
-            "",
+            phnum,
             "uint16_t",
             sizeof(uint16_t));
 
     // Size of single section header entry
-    printf("%#06zx %24s %#18"PRIx16" %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %#18"PRIx16" %35s %12s %6zu\n",
             0x003aUL,
             "Section hdr entry size",
             e->e_shentsize,
@@ -362,163 +495,1344 @@ parse_elf_header(){
             sizeof(uint16_t));
 
     // Number of section header entries
-    printf("%#06zx %24s %#18"PRIx16" %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %#18"PRIx16" %35s %12s %6zu\n",
             0x003cUL,
             "Section hdr entry count",
             e->e_shnum,
-            "",
+            shnum,
             "uint16_t",
             sizeof(uint16_t));
 
     // Section header index for the string table.
-    printf("%#06zx %24s %#18"PRIx16" %35s %12s %6zu\n",
+    ob_printf(out, "%#06zx %24s %#18"PRIx16" %35s %12s %6zu\n",
             0x003eUL,
             "Section hdr str idx",
-            e->e_shnum,
-            e->e_shnum == SHN_UNDEF ? "No string table present" :
-            e->e_shnum == SHN_XINDEX ? "Extended index used" :
+            e->e_shstrndx,
+            e->e_shstrndx == SHN_UNDEF ? "No string table present" :
+            e->e_shstrndx == SHN_XINDEX ? "Extended index used" :
             "",
             "uint16_t",
             sizeof(uint16_t));
 
-    printf("\n\n");
+    ob_printf(out, "\n\n");
 }
 
 void
-parse_program_headers(){
-    Elf64_Ehdr *e = (Elf64_Ehdr *)map_addr;
-    Elf64_Phdr *ph = (Elf64_Phdr*)(map_addr+(e->e_phoff));
+parse_program_headers( struct pe_file const *f ){
+    Elf64_Ehdr const *e = pe_ehdr( f );
 
-    printf("Program headers\n");
-    printf("\tStart = %#"PRIx64", Count = %#"PRIx16", Size (each)=%#"PRIx16"\n\n",
-            e->e_phoff, e->e_phnum, e->e_phentsize);
+    ob_printf(out, "Program headers\n");
+    ob_printf(out, "\tStart = %#"PRIx64", Count = %#zx, Size (each)=%#"PRIx16"\n\n",
+            e->e_phoff, pe_phnum( f ), e->e_phentsize);
 
     // Program header index
-    printf("%6s %6s %15s %8s %10s %10s %10s %10s %10s %10s\n",
+    ob_printf(out, "%6s %6s %15s %8s %10s %10s %10s %10s %10s %10s\n",
             "offset", "index","type","perms","offset", "vaddr", "paddr", "filesz", "memsz", "align");
-    printf("%6s %6s %15s %8s %10s %10s %10s %10s %10s %10s\n",
+    ob_printf(out, "%6s %6s %15s %8s %10s %10s %10s %10s %10s %10s\n",
             "", "","(uint32)","(uint32)","(uint64)", "(uint64)", "(uint64)", "(uint64)", "(uint64)", "(uint64)");
-    printf("%6s %6s %15s %8s %10s %10s %10s %10s %10s %10s\n",
+    ob_printf(out, "%6s %6s %15s %8s %10s %10s %10s %10s %10s %10s\n",
         "======", "======", "==============", "========", "==========", "==========", "==========", "==========", "==========", "==========");
-    for(uint16_t i=0; i<e->e_phnum; i++, ph++){
+    for(size_t i=0; i<pe_phnum( f ); i++){
+        Elf64_Phdr const *ph = pe_phdr( f, i );
         //     offset   index        type perms       offset       vaddr        paddr        filesz       memsz        align
-    	snprintf(err_buf, ERR_BUF_SZ, "Invalid:(%#"PRIx32")\n", ph->p_type);
-        printf("%#06lx %#6"PRIx16" %15s %6c%1c%1c %#10"PRIx64" %#10"PRIx64" %#10"PRIx64" %#10"PRIx64" %#10"PRIx64" %#10"PRIx64"\n",
-                e->e_phoff + ( i * e->e_phentsize ),
-                i,                                                      // index
-                ph->p_type == PT_NULL ? "NULL" :                        // type
-                ph->p_type == PT_LOAD ? "LOAD" :
-                ph->p_type == PT_DYNAMIC ? "DYNAMIC" :
-                ph->p_type == PT_INTERP ? "INTERP" :
-                ph->p_type == PT_NOTE ? "NOTE" :
-                ph->p_type == PT_SHLIB ? "SHLIB" :
-                ph->p_type == PT_PHDR ? "PHDR" :
-		// See /usr/include/elf.h for details
-                ph->p_type >= PT_LOPROC && ph->p_type <= PT_HIPROC ? "Processor-specific" :
-		ph->p_type == PT_GNU_EH_FRAME ? "GNU_EH_FRAME" :
-                ph->p_type == PT_GNU_STACK ? "GNU_STACK" :
-                ph->p_type == PT_GNU_RELRO ? "GNU_RELRO" :
-                err_buf,
-                (ph->p_flags & PF_R) ? 'r' : '-',                         // flags
-                (ph->p_flags & PF_W) ? 'w' : '-',
-                (ph->p_flags & PF_X) ? 'x' : '-',
-                ph->p_offset,                                           // offset
-                ph->p_vaddr,                                            // vaddr
-                ph->p_paddr,                                            // paddr
-                ph->p_filesz,                                           // filesz
-                ph->p_memsz,                                            // memsz
-                ph->p_align                                             // align
-                );
+        // i.e. "%#06zx %#6zx %15s %6c%1c%1c %#10x %#10x %#10x %#10x %#10x %#10x\n", built by hand.
+        ob_hex( out, pe_phdr_offset( f, i ), 6, true );
+        ob_putc( out, ' ' );
+        ob_hex( out, i, 6, false );                             // index
+        ob_putc( out, ' ' );
+        ob_str( out, or_invalid( pe_ptype_name( ph->p_type ), "Invalid:(%#"PRIx64")\n", ph->p_type ), 15 );
+        ob_puts( out, "      " );
+        ob_putc( out, (ph->p_flags & PF_R) ? 'r' : '-' );       // flags
+        ob_putc( out, (ph->p_flags & PF_W) ? 'w' : '-' );
+        ob_putc( out, (ph->p_flags & PF_X) ? 'x' : '-' );
+        ob_putc( out, ' ' );
+        ob_hex( out, ph->p_offset, 10, false );                 // offset
+        ob_putc( out, ' ' );
+        ob_hex( out, ph->p_vaddr, 10, false );                  // vaddr
+        ob_putc( out, ' ' );
+        ob_hex( out, ph->p_paddr, 10, false );                  // paddr
+        ob_putc( out, ' ' );
+        ob_hex( out, ph->p_filesz, 10, false );                 // filesz
+        ob_putc( out, ' ' );
+        ob_hex( out, ph->p_memsz, 10, false );                  // memsz
+        ob_putc( out, ' ' );
+        ob_hex( out, ph->p_align, 10, false );                  // align
+        ob_putc( out, '\n' );
+    }
+    ob_printf(out, "\n\n");
+}
+
+/* Huge pages.  Only executable segments are listed, since iTLB reach is
+ * what 2 MiB text pages buy; the total line is the whole text footprint.
+ */
+void
+parse_huge_pages( struct pe_file const *f ){
+    struct pe_huge hp, total = { 0 };
+    uint64_t base = ET_EXEC == pe_ehdr( f )->e_type ? 0 : pe_load_align( f );
+
+    ob_printf(out, "Huge pages\n");
+    ob_printf(out, "\tPage = %#llx, Huge page = %#llx, Load base alignment = ",
+            PE_PAGE_SZ, PE_HUGE_PAGE_SZ);
+    if( base ){
+        ob_printf(out, "%#"PRIx64"\n\n", base);
+    }else{
+        ob_printf(out, "fixed\n\n");
+    }
+    ob_printf(out, "%6s %10s %10s %10s %9s %8s %8s %8s %8s %8s\n",
+            "index", "offset", "vaddr", "memsz", "aligned", "eligible", "huge", "tlb_4k", "tlb_2m", "tlb_mix");
+    ob_printf(out, "%6s %10s %10s %10s %9s %8s %8s %8s %8s %8s\n",
+            "======", "==========", "==========", "==========", "=========", "========",
+            "========", "========", "========", "========");
+    for( size_t i = 0; i < pe_phnum( f ); i++ ){
+        Elf64_Phdr const *ph = pe_phdr( f, i );
+        if( PT_LOAD != ph->p_type || !( ph->p_flags & PF_X ) ){
+            continue;
+        }
+        pe_huge_pages( f, ph, &hp );
+        total.huge_pages += hp.huge_pages;
+        total.tlb_4k += hp.tlb_4k;
+        total.tlb_2m += hp.tlb_2m;
+        total.tlb_mixed += hp.tlb_mixed;
+        //      index     offset      vaddr      memsz   aligned eligible  huge tlb_4k tlb_2m tlb_mix
+        // "aligned" is o (offset), v (vaddr), c (congruent) and b (base),
+        // each - if not.
+        ob_hex( out, i, 6, false );
+        ob_putc( out, ' ' );
+        ob_hex( out, ph->p_offset, 10, false );
+        ob_putc( out, ' ' );
+        ob_hex( out, ph->p_vaddr, 10, false );
+        ob_putc( out, ' ' );
+        ob_hex( out, ph->p_memsz, 10, false );
+        ob_puts( out, "      " );
+        ob_putc( out, hp.offset_aligned ? 'o' : '-' );
+        ob_putc( out, hp.vaddr_aligned ? 'v' : '-' );
+        ob_putc( out, hp.congruent ? 'c' : '-' );
+        ob_putc( out, hp.base_aligned ? 'b' : '-' );
+        ob_str( out, hp.eligible ? "yes" : "no", 9 );
+        ob_putc( out, ' ' );
+        ob_hex( out, hp.huge_pages, 8, false );
+        ob_putc( out, ' ' );
+        ob_hex( out, hp.tlb_4k, 8, false );
+        ob_putc( out, ' ' );
+        ob_hex( out, hp.tlb_2m, 8, false );
+        ob_putc( out, ' ' );
+        ob_hex( out, hp.tlb_mixed, 8, false );
+        ob_putc( out, '\n' );
     }
-    printf("\n\n");
+    ob_printf(out, "%6s %10s %10s %10s %9s %8s ", "total", "", "", "", "", "");
+    ob_hex( out, total.huge_pages, 8, false );
+    ob_putc( out, ' ' );
+    ob_hex( out, total.tlb_4k, 8, false );
+    ob_putc( out, ' ' );
+    ob_hex( out, total.tlb_2m, 8, false );
+    ob_putc( out, ' ' );
+    ob_hex( out, total.tlb_mixed, 8, false );
+    ob_printf(out, "\n\n\n");
 }
 
 void
-parse_section_headers(){
-    Elf64_Ehdr *e = (Elf64_Ehdr *)map_addr;
-    Elf64_Shdr *sh = (Elf64_Shdr*)(map_addr+(e->e_shoff));
-
-    printf("Section headers\n");
-    printf("\tStart = %#"PRIx64", Count = %#"PRIx16", Size (each)=%#"PRIx16"\n\n",
-            e->e_shoff, e->e_shnum, e->e_shentsize);
-    printf("%6s %12s %12s %5s %12s %12s %12s %12s %12s %12s %12s\n",
+parse_dynamic_section( struct pe_file const *f ){
+    Elf64_Dyn const *dyn;
+    size_t count, strsz, start = 0;
+    unsigned char const *strtab;
+
+    if( PE_OK != pe_dynamic( f, &dyn, &count ) ){
+        return;
+    }
+    pe_dynamic_strtab( f, &strtab, &strsz );
+    for( size_t i = 0; i < pe_phnum( f ); i++ ){
+        if( PT_DYNAMIC == pe_phdr( f, i )->p_type ){
+            start = pe_phdr( f, i )->p_offset;
+            break;
+        }
+    }
+
+    ob_printf(out, "Dynamic section\n");
+    ob_printf(out, "\tStart = %#zx, Count = %#zx\n\n", start, count);
+    ob_printf(out, "%6s %18s %18s %s\n", "offset", "tag", "value", "string");
+    ob_printf(out, "%6s %18s %18s %s\n", "======", "==================", "==================", "======");
+    for( size_t i = 0; i < count; i++ ){
+        //     offset   tag value string
+        // i.e. "%#06zx %18s %#18x %s\n", built by hand.
+        char const *str = pe_dtag_is_string( dyn[i].d_tag ) ?
+                pe_string( strtab, strsz, dyn[i].d_un.d_val ) : NULL;
+        ob_hex( out, start + i * pe_dyn_entsize( pe_variant( f ) ), 6, true );
+        ob_putc( out, ' ' );
+        ob_str( out, or_invalid( pe_dtag_name( dyn[i].d_tag ), "%#"PRIx64, dyn[i].d_tag ), 18 );
+        ob_putc( out, ' ' );
+        ob_hex( out, dyn[i].d_un.d_val, 18, false );
+        if( str ){
+            ob_putc( out, ' ' );
+            ob_puts( out, str );
+        }
+        ob_putc( out, '\n' );
+    }
+    ob_printf(out, "\n\n");
+}
+
+void
+parse_section_headers( struct pe_file const *f ){
+    Elf64_Ehdr const *e = pe_ehdr( f );
+
+    ob_printf(out, "Section headers\n");
+    ob_printf(out, "\tStart = %#"PRIx64", Count = %#zx, Size (each)=%#"PRIx16"\n\n",
+            e->e_shoff, pe_shnum( f ), e->e_shentsize);
+    ob_printf(out, "%6s %12s %12s %5s %12s %12s %12s %12s %12s %12s %12s\n",
             "offset", "name", "type", "flags", "saddr", "soffset", "size", "link", "info", "addralign", "entsize");
-    printf("%6s %12s %12s %5s %12s %12s %12s %12s %12s %12s %12s\n",
+    ob_printf(out, "%6s %12s %12s %5s %12s %12s %12s %12s %12s %12s %12s\n",
             "======", "============", "============", "=====", "============", "============", "============", "============", "============", "============", "============");
-    for(uint16_t i=0; i < e->e_shnum; i++, sh++){
-        snprintf(err_buf, ERR_BUF_SZ, "Invalid:(%#12"PRIx32")", sh->sh_type);
+    for(size_t i=0; i < pe_shnum( f ); i++){
+        Elf64_Shdr const *sh = pe_shdr( f, i );
         //     offset        name   type    flags        addr      soffset        ssize      sh_link      sh_info   addr_align      entsize
-        printf("%#06lx %#12"PRIx32" %12s   %s%s%s %#12"PRIx64" %#12"PRIx64" %#12"PRIx64" %#12"PRIx32" %#12"PRIx32" %#12"PRIx64" %#12"PRIx64"\n",
-                e->e_shoff + ( i * e->e_shentsize ),    // offset
-                sh->sh_name,                            // name
-                sh->sh_type == SHT_NULL     ? "NULL"    :
-                sh->sh_type == SHT_PROGBITS ? "PROGBITS":
-                sh->sh_type == SHT_SYMTAB   ? "SYMTAB"  :
-                sh->sh_type == SHT_STRTAB   ? "STRTAB"  :
-                sh->sh_type == SHT_RELA     ? "RELA"    :
-                sh->sh_type == SHT_HASH     ? "HASH"    :
-                sh->sh_type == SHT_DYNAMIC  ? "DYNAMIC" :
-                sh->sh_type == SHT_NOTE     ? "NOTE"    :
-                sh->sh_type == SHT_NOBITS   ? "NOBITS"  :
-                sh->sh_type == SHT_REL      ? "REL"     :
-                sh->sh_type == SHT_SHLIB    ? "SHLIB"   :
-                sh->sh_type == SHT_DYNSYM   ? "DYNSYM"  :
-                err_buf,
-                sh->sh_flags & SHF_WRITE    ? "w" : " ",
-                sh->sh_flags & SHF_ALLOC    ? "a" : " ",
-                sh->sh_flags & SHF_EXECINSTR? "x" : " ",
-                sh->sh_addr,                            // addr
-                sh->sh_offset,                          // soffset
-                sh->sh_size,                            // ssize
-                sh->sh_link,                            // link
-                sh->sh_info,                            // info
-                sh->sh_addralign,                       // addralign
-                sh->sh_entsize                          // entsize
-        );
-    }
-    printf("\n\n");
+        // i.e. "%#06zx %12s %12s   %s%s%s %#12x %#12x %#12x %#12x %#12x %#12x %#12x\n", built by hand.
+        // Names that don't resolve through e_shstrndx are shown as the
+        // raw sh_name offset instead.
+        char const *name = pe_section_name( f, sh );
+        ob_hex( out, pe_shdr_offset( f, i ), 6, true );         // offset
+        ob_putc( out, ' ' );
+        if( name ){                                             // name
+            ob_str( out, name, 12 );
+        }else{
+            ob_hex( out, sh->sh_name, 12, false );
+        }
+        ob_putc( out, ' ' );
+        ob_str( out, or_invalid( pe_shtype_name( sh->sh_type ), "Invalid:(%#12"PRIx64")", sh->sh_type ), 12 );
+        ob_puts( out, "   " );
+        ob_putc( out, sh->sh_flags & SHF_WRITE     ? 'w' : ' ' );
+        ob_putc( out, sh->sh_flags & SHF_ALLOC     ? 'a' : ' ' );
+        ob_putc( out, sh->sh_flags & SHF_EXECINSTR ? 'x' : ' ' );
+        ob_putc( out, ' ' );
+        ob_hex( out, sh->sh_addr, 12, false );                  // addr
+        ob_putc( out, ' ' );
+        ob_hex( out, sh->sh_offset, 12, false );                // soffset
+        ob_putc( out, ' ' );
+        ob_hex( out, sh->sh_size, 12, false );                  // ssize
+        ob_putc( out, ' ' );
+        ob_hex( out, sh->sh_link, 12, false );                  // link
+        ob_putc( out, ' ' );
+        ob_hex( out, sh->sh_info, 12, false );                  // info
+        ob_putc( out, ' ' );
+        ob_hex( out, sh->sh_addralign, 12, false );             // addralign
+        ob_putc( out, ' ' );
+        ob_hex( out, sh->sh_entsize, 12, false );               // entsize
+        ob_putc( out, '\n' );
+    }
+    ob_printf(out, "\n\n");
 
 }
 
-void
-parse_string_tables(){
-    Elf64_Ehdr *e = (Elf64_Ehdr *)map_addr;
-    Elf64_Shdr *sh = (Elf64_Shdr*)(map_addr+(e->e_shoff));
+/* String tables are printed one string per line, each prefixed with its
+ * file offset.  The string boundaries come from the strtab index, and the
+ * strings themselves are never copied into the output buffer when it
+ * drains to a file descriptor: the buffer is flushed and the strings are
+ * handed to writev(2) as iovecs pointing into the map.  In-memory buffers
+ * (batch and recursive mode) just take a copy.
+ */
+#define STRTAB_IOV_STRINGS (IOV_MAX / 3)    // prefix, string, newline
+#define STRTAB_PREFIX_SZ (FMT_MAX( 6 ) + 2)
+
+struct strtab_out {
+    unsigned char const *base;  // Start of the table
+    size_t start;               // Its file offset, for the listing
+    int fd;             // -1 when writing to an in-memory obuf
+    int n;              // Strings queued in iov
+    struct iovec iov[ 3 * STRTAB_IOV_STRINGS ];
+    char prefix[ STRTAB_IOV_STRINGS ][ STRTAB_PREFIX_SZ ];
+};
+
+static void
+writev_all( int fd, struct iovec *iov, int iovcnt ){
+    while( iovcnt > 0 ){
+        ssize_t n = writev( fd, iov, iovcnt );
+        assert( -1 != n );
+        // Skip the iovecs that went out completely, trim the partial one.
+        while( iovcnt > 0 && (size_t)n >= iov->iov_len ){
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if( iovcnt > 0 ){
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
 
-    printf("String tables\n\n");
-    for(uint16_t i=0; i<e->e_shnum; i++, sh++){
+static void
+emit_string( struct strtab_out *so, size_t str_offset, size_t len, bool nul ){
+    static char newline[] = "\n";
+    unsigned char const *str = so->base + str_offset;
+    char *prefix = so->prefix[ so->n ];
+    size_t plen = fmt_hex( prefix, so->start + str_offset, 6, true );   // %#06zx
+
+    prefix[plen++] = ':';
+    prefix[plen++] = '\t';
+    if( -1 == so->fd ){
+        ob_write( out, prefix, plen );
+        ob_write( out, str, len );
+        if( nul ){
+            ob_putc( out, '\n' );
+        }
+        return;
+    }
+    so->iov[ 3*so->n+0 ] = (struct iovec){ prefix, plen };
+    so->iov[ 3*so->n+1 ] = (struct iovec){ (void *)str, len };
+    so->iov[ 3*so->n+2 ] = (struct iovec){ newline, nul ? 1 : 0 };
+    if( ++so->n == STRTAB_IOV_STRINGS ){
+        writev_all( so->fd, so->iov, 3 * so->n );
+        so->n = 0;
+    }
+}
+
+static void
+emit_string_table( struct pe_file const *f, Elf64_Shdr const *sh ){
+    static _Thread_local struct strtab_out so;
+    unsigned char const *tab;
+    size_t len, count;
+    uint32_t *starts;
+
+    if( PE_OK != pe_section_data( f, sh, &tab, &len ) ){
+        return;
+    }
+    so.base = tab;
+    so.start = sh->sh_offset;
+    so.fd = out->fd;
+    so.n = 0;
+    ob_flush( out );
+    if( 0 == len ){
+        return;
+    }
+
+    starts = strtab_index( tab, len, &count );
+    if( NULL != starts ){
+        // Every string but the last ends one byte before the next begins.
+        for( size_t i = 0; i + 1 < count; i++ ){
+            emit_string( &so, starts[i], starts[i+1] - starts[i] - 1, true );
+        }
+        bool nul = ( 0 == tab[ len - 1 ] );
+        emit_string( &so, starts[count-1], len - starts[count-1] - ( nul ? 1 : 0 ), nul );
+        free( starts );
+    }else{
+        // Too large for 32-bit offsets; walk it with memchr instead.
+        for( size_t off = 0; off < len; ){
+            unsigned char const *nul = memchr( tab + off, 0, len - off );
+            size_t slen = nul ? (size_t)( nul - ( tab + off ) ) : len - off;
+            emit_string( &so, off, slen, NULL != nul );
+            off += slen + ( nul ? 1 : 0 );
+        }
+    }
+    if( so.n ){
+        writev_all( so.fd, so.iov, 3 * so.n );
+    }
+}
+
+void
+parse_string_tables( struct pe_file const *f ){
+    ob_printf(out, "String tables\n\n");
+    for(size_t i=0; i<pe_shnum( f ); i++){
+        Elf64_Shdr const *sh = pe_shdr( f, i );
         if( sh->sh_type == SHT_STRTAB ){
-            for(
-                    size_t str_offset = (size_t)(sh->sh_offset), newline=1;
-                    str_offset < (size_t)(sh->sh_offset + sh->sh_size);
-               ){
-                    if(newline){
-                        newline = !newline;
-                        printf("%#06zx:\t", str_offset);
-                    }
-                    if( map_addr[str_offset] == 0 ){
-                        newline = 1;
-                        printf("\n");
-                    }else{
-                        printf("%c", map_addr[str_offset]);
-                    }
-                    str_offset++;
+            emit_string_table( f, sh );
+        }
+    }
+    ob_printf(out, "\n\n");
+}
+
+/* Symbols are listed in address order from the symbol index rather than in
+ * table order, which is what anyone matching addresses against them wants.
+ */
+static void
+emit_symbol_table( struct pe_file const *f, uint32_t sh_type, char const *title ){
+    struct pe_symtab *st;
+    struct pe_sym sym;
+
+    if( PE_OK != pe_symtab_build( f, sh_type, &st ) ){
+        return;
+    }
+    ob_printf(out, "%s\n\tCount = %#zx\n\n", title, pe_symtab_count( st ));
+    ob_printf(out, "%18s %12s %8s %8s %6s %s\n",
+            "value", "size", "type", "bind", "shndx", "name");
+    ob_printf(out, "%18s %12s %8s %8s %6s %s\n",
+            "==================", "============", "========", "========", "======", "====");
+    for( size_t i = 0; i < pe_symtab_count( st ); i++ ){
+        char const *name = pe_symtab_name( st, i );
+        pe_symtab_get( st, i, &sym );
+        //      value     size  type  bind   shndx name
+        // i.e. "%#018x %#12x %8s %8s %#6x %s\n", built by hand.
+        ob_hex( out, sym.value, 18, true );
+        ob_putc( out, ' ' );
+        ob_hex( out, sym.size, 12, false );
+        ob_putc( out, ' ' );
+        ob_str( out, or_invalid( pe_symtype_name( ELF64_ST_TYPE( sym.info ) ), "%#"PRIx64, ELF64_ST_TYPE( sym.info ) ), 8 );
+        ob_putc( out, ' ' );
+        ob_str( out, or_invalid( pe_symbind_name( ELF64_ST_BIND( sym.info ) ), "%#"PRIx64, ELF64_ST_BIND( sym.info ) ), 8 );
+        ob_putc( out, ' ' );
+        ob_hex( out, sym.shndx, 6, false );
+        ob_putc( out, ' ' );
+        ob_puts( out, name ? name : "" );
+        ob_putc( out, '\n' );
+    }
+    ob_printf(out, "\n\n");
+    pe_symtab_free( st );
+}
+
+void
+parse_symbols( struct pe_file const *f ){
+    emit_symbol_table( f, SHT_SYMTAB, "Symbols (.symtab)" );
+    emit_symbol_table( f, SHT_DYNSYM, "Symbols (.dynsym)" );
+}
+
+/* Relocations.  The counts come from one pass over the mapped table; the
+ * only allocations are the per-symbol counters, sized by the symbol table
+ * and not by the number of relocations, and the list of referenced symbols
+ * sorted for printing.
+ */
+struct reloc_syms {
+    unsigned char const *syms;  // Linked symbol table, NULL if none
+    enum pe_variant variant;
+    size_t entsize;
+    size_t nsyms;
+    unsigned char const *strs;
+    size_t strs_len;
+};
+
+static void
+reloc_syms_open( struct pe_file const *f, Elf64_Shdr const *sh, struct reloc_syms *rs ){
+    Elf64_Shdr const *symsh = pe_shdr( f, sh->sh_link );
+    size_t len;
+
+    *rs = (struct reloc_syms){ 0 };
+    if( NULL == symsh || symsh->sh_entsize < pe_sym_entsize( pe_variant( f ) )
+            || PE_OK != pe_section_data( f, symsh, &rs->syms, &len ) ){
+        rs->syms = NULL;
+        return;
+    }
+    rs->variant = pe_variant( f );
+    rs->entsize = symsh->sh_entsize;
+    rs->nsyms = len / symsh->sh_entsize;
+    if( NULL != pe_shdr( f, symsh->sh_link ) ){
+        pe_section_data( f, pe_shdr( f, symsh->sh_link ), &rs->strs, &rs->strs_len );
+    }
+}
+
+static char const *
+reloc_sym_name( struct reloc_syms const *rs, uint32_t sym ){
+    Elf64_Sym s;
+
+    if( sym >= rs->nsyms ){
+        return NULL;
+    }
+    pe_sym_read( rs->variant, rs->syms + sym * rs->entsize, &s );
+    return pe_string( rs->strs, rs->strs_len, s.st_name );
+}
+
+static _Thread_local uint32_t const *sort_refs;    // qsort(3) has no context argument
+
+static int
+cmp_refs( void const *a, void const *b ){
+    uint32_t x = *(uint32_t const *)a, y = *(uint32_t const *)b;
+    if( sort_refs[x] != sort_refs[y] ){
+        return sort_refs[x] < sort_refs[y] ? 1 : -1;
+    }
+    return x < y ? -1 : x > y;
+}
+
+void
+emit_relocations( struct pe_file const *f, Elf64_Shdr const *sh ){
+    static _Thread_local struct pe_reloc_hist h;
+    struct pe_reloc_iter it;
+    struct reloc_syms rs;
+    char const *name = pe_section_name( f, sh );
+    unsigned machine = pe_ehdr( f )->e_machine;
+    uint32_t *order;
+    size_t nref = 0;
+
+    if( PE_OK != pe_reloc_begin( f, sh, &it ) ){
+        return;
+    }
+    reloc_syms_open( f, sh, &rs );
+    memset( &h, 0, sizeof( h ) );
+    h.nsyms = rs.nsyms;
+    h.sym_refs = calloc( rs.nsyms + 1, sizeof( uint32_t ) );
+    order = malloc( ( rs.nsyms + 1 ) * sizeof( uint32_t ) );
+    assert( NULL != h.sym_refs && NULL != order );
+    pe_reloc_count( it, &h );
+
+    ob_printf(out, "Relocations (%s)\n", name ? name : "?");
+    ob_printf(out, "\tType = %s, Count = %#"PRIx64", Symbols = %s\n\n",
+            SHT_RELA == sh->sh_type ? "RELA" : "REL", h.count,
+            rs.syms ? or_invalid( pe_section_name( f, pe_shdr( f, sh->sh_link ) ), "%#"PRIx64, sh->sh_link ) : "none");
+    ob_printf(out, "%12s %s\n", "count", "type");
+    ob_printf(out, "%12s %s\n", "============", "====");
+    for( uint32_t t = 0; t < PE_RELOC_NTYPES; t++ ){
+        if( h.by_type[t] ){
+            ob_hex( out, h.by_type[t], 12, false );
+            ob_putc( out, ' ' );
+            ob_puts( out, or_invalid( pe_reloc_type_name( machine, t ), "%#"PRIx64, t ) );
+            ob_putc( out, '\n' );
+        }
+    }
+    if( h.other_type ){
+        ob_hex( out, h.other_type, 12, false );
+        ob_puts( out, " (other)\n" );
+    }
+
+    // Symbols by reference count, most referenced first.
+    for( uint32_t i = 1; i < rs.nsyms; i++ ){
+        if( h.sym_refs[i] ){
+            order[ nref++ ] = i;
+        }
+    }
+    sort_refs = h.sym_refs;
+    qsort( order, nref, sizeof( uint32_t ), cmp_refs );
+    ob_printf(out, "\n%12s %s\n", "references", "symbol");
+    ob_printf(out, "%12s %s\n", "============", "======");
+    for( size_t i = 0; i < nref; i++ ){
+        char const *sym = reloc_sym_name( &rs, order[i] );
+        ob_hex( out, h.sym_refs[ order[i] ], 12, false );
+        ob_putc( out, ' ' );
+        if( sym ){
+            ob_puts( out, sym );
+        }else{
+            ob_hex( out, order[i], 0, false );
+        }
+        ob_putc( out, '\n' );
+    }
+    if( h.no_symbol ){
+        ob_hex( out, h.no_symbol, 12, false );
+        ob_puts( out, " (none)\n" );
+    }
+    free( order );
+    free( h.sym_refs );
+
+    if( relocs > 1 ){
+        struct pe_reloc r;
+        ob_printf(out, "\n%18s %24s %18s %s\n", "offset", "type", "addend", "symbol");
+        ob_printf(out, "%18s %24s %18s %s\n", "==================", "========================", "==================", "======");
+        while( pe_reloc_next( &it, &r ) ){
+            //     offset type   addend symbol
+            // i.e. "%#018x %24s %#18x %s\n", built by hand.
+            char const *sym = r.sym ? reloc_sym_name( &rs, r.sym ) : NULL;
+            ob_hex( out, r.offset, 18, true );
+            ob_putc( out, ' ' );
+            ob_str( out, or_invalid( pe_reloc_type_name( machine, r.type ), "%#"PRIx64, r.type ), 24 );
+            ob_putc( out, ' ' );
+            ob_hex( out, (uint64_t)r.addend, 18, false );
+            ob_putc( out, ' ' );
+            ob_puts( out, sym ? sym : "" );
+            ob_putc( out, '\n' );
+        }
+    }
+    ob_printf(out, "\n\n");
+}
+
+void
+emit_relr( struct pe_file const *f, Elf64_Shdr const *sh ){
+    unsigned char const *data;
+    size_t len;
+    char const *name = pe_section_name( f, sh );
+
+    if( PE_OK != pe_section_data( f, sh, &data, &len ) ){
+        return;
+    }
+    ob_printf(out, "Relocations (%s)\n", name ? name : "?");
+    ob_printf(out, "\tType = RELR, Count = %#"PRIx64"\n\n\n", pe_relr_count( pe_variant( f ), data, len ));
+}
+
+void
+parse_relocations( struct pe_file const *f ){
+    for( size_t i = 0; i < pe_shnum( f ); i++ ){
+        Elf64_Shdr const *sh = pe_shdr( f, i );
+        if( SHT_REL == sh->sh_type || SHT_RELA == sh->sh_type ){
+            emit_relocations( f, sh );
+        }else if( SHT_RELR == sh->sh_type ){
+            emit_relr( f, sh );
+        }
+    }
+}
+
+/* Residency mode.
+ *
+ * The "before" snapshot is taken by parse_file() ahead of pe_open(), so
+ * the header reads don't count.  Prefetching is asynchronous, so "after"
+ * may not show all of it yet.
+ */
+
+// Resolve a --prefetch / --evict range against f.
+static bool
+advice_range( struct pe_file const *f, char const *spec, uint64_t *off, uint64_t *len ){
+    Elf64_Shdr const *sh;
+    char *end;
+
+    if( 0 == strcmp( spec, "all" ) ){
+        *off = *len = 0;
+        return true;
+    }
+    if( NULL != ( sh = pe_section_by_name( f, spec ) ) ){
+        *off = sh->sh_offset;
+        *len = sh->sh_size;
+        return SHT_NOBITS != sh->sh_type && 0 != sh->sh_size;
+    }
+    *off = strtoull( spec, &end, 0 );
+    if( ':' == *end && end != spec ){
+        *len = strtoull( end + 1, &end, 0 );
+        return '\0' == *end;
+    }
+    return false;
+}
+
+// A --prefetch or --evict request, resolved while the file is open and
+// applied once it is closed: pages this process has mapped can't be
+// evicted.
+struct advice {
+    char const *spec;
+    enum pe_advice advice;
+    uint64_t off, len;
+    bool ok;
+};
+
+static void
+advice_resolve( struct pe_file const *f, struct advice *a ){
+    a->ok = a->spec && advice_range( f, a->spec, &a->off, &a->len );
+    if( a->spec && !a->ok ){
+        fprintf(stderr, "%s:%s:%d %s: No range '%s'.\n",
+            __FILE__, __func__, __LINE__, pe_path( f ), a->spec);
+    }
+}
+
+static void
+advice_apply( char const *path, struct advice *a ){
+    int rc;
+
+    if( a->ok && PE_OK != ( rc = pe_advise( path, a->off, a->len, a->advice ) ) ){
+        fprintf(stderr, "%s:%s:%d %s: %s.\n",
+            __FILE__, __func__, __LINE__, path, pe_strerror( rc ));
+        a->ok = false;
+    }
+}
+
+static void
+emit_residency_row( char const *kind, size_t index, uint64_t off, uint64_t len, char const *name,
+        struct pe_residency const *before, struct pe_residency const *after ){
+    uint64_t pages, resident;
+
+    //     kind  index     offset       size    pages resident    after name
+    // i.e. "%8s %6s %#10x %#10x %#8x %#8x %#8x %s\n", built by hand.
+    pe_resident_range( before, off, len, &pages, &resident );
+    ob_str( out, kind, 8 );
+    ob_putc( out, ' ' );
+    ob_hex( out, index, 6, false );
+    ob_putc( out, ' ' );
+    ob_hex( out, off, 10, false );
+    ob_putc( out, ' ' );
+    ob_hex( out, len, 10, false );
+    ob_putc( out, ' ' );
+    ob_hex( out, pages, 8, false );
+    ob_putc( out, ' ' );
+    ob_hex( out, resident, 8, false );
+    if( after ){
+        pe_resident_range( after, off, len, &pages, &resident );
+        ob_putc( out, ' ' );
+        ob_hex( out, resident, 8, false );
+    }
+    ob_putc( out, ' ' );
+    ob_puts( out, name );
+    ob_putc( out, '\n' );
+}
+
+// *fp is closed and reopened around the advice; false if reopening fails.
+bool
+parse_residency( struct pe_file **fp, struct pe_residency const *before ){
+    struct advice adv[] = {
+        { .spec = prefetch_range, .advice = PE_ADVISE_PREFETCH },
+        { .spec = evict_range, .advice = PE_ADVISE_EVICT } };
+    struct pe_residency after_r = { 0 };
+    struct pe_residency const *after = NULL;
+    struct pe_file *f = *fp;
+    uint64_t pages, resident;
+    char *path;
+    int rc;
+
+    advice_resolve( f, &adv[0] );
+    advice_resolve( f, &adv[1] );
+    if( adv[0].ok || adv[1].ok ){
+        path = strdup( pe_path( f ) );
+        assert( NULL != path );
+        pe_close( f );
+        *fp = NULL;
+        advice_apply( path, &adv[0] );
+        advice_apply( path, &adv[1] );
+        if( PE_OK == pe_mincore( path, &after_r ) ){
+            after = &after_r;
+        }
+        rc = pe_open( path, fp );
+        if( PE_OK != rc ){
+            fprintf(stderr, "%s:%s:%d %s: %s.\n",
+                __FILE__, __func__, __LINE__, path, pe_strerror( rc ));
+            pe_residency_free( &after_r );
+            free( path );
+            return false;
+        }
+        free( path );
+        f = *fp;
+    }
+    if( REC_TEXT != format ){
+        rec_write_residency( out, format, f, before, after );
+        pe_residency_free( &after_r );
+        return true;
+    }
+
+    pe_resident_range( before, 0, pe_size( f ), &pages, &resident );
+    ob_printf(out, "Page cache\n");
+    ob_printf(out, "\tPage = %#zx, Pages = %#"PRIx64", Resident = %#"PRIx64"",
+            before->page_size, pages, resident);
+    if( after ){
+        pe_resident_range( after, 0, pe_size( f ), &pages, &resident );
+        ob_printf(out, ", After = %#"PRIx64"", resident);
+    }
+    ob_printf(out, "\n\n");
+    ob_printf(out, "%8s %6s %10s %10s %8s %8s ", "kind", "index", "offset", "size", "pages", "resident");
+    if( after ){
+        ob_printf(out, "%8s ", "after");
+    }
+    ob_printf(out, "name\n");
+    ob_printf(out, "%8s %6s %10s %10s %8s %8s ", "========", "======", "==========", "==========",
+            "========", "========");
+    if( after ){
+        ob_printf(out, "%8s ", "========");
+    }
+    ob_printf(out, "====\n");
+    for( size_t i = 0; i < pe_phnum( f ); i++ ){
+        Elf64_Phdr const *ph = pe_phdr( f, i );
+        if( PT_LOAD == ph->p_type ){
+            char perms[4] = {
+                (ph->p_flags & PF_R) ? 'r' : '-',
+                (ph->p_flags & PF_W) ? 'w' : '-',
+                (ph->p_flags & PF_X) ? 'x' : '-', '\0' };
+            emit_residency_row( "segment", i, ph->p_offset, ph->p_filesz, perms, before, after );
+        }
+    }
+    for( size_t i = 0; i < pe_shnum( f ); i++ ){
+        Elf64_Shdr const *sh = pe_shdr( f, i );
+        if( SHT_NOBITS != sh->sh_type && sh->sh_size ){
+            emit_residency_row( "section", i, sh->sh_offset, sh->sh_size,
+                    or_invalid( pe_section_name( f, sh ), "%#"PRIx64, sh->sh_name ), before, after );
+        }
+    }
+    ob_printf(out, "\n\n");
+    pe_residency_free( &after_r );
+    return true;
+}
+
+/* Lookup mode prints one line per file that defines the symbol, and
+ * nothing for files that don't (or that have no hash table to ask).
+ */
+void
+lookup_symbol( struct pe_file const *f ){
+    struct pe_dynhash h;
+    Elf64_Sym sym;
+
+    if( PE_OK != pe_dynhash_open( f, &h ) || !pe_dynhash_lookup( &h, lookup_name, &sym ) ){
+        return;
+    }
+    if( REC_TEXT != format ){
+        rec_write_lookup( out, format, f, lookup_name, &sym );
+        return;
+    }
+    ob_puts( out, pe_path( f ) );
+    ob_putc( out, '\t' );
+    ob_puts( out, lookup_name );
+    ob_putc( out, '\t' );
+    ob_hex( out, sym.st_value, 18, true );
+    ob_putc( out, '\t' );
+    ob_hex( out, sym.st_size, 0, false );
+    ob_putc( out, '\t' );
+    ob_puts( out, or_invalid( pe_symtype_name( ELF64_ST_TYPE( sym.st_info ) ), "%#"PRIx64, ELF64_ST_TYPE( sym.st_info ) ) );
+    ob_putc( out, '\t' );
+    ob_puts( out, or_invalid( pe_symbind_name( ELF64_ST_BIND( sym.st_info ) ), "%#"PRIx64, ELF64_ST_BIND( sym.st_info ) ) );
+    ob_putc( out, '\n' );
+}
+
+/* Address mode prints the symbol containing the address in each file that
+ * has one.  .symtab is preferred since .dynsym only has the exports.  See
+ * pe_symtab_lookup() for what "containing" means with overlapping symbols.
+ */
+void
+lookup_address( struct pe_file const *f ){
+    static uint32_t const tables[] = { SHT_SYMTAB, SHT_DYNSYM };
+    struct pe_symtab *st;
+    struct pe_sym sym;
+    ptrdiff_t i = -1;
+    size_t t;
+
+    for( t = 0; t < sizeof( tables ) / sizeof( tables[0] ); t++ ){
+        if( PE_OK == pe_symtab_build( f, tables[t], &st ) ){
+            break;
+        }
+    }
+    if( t == sizeof( tables ) / sizeof( tables[0] ) ){
+        return;
+    }
+    if( -1 == ( i = pe_symtab_lookup( st, address ) ) ){
+        pe_symtab_free( st );
+        return;
+    }
+    char const *name = pe_symtab_name( st, i );
+    pe_symtab_get( st, i, &sym );
+    if( REC_TEXT != format ){
+        rec_write_address( out, format, f, tables[t], name, &sym );
+        pe_symtab_free( st );
+        return;
+    }
+    ob_puts( out, pe_path( f ) );
+    ob_putc( out, '\t' );
+    ob_hex( out, address, 18, true );
+    ob_putc( out, '\t' );
+    ob_puts( out, name ? name : "" );
+    ob_puts( out, "+" );
+    ob_hex( out, address - sym.value, 0, true );
+    ob_putc( out, '\t' );
+    ob_hex( out, sym.value, 18, true );
+    ob_putc( out, '\t' );
+    ob_hex( out, sym.size, 0, false );
+    ob_putc( out, '\t' );
+    ob_puts( out, or_invalid( pe_symtype_name( ELF64_ST_TYPE( sym.info ) ), "%#"PRIx64, ELF64_ST_TYPE( sym.info ) ) );
+    ob_putc( out, '\t' );
+    ob_puts( out, or_invalid( pe_symbind_name( ELF64_ST_BIND( sym.info ) ), "%#"PRIx64, ELF64_ST_BIND( sym.info ) ) );
+    ob_putc( out, '\n' );
+    pe_symtab_free( st );
+}
+
+/* I/O accounting for --io.  Files and bytes are counted as they are
+ * opened; faults, storage reads and time are taken for the whole process,
+ * so they include whatever else the run did with the files.
+ */
+static _Atomic uint64_t io_files;
+static _Atomic uint64_t io_bytes;
+
+struct io_sample {
+    struct timespec t;
+    struct rusage ru;
+    uint64_t storage;               // read_bytes from /proc/self/io
+};
+
+static void
+io_sample( struct io_sample *s ){
+    FILE *fp = fopen( "/proc/self/io", "r" );
+    char line[128];
+
+    clock_gettime( CLOCK_MONOTONIC, &s->t );
+    getrusage( RUSAGE_SELF, &s->ru );
+    s->storage = 0;
+    while( fp && fgets( line, sizeof( line ), fp ) ){
+        if( 1 == sscanf( line, "read_bytes: %"SCNu64, &s->storage ) ){
+            break;
+        }
+    }
+    if( fp ){
+        fclose( fp );
+    }
+}
+
+static void
+io_report( struct io_sample const *start ){
+    struct io_sample end;
+
+    io_sample( &end );
+    fprintf(stderr, "I/O\n");
+    fprintf(stderr, "\tStrategy = %s, Files = %"PRIu64", Bytes read = %"PRIu64"\n",
+            pe_io_name( io ), atomic_load( &io_files ), atomic_load( &io_bytes ));
+    fprintf(stderr, "\tMinor faults = %ld, Major faults = %ld, Storage read = %"PRIu64"\n",
+            end.ru.ru_minflt - start->ru.ru_minflt, end.ru.ru_majflt - start->ru.ru_majflt,
+            end.storage - start->storage);
+    fprintf(stderr, "\tElapsed = %.3f ms\n",
+            ( end.t.tv_sec - start->t.tv_sec ) * 1e3 + ( end.t.tv_nsec - start->t.tv_nsec ) / 1e6);
+}
+
+bool
+parse_file( char const *pathname ){
+    struct pe_file *f;
+    struct pe_residency before = { 0 };
+    int rc;
+
+    stats_file_begin( pathname );
+    // Before pe_open(), whose header reads would show up as resident.
+    if( residency ){
+        pe_mincore( pathname, &before );
+    }
+    stats_begin( STATS_OPEN );
+    if( 0 == strcmp( pathname, "-" ) ){
+        rc = pe_open_stream( STDIN_FILENO, pathname, stream_window, &f );
+    }else if( -1 == io ){
+        rc = pe_open( pathname, &f );
+    }else{
+        rc = pe_open_io( pathname, io, &f );
+    }
+    stats_end( STATS_OPEN );
+    if( PE_OK != rc ){
+        pe_residency_free( &before );
+        // Recursive mode expects most files not to be ELF.
+        if( !( recursive && PE_ERR_NOT_ELF == rc ) ){
+            fprintf(stderr, "%s:%s:%d %s: %s.\n",
+                __FILE__, __func__, __LINE__, pathname, pe_strerror( rc ));
+        }
+        stats_file_end( false );
+        return false;
+    }
+    if( -1 != io ){
+        atomic_fetch_add( &io_files, 1 );
+        atomic_fetch_add( &io_bytes, pe_bytes_read( f ) );
+    }
+    if( lookup_name || lookup_addr ){
+        stats_begin( STATS_LOOKUP );
+        if( lookup_name ){
+            lookup_symbol( f );
+        }else{
+            lookup_address( f );
+        }
+        stats_end( STATS_LOOKUP );
+    }else if( residency ){
+        stats_begin( STATS_RESIDENCY );
+        bool ok = parse_residency( &f, &before );
+        stats_end( STATS_RESIDENCY );
+        pe_residency_free( &before );
+        if( !ok ){
+            stats_file_end( false );
+            return false;
+        }
+    }else if( REC_TEXT == format ){
+        stats_begin( STATS_HEADER );
+        parse_elf_header( f );
+        stats_end( STATS_HEADER );
+        stats_begin( STATS_PHDRS );
+        parse_program_headers( f );
+        stats_end( STATS_PHDRS );
+        if( huge_pages ){
+            stats_begin( STATS_HUGE_PAGES );
+            parse_huge_pages( f );
+            stats_end( STATS_HUGE_PAGES );
+        }
+        stats_begin( STATS_SHDRS );
+        parse_section_headers( f );
+        stats_end( STATS_SHDRS );
+        stats_begin( STATS_STRTABS );
+        parse_string_tables( f );
+        stats_end( STATS_STRTABS );
+        if( symbols ){
+            stats_begin( STATS_SYMBOLS );
+            parse_symbols( f );
+            stats_end( STATS_SYMBOLS );
+        }
+        if( relocs ){
+            stats_begin( STATS_RELOCS );
+            parse_relocations( f );
+            stats_end( STATS_RELOCS );
+        }
+    }else{
+        stats_begin( STATS_RECORDS );
+        rec_write_file( out, format, f );
+        stats_end( STATS_RECORDS );
+        if( huge_pages ){
+            stats_begin( STATS_HUGE_PAGES );
+            rec_write_huge_pages( out, format, f );
+            stats_end( STATS_HUGE_PAGES );
+        }
+        if( symbols ){
+            stats_begin( STATS_SYMBOLS );
+            rec_write_symbols( out, format, f );
+            stats_end( STATS_SYMBOLS );
+        }
+        if( relocs ){
+            stats_begin( STATS_RELOCS );
+            rec_write_relocs( out, format, f, relocs > 1 );
+            stats_end( STATS_RELOCS );
+        }
+    }
+    stats_begin( STATS_CLOSE );
+    pe_close( f );
+    stats_end( STATS_CLOSE );
+    stats_file_end( true );
+    return true;
+}
+
+/* Batch mode.
+ *
+ * Each file becomes one pool task that renders its output into a private
+ * in-memory obuf.  The main thread hands the finished buffers to stdout
+ * strictly in command-line order, and keeps at most batch_window files in
+ * flight so a slow file early in the list can't make the rest pile up in
+ * memory.
+ */
+struct batch_job {
+    char const *pathname;
+    struct obuf ob;
+    bool ok;
+    bool done;
+};
+
+static struct obuf stdout_ob;            // Main thread, or under stdout_lock
+static pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t batch_cv = PTHREAD_COND_INITIALIZER;
+
+static void
+batch_parse( void *arg ){
+    struct batch_job *job = arg;
+
+    ob_init_mem( &job->ob );
+    out = &job->ob;
+    job->ok = parse_file( job->pathname );
+
+    pthread_mutex_lock( &batch_lock );
+    job->done = true;
+    pthread_cond_broadcast( &batch_cv );
+    pthread_mutex_unlock( &batch_lock );
+}
+
+// False if any file failed, as parse_file() is for a single file.
+bool
+parse_batch(){
+    struct batch_job *jobs = calloc( nfilenames, sizeof( struct batch_job ) );
+    struct pool *p = pool_create( njobs );
+    int batch_window = 4 * njobs;
+    int submitted = 0;
+    bool all_ok = true;
+
+    assert( NULL != jobs );
+    for( ; submitted < nfilenames && submitted < batch_window; submitted++ ){
+        jobs[submitted].pathname = filenames[submitted];
+        pool_submit( p, batch_parse, &jobs[submitted] );
+    }
+    for( int i = 0; i < nfilenames; i++ ){
+        pthread_mutex_lock( &batch_lock );
+        while( !jobs[i].done ){
+            pthread_cond_wait( &batch_cv, &batch_lock );
+        }
+        pthread_mutex_unlock( &batch_lock );
+
+        if( jobs[i].ok ){
+            if( REC_TEXT == format && NULL == lookup_name && !lookup_addr ){
+                ob_printf(&stdout_ob, "File: %s\n\n", jobs[i].pathname);
             }
+            ob_write( &stdout_ob, jobs[i].ob.buf, jobs[i].ob.len );
+        }
+        all_ok = all_ok && jobs[i].ok;
+        ob_free( &jobs[i].ob );
+
+        if( submitted < nfilenames ){
+            jobs[submitted].pathname = filenames[submitted];
+            pool_submit( p, batch_parse, &jobs[submitted] );
+            submitted++;
         }
     }
-    printf("\n\n");
+    pool_destroy( p );
+    free( jobs );
+    return all_ok;
+}
+
+/* Recursive mode.
+ *
+ * Directory operands are walked in parallel and every regular file found
+ * is offered to parse_file(), whose magic-number check turns away non-ELF
+ * files before anything is mapped.  There is no meaningful order to keep,
+ * so each file's output goes to stdout as soon as it is complete.
+ */
+static pthread_mutex_t stdout_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+scan_parse( char const *path, [[maybe_unused]] void *arg ){
+    struct obuf ob;
+
+    ob_init_mem( &ob );
+    out = &ob;
+    if( parse_file( path ) ){
+        pthread_mutex_lock( &stdout_lock );
+        if( REC_TEXT == format && NULL == lookup_name && !lookup_addr ){
+            ob_printf(&stdout_ob, "File: %s\n\n", path);
+        }
+        ob_write( &stdout_ob, ob.buf, ob.len );
+        pthread_mutex_unlock( &stdout_lock );
+    }
+    ob_free( &ob );
+}
+
+static void
+scan_file_task( void *arg ){
+    scan_parse( arg, NULL );
+}
+
+void
+parse_recursive(){
+    struct pool *p = pool_create( njobs );
+    struct stat s;
+
+    for( int i = 0; i < nfilenames; i++ ){
+        if( -1 == stat( filenames[i], &s ) ){
+            fprintf(stderr, "%s:%s:%d Unable to stat %s.\n",
+                __FILE__, __func__, __LINE__, filenames[i]);
+        }else if( S_ISDIR( s.st_mode ) ){
+            walk_tree( p, filenames[i], scan_parse, NULL );
+        }else{
+            pool_submit( p, scan_file_task, filenames[i] );
+        }
+    }
+    pool_destroy( p );
+}
+
+/* Dependency mode.
+ *
+ * Every root is loaded, and its dependencies prefetched, on the pool.  Once
+ * everything has settled the closures are resolved from the library cache
+ * and printed in command-line order, or in path order for roots found by
+ * walking directories.
+ */
+static void
+deps_found( char const *path, void *arg ){
+    deps_add_root( arg, path );
+}
+
+void
+print_dependencies( struct deps_entry const *e, size_t n ){
+    ob_printf(out, "Dependencies\n");
+    ob_printf(out, "\tCount = %#zx\n\n", n);
+    for( size_t i = 0; i < n; i++ ){
+        ob_putc( out, '\t' );
+        ob_puts( out, e[i].name );
+        ob_puts( out, " => " );
+        ob_puts( out, e[i].path ? e[i].path : "not found" );
+        ob_putc( out, '\n' );
+    }
+    ob_printf(out, "\n\n");
+}
+
+// Add every operand as a root, walking directories under -r, and wait for
+// all of them and their dependencies to load.
+static struct deps *
+load_roots( struct pool *p ){
+    struct deps *d = deps_create( p, sysroot );
+    struct stat s;
+
+    for( int i = 0; i < nfilenames; i++ ){
+        if( recursive && 0 == stat( filenames[i], &s ) && S_ISDIR( s.st_mode ) ){
+            walk_tree( p, filenames[i], deps_found, d );
+        }else{
+            deps_add_root( d, filenames[i] );
+        }
+    }
+    pool_wait( p );
+    return d;
+}
+
+static void
+closure_error( char const *root, int rc ){
+    if( !( recursive && PE_ERR_NOT_ELF == rc ) ){
+        fprintf(stderr, "%s:%s:%d %s: %s.\n",
+            __FILE__, __func__, __LINE__, root, pe_strerror( rc ));
+    }
+}
+
+void
+parse_deps(){
+    struct pool *p = pool_create( njobs );
+    struct deps *d = load_roots( p );
+    char const *const *roots;
+    size_t nroots;
+
+    out = &stdout_ob;
+    roots = deps_roots( d, &nroots, recursive );
+    for( size_t i = 0; i < nroots; i++ ){
+        struct deps_entry *e;
+        size_t n;
+        int rc = deps_closure( d, roots[i], &e, &n );
+
+        if( PE_OK != rc ){
+            closure_error( roots[i], rc );
+            continue;
+        }
+        if( REC_TEXT == format ){
+            struct pe_file *f;
+            ob_printf(out, "File: %s\n\n", roots[i]);
+            // The dynamic section the closure came from, with its strings.
+            if( PE_OK == pe_open( roots[i], &f ) ){
+                parse_dynamic_section( f );
+                pe_close( f );
+            }
+            print_dependencies( e, n );
+        }else{
+            rec_write_deps( out, format, roots[i], e, n );
+        }
+        free( e );
+    }
+    pool_destroy( p );
+    deps_destroy( d );
+}
+
+/* Startup mode.
+ *
+ * Closures are resolved as for --deps, then every distinct object across
+ * all of them is analysed once on the pool.  Only the symbol lookups depend
+ * on the program an object is loaded into, so the per-program costs are a
+ * second, cheaper round of pool tasks, each rendering into its own buffer
+ * for printing in root order.
+ */
+struct startup_job {
+    char const *root;
+    struct startup_obj **objs;          // Global scope in load order
+    size_t n;
+    size_t missing;                     // DT_NEEDED entries not found
+    struct obuf ob;
+};
+
+static void
+startup_analyse_task( void *arg ){
+    int rc = startup_analyse( arg );
+
+    if( PE_OK != rc ){
+        fprintf(stderr, "%s:%s:%d %s: %s.\n",
+            __FILE__, __func__, __LINE__, startup_path( arg ), pe_strerror( rc ));
+    }
+}
+
+void
+print_startup( struct startup_job const *job, struct startup_cost const *per,
+        struct startup_cost const *total ){
+    static char const *const cols[] = { "relative", "irelative", "symbolic", "probes",
+        "unresolved", "plt_lazy", "init", "preinit", "pages" };
+    char const *interp = startup_interp( job->objs[0] );
+
+    ob_printf(out, "Startup cost\n");
+    ob_printf(out, "\tInterpreter = %s, Objects = %#zx, Missing = %#zx\n\n",
+            interp ? interp : "none", job->n, job->missing);
+    for( size_t c = 0; c < sizeof( cols ) / sizeof( cols[0] ); c++ ){
+        ob_str( out, cols[c], 12 );
+        ob_putc( out, ' ' );
+    }
+    ob_puts( out, "object\n" );
+    for( size_t c = 0; c < sizeof( cols ) / sizeof( cols[0] ); c++ ){
+        ob_puts( out, "============ " );
+    }
+    ob_puts( out, "======\n" );
+    for( size_t i = 0; i <= job->n; i++ ){
+        struct startup_cost const *c = i < job->n ? &per[i] : total;
+        uint64_t const v[] = { c->relative, c->irelative, c->symbolic, c->probes,
+            c->unresolved, c->plt_lazy, c->init, c->preinit, c->pages };
+
+        for( size_t k = 0; k < sizeof( v ) / sizeof( v[0] ); k++ ){
+            ob_hex( out, v[k], 12, false );
+            ob_putc( out, ' ' );
+        }
+        ob_puts( out, i < job->n ? startup_path( job->objs[i] ) : "(total)" );
+        ob_putc( out, '\n' );
+    }
+    ob_printf(out, "\n\n");
+}
+
+static void
+startup_cost_task( void *arg ){
+    struct startup_job *job = arg;
+    struct startup_cost *per = malloc( job->n * sizeof( struct startup_cost ) );
+    struct startup_cost total;
+
+    assert( NULL != per );
+    startup_cost( job->objs, job->n, per, &total );
+    ob_init_mem( &job->ob );
+    out = &job->ob;
+    if( REC_TEXT == format ){
+        ob_printf(out, "File: %s\n\n", job->root);
+        print_startup( job, per, &total );
+    }else{
+        rec_write_startup( out, format, job->root, job->objs, job->n, per, &total );
+    }
+    free( per );
+}
+
+void
+parse_startup(){
+    struct pool *p = pool_create( njobs );
+    struct deps *d = load_roots( p );
+    struct startup *su = startup_create();
+    struct startup_obj *const *objs;
+    struct startup_job *jobs;
+    char const *const *roots;
+    size_t nroots, nobjs;
+
+    roots = deps_roots( d, &nroots, recursive );
+    jobs = calloc( nroots, sizeof( struct startup_job ) );
+    assert( NULL != jobs );
+    for( size_t i = 0; i < nroots; i++ ){
+        struct deps_entry *e;
+        size_t n;
+        int rc = deps_closure( d, roots[i], &e, &n );
+
+        if( PE_OK != rc ){
+            closure_error( roots[i], rc );
+            continue;
+        }
+        jobs[i].root = roots[i];
+        jobs[i].objs = malloc( ( n + 1 ) * sizeof( struct startup_obj * ) );
+        assert( NULL != jobs[i].objs );
+        jobs[i].objs[ jobs[i].n++ ] = startup_object( su, roots[i] );
+        for( size_t k = 0; k < n; k++ ){
+            if( e[k].path ){
+                jobs[i].objs[ jobs[i].n++ ] = startup_object( su, e[k].path );
+            }else{
+                jobs[i].missing++;
+            }
+        }
+        free( e );
+    }
+
+    objs = startup_objects( su, &nobjs );
+    for( size_t i = 0; i < nobjs; i++ ){
+        pool_submit( p, startup_analyse_task, objs[i] );
+    }
+    pool_wait( p );
+    for( size_t i = 0; i < nroots; i++ ){
+        if( jobs[i].root ){
+            pool_submit( p, startup_cost_task, &jobs[i] );
+        }
+    }
+    pool_wait( p );
+
+    for( size_t i = 0; i < nroots; i++ ){
+        if( jobs[i].root ){
+            ob_write( &stdout_ob, jobs[i].ob.buf, jobs[i].ob.len );
+            ob_free( &jobs[i].ob );
+            free( jobs[i].objs );
+        }
+    }
+    free( jobs );
+    pool_destroy( p );
+    startup_destroy( su );
+    deps_destroy( d );
 }
 
 int
 main( [[maybe_unused]] int argc, [[maybe_unused]] char **argv ){
+    struct io_sample io_start;
+    bool ok = true;
+
     parse_options( argc, argv );
-    map_file();
-    parse_elf_header();
-    parse_program_headers();
-    parse_section_headers();
-    parse_string_tables();
-    cleanup();
-    return 0;
+    if( -1 != io ){
+        io_sample( &io_start );
+    }
+    ob_init_fd( &stdout_ob, STDOUT_FILENO );
+    rec_write_stream_header( &stdout_ob, format );
+    if( startup ){
+        parse_startup();
+    }else if( dependencies ){
+        parse_deps();
+    }else if( recursive ){
+        parse_recursive();
+    }else if( 1 == nfilenames ){
+        out = &stdout_ob;
+        ok = parse_file( filenames[0] );
+    }else{
+        ok = parse_batch();
+    }
+    ob_free( &stdout_ob );
+    if( -1 != io ){
+        io_report( &io_start );
+    }
+    stats_report();
+    return ok ? 0 : -1;
 }
-
-
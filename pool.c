@@ -0,0 +1,253 @@
+/* pool.c
+ *
+ * Work-stealing thread pool, see pool.h.
+ *
+ * Each deque is a growable ring buffer guarded by its own mutex.  The owner
+ * pushes and pops at the bottom, thieves and the injection queue take from
+ * the top.  A single idle lock/condition pair parks workers when there is
+ * nothing anywhere to run; the "queued" counter is only ever compared
+ * against zero under that lock, which is what keeps wakeups from getting
+ * lost.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>     // calloc(3), free(3)
+#include <assert.h>     // assert(3)
+#include <pthread.h>    // pthread_create(3) and friends
+#include <stdatomic.h>  // atomic_long
+#include <stdbool.h>    // bool, true, false
+#include "pool.h"
+
+struct task {
+    pool_fn fn;
+    void *arg;
+};
+
+struct deque {
+    pthread_mutex_t lock;
+    struct task *buf;
+    size_t cap;         // Always a power of two.
+    size_t top;         // Index of the oldest task.
+    size_t bottom;      // One past the newest task.
+};
+
+struct worker {
+    struct pool *p;
+    pthread_t thread;
+    unsigned id;
+    struct deque q;
+};
+
+struct pool {
+    unsigned nthreads;
+    struct worker *workers;
+    struct deque inject;            // Tasks submitted from outside the pool.
+
+    pthread_mutex_t idle_lock;
+    pthread_cond_t  work_cv;        // Signalled when a task is queued.
+    pthread_cond_t  done_cv;        // Signalled when pending drops to zero.
+    unsigned sleepers;
+    bool shutdown;
+
+    atomic_long queued;             // Tasks sitting in some deque.
+    atomic_long pending;            // Tasks submitted but not yet finished.
+};
+
+static _Thread_local int worker_id = -1;
+static _Thread_local struct pool *worker_pool;
+
+static void
+deque_init( struct deque *d ){
+    pthread_mutex_init( &d->lock, NULL );
+    d->cap = 64;
+    d->buf = calloc( d->cap, sizeof( struct task ) );
+    assert( NULL != d->buf );
+    d->top = d->bottom = 0;
+}
+
+static void
+deque_fini( struct deque *d ){
+    pthread_mutex_destroy( &d->lock );
+    free( d->buf );
+}
+
+static void
+deque_push_bottom( struct deque *d, struct task t ){
+    pthread_mutex_lock( &d->lock );
+    if( d->bottom - d->top == d->cap ){
+        // Full: unroll the ring into a buffer twice the size.
+        struct task *nbuf = calloc( d->cap * 2, sizeof( struct task ) );
+        assert( NULL != nbuf );
+        for( size_t i = d->top; i != d->bottom; i++ ){
+            nbuf[ i & (d->cap * 2 - 1) ] = d->buf[ i & (d->cap - 1) ];
+        }
+        free( d->buf );
+        d->buf = nbuf;
+        d->cap *= 2;
+    }
+    d->buf[ d->bottom++ & (d->cap - 1) ] = t;
+    pthread_mutex_unlock( &d->lock );
+}
+
+static bool
+deque_pop_bottom( struct deque *d, struct task *t ){
+    bool found = false;
+    pthread_mutex_lock( &d->lock );
+    if( d->bottom != d->top ){
+        *t = d->buf[ --d->bottom & (d->cap - 1) ];
+        found = true;
+    }
+    pthread_mutex_unlock( &d->lock );
+    return found;
+}
+
+static bool
+deque_pop_top( struct deque *d, struct task *t ){
+    bool found = false;
+    pthread_mutex_lock( &d->lock );
+    if( d->bottom != d->top ){
+        *t = d->buf[ d->top++ & (d->cap - 1) ];
+        found = true;
+    }
+    pthread_mutex_unlock( &d->lock );
+    return found;
+}
+
+static bool
+find_task( struct worker *w, struct task *t ){
+    struct pool *p = w->p;
+
+    // 1. Our own most recently pushed task (still hot in cache).
+    if( deque_pop_bottom( &w->q, t ) ){
+        return true;
+    }
+    // 2. Work submitted from outside the pool, in submission order.
+    if( deque_pop_top( &p->inject, t ) ){
+        return true;
+    }
+    // 3. The oldest task of some other worker.
+    for( unsigned i = 1; i < p->nthreads; i++ ){
+        struct worker *victim = &p->workers[ (w->id + i) % p->nthreads ];
+        if( deque_pop_top( &victim->q, t ) ){
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *
+worker_main( void *arg ){
+    struct worker *w = arg;
+    struct pool *p = w->p;
+    struct task t;
+
+    worker_id = (int)w->id;
+    worker_pool = p;
+
+    while(1){
+        if( find_task( w, &t ) ){
+            atomic_fetch_sub( &p->queued, 1 );
+            t.fn( t.arg );
+            if( 1 == atomic_fetch_sub( &p->pending, 1 ) ){
+                pthread_mutex_lock( &p->idle_lock );
+                pthread_cond_broadcast( &p->done_cv );
+                pthread_mutex_unlock( &p->idle_lock );
+            }
+            continue;
+        }
+        pthread_mutex_lock( &p->idle_lock );
+        while( atomic_load( &p->queued ) <= 0 && !p->shutdown ){
+            p->sleepers++;
+            pthread_cond_wait( &p->work_cv, &p->idle_lock );
+            p->sleepers--;
+        }
+        if( p->shutdown && atomic_load( &p->queued ) <= 0 ){
+            pthread_mutex_unlock( &p->idle_lock );
+            break;
+        }
+        pthread_mutex_unlock( &p->idle_lock );
+    }
+    return NULL;
+}
+
+struct pool *
+pool_create( unsigned nthreads ){
+    struct pool *p = calloc( 1, sizeof( struct pool ) );
+    assert( NULL != p );
+
+    p->nthreads = nthreads ? nthreads : 1;
+    p->workers = calloc( p->nthreads, sizeof( struct worker ) );
+    assert( NULL != p->workers );
+    deque_init( &p->inject );
+    pthread_mutex_init( &p->idle_lock, NULL );
+    pthread_cond_init( &p->work_cv, NULL );
+    pthread_cond_init( &p->done_cv, NULL );
+    atomic_init( &p->queued, 0 );
+    atomic_init( &p->pending, 0 );
+
+    // Every deque must exist before any worker starts stealing.
+    for( unsigned i = 0; i < p->nthreads; i++ ){
+        p->workers[i].p = p;
+        p->workers[i].id = i;
+        deque_init( &p->workers[i].q );
+    }
+    for( unsigned i = 0; i < p->nthreads; i++ ){
+        int rc = pthread_create( &p->workers[i].thread, NULL, worker_main, &p->workers[i] );
+        assert( 0 == rc );
+    }
+    return p;
+}
+
+void
+pool_submit( struct pool *p, pool_fn fn, void *arg ){
+    struct task t = { .fn = fn, .arg = arg };
+
+    atomic_fetch_add( &p->pending, 1 );
+    if( worker_pool == p ){
+        deque_push_bottom( &p->workers[ worker_id ].q, t );
+    }else{
+        deque_push_bottom( &p->inject, t );
+    }
+    atomic_fetch_add( &p->queued, 1 );
+
+    pthread_mutex_lock( &p->idle_lock );
+    if( p->sleepers ){
+        pthread_cond_signal( &p->work_cv );
+    }
+    pthread_mutex_unlock( &p->idle_lock );
+}
+
+void
+pool_wait( struct pool *p ){
+    pthread_mutex_lock( &p->idle_lock );
+    while( atomic_load( &p->pending ) > 0 ){
+        pthread_cond_wait( &p->done_cv, &p->idle_lock );
+    }
+    pthread_mutex_unlock( &p->idle_lock );
+}
+
+void
+pool_destroy( struct pool *p ){
+    pool_wait( p );
+
+    pthread_mutex_lock( &p->idle_lock );
+    p->shutdown = true;
+    pthread_cond_broadcast( &p->work_cv );
+    pthread_mutex_unlock( &p->idle_lock );
+
+    for( unsigned i = 0; i < p->nthreads; i++ ){
+        pthread_join( p->workers[i].thread, NULL );
+        deque_fini( &p->workers[i].q );
+    }
+    deque_fini( &p->inject );
+    pthread_cond_destroy( &p->done_cv );
+    pthread_cond_destroy( &p->work_cv );
+    pthread_mutex_destroy( &p->idle_lock );
+    free( p->workers );
+    free( p );
+}
+
+int
+pool_worker_id( void ){
+    return worker_id;
+}
@@ -0,0 +1,33 @@
+/* pool.h
+ *
+ * A small work-stealing thread pool.  Each worker owns a deque of tasks;
+ * tasks submitted from inside a worker go to the bottom of that worker's
+ * deque and are popped LIFO, idle workers steal FIFO from the top of other
+ * deques.  Tasks submitted from outside the pool go to a shared injection
+ * queue and are picked up in submission order.
+ */
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>     // size_t
+
+struct pool;
+typedef void (*pool_fn)( void *arg );
+
+// Start a pool of nthreads workers (at least one).
+struct pool *pool_create( unsigned nthreads );
+
+// Queue fn(arg).  Safe to call from any thread, including from inside a task.
+void pool_submit( struct pool *p, pool_fn fn, void *arg );
+
+// Block until every submitted task, including tasks submitted by tasks,
+// has finished.
+void pool_wait( struct pool *p );
+
+// Wait for outstanding work, then join and free the workers.
+void pool_destroy( struct pool *p );
+
+// Index of the calling worker in [0, nthreads), or -1 outside the pool.
+int pool_worker_id( void );
+
+#endif // POOL_H
@@ -0,0 +1,624 @@
+/* records.c
+ *
+ * Machine-readable output, see records.h.
+ */
+
+#include <stdlib.h>     // free(3)
+#include <string.h>     // strcmp(3), strlen(3)
+#include <stdbool.h>    // bool
+#include "records.h"
+#include "strtab.h"
+
+enum field_kind { F_U64, F_STR };
+
+struct field {
+    char const *name;
+    enum field_kind kind;
+};
+
+struct schema {
+    char const *name;
+    size_t nfields;
+    struct field const *fields;
+};
+
+struct rec_val {
+    uint64_t u;
+    char const *s;
+    size_t len;
+};
+
+#define SCHEMA( name, fields ) { name, sizeof( fields ) / sizeof( fields[0] ), fields }
+
+static struct field const file_fields[] = {
+    { "path", F_STR },
+};
+
+static struct field const ehdr_fields[] = {
+    { "class", F_U64 },         { "data", F_U64 },          { "ident_version", F_U64 },
+    { "osabi", F_U64 },         { "abiversion", F_U64 },    { "type", F_U64 },
+    { "machine", F_U64 },       { "version", F_U64 },       { "entry", F_U64 },
+    { "phoff", F_U64 },         { "shoff", F_U64 },         { "flags", F_U64 },
+    { "ehsize", F_U64 },        { "phentsize", F_U64 },     { "phnum", F_U64 },
+    { "shentsize", F_U64 },     { "shnum", F_U64 },         { "shstrndx", F_U64 },
+};
+
+static struct field const phdr_fields[] = {
+    { "index", F_U64 },         { "hdr_offset", F_U64 },    { "type", F_U64 },
+    { "flags", F_U64 },         { "offset", F_U64 },        { "vaddr", F_U64 },
+    { "paddr", F_U64 },         { "filesz", F_U64 },        { "memsz", F_U64 },
+    { "align", F_U64 },
+};
+
+static struct field const shdr_fields[] = {
+    { "index", F_U64 },         { "hdr_offset", F_U64 },    { "name", F_U64 },
+    { "name_str", F_STR },      { "type", F_U64 },          { "flags", F_U64 },
+    { "addr", F_U64 },          { "offset", F_U64 },        { "size", F_U64 },
+    { "link", F_U64 },          { "info", F_U64 },          { "addralign", F_U64 },
+    { "entsize", F_U64 },
+};
+
+static struct field const string_fields[] = {
+    { "section", F_U64 },       { "offset", F_U64 },        { "value", F_STR },
+};
+
+static struct field const symbol_fields[] = {
+    { "table", F_U64 },         { "value", F_U64 },         { "size", F_U64 },
+    { "type", F_U64 },          { "bind", F_U64 },          { "shndx", F_U64 },
+    { "name", F_STR },
+};
+
+static struct field const dynamic_fields[] = {
+    { "index", F_U64 },         { "tag", F_U64 },           { "value", F_U64 },
+    { "string", F_STR },
+};
+
+static struct field const needed_fields[] = {
+    { "name", F_STR },          { "path", F_STR },          { "parent", F_STR },
+};
+
+static struct field const reloc_type_fields[] = {
+    { "section", F_U64 },       { "type", F_U64 },          { "count", F_U64 },
+};
+
+static struct field const reloc_sym_fields[] = {
+    { "section", F_U64 },       { "symbol", F_U64 },        { "name", F_STR },
+    { "count", F_U64 },
+};
+
+static struct field const reloc_fields[] = {
+    { "section", F_U64 },       { "offset", F_U64 },        { "type", F_U64 },
+    { "symbol", F_U64 },        { "addend", F_U64 },
+};
+
+static struct field const startup_fields[] = {
+    { "object", F_STR },        { "relative", F_U64 },      { "irelative", F_U64 },
+    { "symbolic", F_U64 },      { "probes", F_U64 },        { "unresolved", F_U64 },
+    { "plt_lazy", F_U64 },      { "init", F_U64 },          { "preinit", F_U64 },
+    { "pages", F_U64 },
+};
+
+static struct field const huge_page_fields[] = {
+    { "index", F_U64 },         { "offset_aligned", F_U64 }, { "vaddr_aligned", F_U64 },
+    { "congruent", F_U64 },     { "base_aligned", F_U64 },  { "huge_pages", F_U64 },
+    { "tlb_4k", F_U64 },        { "tlb_2m", F_U64 },        { "tlb_mixed", F_U64 },
+};
+
+static struct field const residency_fields[] = {
+    { "kind", F_STR },          { "index", F_U64 },         { "name", F_STR },
+    { "offset", F_U64 },        { "size", F_U64 },          { "pages", F_U64 },
+    { "resident", F_U64 },      { "resident_after", F_U64 },
+};
+
+static struct field const stats_fields[] = {
+    { "phase", F_STR },         { "wall_ns", F_U64 },       { "cpu_ns", F_U64 },
+    { "minflt", F_U64 },        { "majflt", F_U64 },        { "cycles", F_U64 },
+    { "instructions", F_U64 },  { "cache_misses", F_U64 },
+};
+
+static struct schema const schemas[REC_NSCHEMAS] = {
+    [REC_FILE]   = SCHEMA( "file", file_fields ),
+    [REC_EHDR]   = SCHEMA( "ehdr", ehdr_fields ),
+    [REC_PHDR]   = SCHEMA( "phdr", phdr_fields ),
+    [REC_SHDR]   = SCHEMA( "shdr", shdr_fields ),
+    [REC_STRING] = SCHEMA( "string", string_fields ),
+    [REC_SYMBOL] = SCHEMA( "symbol", symbol_fields ),
+    [REC_DYNAMIC] = SCHEMA( "dynamic", dynamic_fields ),
+    [REC_NEEDED] = SCHEMA( "needed", needed_fields ),
+    [REC_RELOC_TYPE] = SCHEMA( "reloc_type", reloc_type_fields ),
+    [REC_RELOC_SYM] = SCHEMA( "reloc_symbol", reloc_sym_fields ),
+    [REC_RELOC]  = SCHEMA( "reloc", reloc_fields ),
+    [REC_STARTUP] = SCHEMA( "startup", startup_fields ),
+    [REC_HUGE_PAGE] = SCHEMA( "huge_page", huge_page_fields ),
+    [REC_RESIDENCY] = SCHEMA( "residency", residency_fields ),
+    [REC_STATS]  = SCHEMA( "stats", stats_fields ),
+};
+
+struct rec_stream {
+    struct obuf *ob;
+    enum rec_format fmt;
+    unsigned csv_seen;          // Bit per schema whose CSV header is out
+};
+
+void
+rec_json_string( struct obuf *ob, char const *s, size_t len ){
+    static char const hex[] = "0123456789abcdef";
+    size_t run = 0;
+
+    ob_putc( ob, '"' );
+    for( size_t i = 0; i < len; i++ ){
+        unsigned char c = s[i];
+        if( c >= 0x20 && c < 0x7f && c != '"' && c != '\\' ){
+            continue;
+        }
+        // Copy the clean run before this byte in one go, then escape it.
+        ob_write( ob, s + run, i - run );
+        run = i + 1;
+        if( '"' == c || '\\' == c ){
+            ob_putc( ob, '\\' );
+            ob_putc( ob, c );
+        }else{
+            char esc[6] = { '\\', 'u', '0', '0', hex[ c >> 4 ], hex[ c & 0xf ] };
+            ob_write( ob, esc, sizeof( esc ) );
+        }
+    }
+    ob_write( ob, s + run, len - run );
+    ob_putc( ob, '"' );
+}
+
+static void
+csv_string( struct obuf *ob, char const *s, size_t len ){
+    bool quote = false;
+
+    for( size_t i = 0; i < len && !quote; i++ ){
+        quote = ( ',' == s[i] || '"' == s[i] || '\n' == s[i] || '\r' == s[i] );
+    }
+    if( !quote ){
+        ob_write( ob, s, len );
+        return;
+    }
+    ob_putc( ob, '"' );
+    for( size_t i = 0; i < len; i++ ){
+        if( '"' == s[i] ){
+            ob_putc( ob, '"' );
+        }
+        ob_putc( ob, s[i] );
+    }
+    ob_putc( ob, '"' );
+}
+
+static void
+put_le( struct obuf *ob, uint64_t v, size_t nbytes ){
+    ob_reserve( ob, nbytes );
+    for( size_t i = 0; i < nbytes; i++, v >>= 8 ){
+        ob->buf[ ob->len++ ] = (char)( v & 0xff );
+    }
+}
+
+static void
+write_record( struct rec_stream *rs, enum rec_schema_id id, struct rec_val const *v ){
+    struct schema const *sc = &schemas[id];
+    struct obuf *ob = rs->ob;
+
+    switch( rs->fmt ){
+        case REC_NDJSON:
+            ob_puts( ob, "{\"record\":\"" );
+            ob_puts( ob, sc->name );
+            ob_putc( ob, '"' );
+            for( size_t i = 0; i < sc->nfields; i++ ){
+                ob_puts( ob, ",\"" );
+                ob_puts( ob, sc->fields[i].name );
+                ob_puts( ob, "\":" );
+                if( F_U64 == sc->fields[i].kind ){
+                    ob_udec( ob, v[i].u, 0 );
+                }else{
+                    rec_json_string( ob, v[i].s, v[i].len );
+                }
+            }
+            ob_puts( ob, "}\n" );
+            break;
+
+        case REC_CSV:
+            if( !( rs->csv_seen & ( 1u << id ) ) ){
+                rs->csv_seen |= 1u << id;
+                ob_puts( ob, "record" );
+                for( size_t i = 0; i < sc->nfields; i++ ){
+                    ob_putc( ob, ',' );
+                    ob_puts( ob, sc->fields[i].name );
+                }
+                ob_putc( ob, '\n' );
+            }
+            ob_puts( ob, sc->name );
+            for( size_t i = 0; i < sc->nfields; i++ ){
+                ob_putc( ob, ',' );
+                if( F_U64 == sc->fields[i].kind ){
+                    ob_udec( ob, v[i].u, 0 );
+                }else{
+                    csv_string( ob, v[i].s, v[i].len );
+                }
+            }
+            ob_putc( ob, '\n' );
+            break;
+
+        case REC_BINARY: {
+            size_t payload = 0;
+            for( size_t i = 0; i < sc->nfields; i++ ){
+                payload += F_U64 == sc->fields[i].kind ? 8 : 4 + v[i].len;
+            }
+            put_le( ob, id, 2 );
+            put_le( ob, sc->nfields, 2 );
+            put_le( ob, payload, 4 );
+            for( size_t i = 0; i < sc->nfields; i++ ){
+                if( F_U64 == sc->fields[i].kind ){
+                    put_le( ob, v[i].u, 8 );
+                }else{
+                    put_le( ob, v[i].len, 4 );
+                    ob_write( ob, v[i].s, v[i].len );
+                }
+            }
+            break;
+        }
+
+        case REC_TEXT:
+            break;
+    }
+}
+
+int
+rec_format_parse( char const *name ){
+    return 0 == strcmp( name, "text" )   ? REC_TEXT :
+           0 == strcmp( name, "ndjson" ) ? REC_NDJSON :
+           0 == strcmp( name, "csv" )    ? REC_CSV :
+           0 == strcmp( name, "binary" ) ? REC_BINARY :
+           -1;
+}
+
+void
+rec_write_stream_header( struct obuf *ob, enum rec_format fmt ){
+    if( REC_BINARY == fmt ){
+        ob_write( ob, RECORDS_BIN_MAGIC, RECORDS_BIN_MAGIC_SZ );
+    }
+}
+
+static void
+write_strings( struct rec_stream *rs, struct pe_file const *f, size_t shndx, Elf64_Shdr const *sh ){
+    unsigned char const *tab;
+    size_t len, count;
+    uint32_t *starts;
+
+    if( PE_OK != pe_section_data( f, sh, &tab, &len ) ){
+        return;
+    }
+    starts = strtab_index( tab, len, &count );
+    for( size_t i = 0; i < count; i++ ){
+        size_t end = i + 1 < count ? starts[i+1] - 1 :
+                     0 == tab[ len - 1 ] ? len - 1 : len;
+        struct rec_val v[] = {
+            { .u = shndx },
+            { .u = sh->sh_offset + starts[i] },
+            { .s = (char const *)tab + starts[i], .len = end - starts[i] },
+        };
+        write_record( rs, REC_STRING, v );
+    }
+    free( starts );
+}
+
+void
+rec_write_file( struct obuf *ob, enum rec_format fmt, struct pe_file const *f ){
+    struct rec_stream rs = { .ob = ob, .fmt = fmt };
+    Elf64_Ehdr const *e = pe_ehdr( f );
+    char const *path = pe_path( f );
+    Elf64_Dyn const *dyn;
+    size_t ndyn, strsz;
+    unsigned char const *strtab;
+
+    write_record( &rs, REC_FILE, (struct rec_val[]){ { .s = path, .len = strlen( path ) } } );
+
+    write_record( &rs, REC_EHDR, (struct rec_val[]){
+            { .u = e->e_ident[EI_CLASS] },  { .u = e->e_ident[EI_DATA] },
+            { .u = e->e_ident[EI_VERSION] },{ .u = e->e_ident[EI_OSABI] },
+            { .u = e->e_ident[EI_ABIVERSION] },
+            { .u = e->e_type },             { .u = e->e_machine },
+            { .u = e->e_version },          { .u = e->e_entry },
+            { .u = e->e_phoff },            { .u = e->e_shoff },
+            { .u = e->e_flags },            { .u = e->e_ehsize },
+            { .u = e->e_phentsize },        { .u = e->e_phnum },
+            { .u = e->e_shentsize },        { .u = e->e_shnum },
+            { .u = e->e_shstrndx } } );
+
+    for( size_t i = 0; i < pe_phnum( f ); i++ ){
+        Elf64_Phdr const *ph = pe_phdr( f, i );
+        write_record( &rs, REC_PHDR, (struct rec_val[]){
+                { .u = i },             { .u = pe_phdr_offset( f, i ) },
+                { .u = ph->p_type },    { .u = ph->p_flags },
+                { .u = ph->p_offset },  { .u = ph->p_vaddr },
+                { .u = ph->p_paddr },   { .u = ph->p_filesz },
+                { .u = ph->p_memsz },   { .u = ph->p_align } } );
+    }
+
+    if( PE_OK == pe_dynamic( f, &dyn, &ndyn ) ){
+        pe_dynamic_strtab( f, &strtab, &strsz );
+        for( size_t i = 0; i < ndyn; i++ ){
+            char const *str = pe_dtag_is_string( dyn[i].d_tag ) ?
+                    pe_string( strtab, strsz, dyn[i].d_un.d_val ) : NULL;
+            write_record( &rs, REC_DYNAMIC, (struct rec_val[]){
+                    { .u = i },                 { .u = dyn[i].d_tag },
+                    { .u = dyn[i].d_un.d_val },
+                    { .s = str ? str : "", .len = str ? strlen( str ) : 0 } } );
+        }
+    }
+
+    for( size_t i = 0; i < pe_shnum( f ); i++ ){
+        Elf64_Shdr const *sh = pe_shdr( f, i );
+        char const *name = pe_section_name( f, sh );
+        write_record( &rs, REC_SHDR, (struct rec_val[]){
+                { .u = i },                 { .u = pe_shdr_offset( f, i ) },
+                { .u = sh->sh_name },
+                { .s = name ? name : "", .len = name ? strlen( name ) : 0 },
+                { .u = sh->sh_type },
+                { .u = sh->sh_flags },      { .u = sh->sh_addr },
+                { .u = sh->sh_offset },     { .u = sh->sh_size },
+                { .u = sh->sh_link },       { .u = sh->sh_info },
+                { .u = sh->sh_addralign },  { .u = sh->sh_entsize } } );
+    }
+
+    for( size_t i = 0; i < pe_shnum( f ); i++ ){
+        Elf64_Shdr const *sh = pe_shdr( f, i );
+        if( SHT_STRTAB == sh->sh_type ){
+            write_strings( &rs, f, i, sh );
+        }
+    }
+}
+
+void
+rec_write_symbols( struct obuf *ob, enum rec_format fmt, struct pe_file const *f ){
+    static uint32_t const tables[] = { SHT_SYMTAB, SHT_DYNSYM };
+    struct rec_stream rs = { .ob = ob, .fmt = fmt };
+    struct pe_symtab *st;
+    struct pe_sym sym;
+
+    for( size_t t = 0; t < sizeof( tables ) / sizeof( tables[0] ); t++ ){
+        if( PE_OK != pe_symtab_build( f, tables[t], &st ) ){
+            continue;
+        }
+        for( size_t i = 0; i < pe_symtab_count( st ); i++ ){
+            char const *name = pe_symtab_name( st, i );
+            pe_symtab_get( st, i, &sym );
+            write_record( &rs, REC_SYMBOL, (struct rec_val[]){
+                    { .u = tables[t] },
+                    { .u = sym.value },     { .u = sym.size },
+                    { .u = ELF64_ST_TYPE( sym.info ) },
+                    { .u = ELF64_ST_BIND( sym.info ) },
+                    { .u = sym.shndx },
+                    { .s = name ? name : "", .len = name ? strlen( name ) : 0 } } );
+        }
+        pe_symtab_free( st );
+    }
+}
+
+void
+rec_write_lookup( struct obuf *ob, enum rec_format fmt, struct pe_file const *f,
+        char const *name, Elf64_Sym const *sym ){
+    struct rec_stream rs = { .ob = ob, .fmt = fmt };
+    char const *path = pe_path( f );
+
+    write_record( &rs, REC_FILE, (struct rec_val[]){ { .s = path, .len = strlen( path ) } } );
+    write_record( &rs, REC_SYMBOL, (struct rec_val[]){
+            { .u = SHT_DYNSYM },
+            { .u = sym->st_value },     { .u = sym->st_size },
+            { .u = ELF64_ST_TYPE( sym->st_info ) },
+            { .u = ELF64_ST_BIND( sym->st_info ) },
+            { .u = sym->st_shndx },
+            { .s = name, .len = strlen( name ) } } );
+}
+
+void
+rec_write_address( struct obuf *ob, enum rec_format fmt, struct pe_file const *f,
+        uint32_t sh_type, char const *name, struct pe_sym const *sym ){
+    struct rec_stream rs = { .ob = ob, .fmt = fmt };
+    char const *path = pe_path( f );
+
+    write_record( &rs, REC_FILE, (struct rec_val[]){ { .s = path, .len = strlen( path ) } } );
+    write_record( &rs, REC_SYMBOL, (struct rec_val[]){
+            { .u = sh_type },
+            { .u = sym->value },        { .u = sym->size },
+            { .u = ELF64_ST_TYPE( sym->info ) },
+            { .u = ELF64_ST_BIND( sym->info ) },
+            { .u = sym->shndx },
+            { .s = name ? name : "", .len = name ? strlen( name ) : 0 } } );
+}
+
+static void
+write_residency( struct rec_stream *rs, char const *kind, uint64_t index, char const *name,
+        uint64_t off, uint64_t len, struct pe_residency const *before,
+        struct pe_residency const *after ){
+    uint64_t pages, resident, resident_after;
+
+    pe_resident_range( before, off, len, &pages, &resident );
+    pe_resident_range( after, off, len, &pages, &resident_after );
+    write_record( rs, REC_RESIDENCY, (struct rec_val[]){
+            { .s = kind, .len = strlen( kind ) },   { .u = index },
+            { .s = name, .len = strlen( name ) },
+            { .u = off },               { .u = len },               { .u = pages },
+            { .u = resident },          { .u = resident_after } } );
+}
+
+void
+rec_write_residency( struct obuf *ob, enum rec_format fmt, struct pe_file const *f,
+        struct pe_residency const *before, struct pe_residency const *after ){
+    struct rec_stream rs = { .ob = ob, .fmt = fmt };
+    char const *path = pe_path( f );
+
+    after = after ? after : before;
+    write_record( &rs, REC_FILE, (struct rec_val[]){ { .s = path, .len = strlen( path ) } } );
+    write_residency( &rs, "file", 0, "", 0, pe_size( f ), before, after );
+    for( size_t i = 0; i < pe_phnum( f ); i++ ){
+        Elf64_Phdr const *ph = pe_phdr( f, i );
+        if( PT_LOAD == ph->p_type ){
+            write_residency( &rs, "segment", i, "", ph->p_offset, ph->p_filesz, before, after );
+        }
+    }
+    for( size_t i = 0; i < pe_shnum( f ); i++ ){
+        Elf64_Shdr const *sh = pe_shdr( f, i );
+        char const *name = pe_section_name( f, sh );
+        if( SHT_NOBITS != sh->sh_type && sh->sh_size ){
+            write_residency( &rs, "section", i, name ? name : "", sh->sh_offset, sh->sh_size,
+                    before, after );
+        }
+    }
+}
+
+void
+rec_write_stats( struct obuf *ob, enum rec_format fmt, char const *path,
+        struct stats_sample const *per_phase, unsigned used ){
+    struct rec_stream rs = { .ob = ob, .fmt = fmt };
+
+    write_record( &rs, REC_FILE, (struct rec_val[]){ { .s = path, .len = strlen( path ) } } );
+    for( unsigned ph = 0; ph < STATS_NPHASES; ph++ ){
+        struct stats_sample const *s = &per_phase[ph];
+        char const *name = stats_phase_name( ph );
+        if( !( used & ( 1u << ph ) ) ){
+            continue;
+        }
+        write_record( &rs, REC_STATS, (struct rec_val[]){
+                { .s = name, .len = strlen( name ) },
+                { .u = s->wall_ns },        { .u = s->cpu_ns },
+                { .u = s->minflt },         { .u = s->majflt },
+                { .u = s->cycles },         { .u = s->instructions },
+                { .u = s->cache_misses } } );
+    }
+}
+
+void
+rec_write_deps( struct obuf *ob, enum rec_format fmt, char const *root,
+        struct deps_entry const *e, size_t n ){
+    struct rec_stream rs = { .ob = ob, .fmt = fmt };
+
+    write_record( &rs, REC_FILE, (struct rec_val[]){ { .s = root, .len = strlen( root ) } } );
+    for( size_t i = 0; i < n; i++ ){
+        char const *path = e[i].path ? e[i].path : "";
+        write_record( &rs, REC_NEEDED, (struct rec_val[]){
+                { .s = e[i].name, .len = strlen( e[i].name ) },
+                { .s = path, .len = strlen( path ) },
+                { .s = e[i].parent, .len = strlen( e[i].parent ) } } );
+    }
+}
+
+void
+rec_write_huge_pages( struct obuf *ob, enum rec_format fmt, struct pe_file const *f ){
+    struct rec_stream rs = { .ob = ob, .fmt = fmt };
+    struct pe_huge hp;
+
+    for( size_t i = 0; i < pe_phnum( f ); i++ ){
+        Elf64_Phdr const *ph = pe_phdr( f, i );
+        if( PT_LOAD != ph->p_type ){
+            continue;
+        }
+        pe_huge_pages( f, ph, &hp );
+        write_record( &rs, REC_HUGE_PAGE, (struct rec_val[]){
+                { .u = i },                 { .u = hp.offset_aligned }, { .u = hp.vaddr_aligned },
+                { .u = hp.congruent },      { .u = hp.base_aligned },   { .u = hp.huge_pages },
+                { .u = hp.tlb_4k },         { .u = hp.tlb_2m },         { .u = hp.tlb_mixed } } );
+    }
+}
+
+static void
+write_startup( struct rec_stream *rs, char const *object, struct startup_cost const *c ){
+    write_record( rs, REC_STARTUP, (struct rec_val[]){
+            { .s = object, .len = strlen( object ) },
+            { .u = c->relative },   { .u = c->irelative },  { .u = c->symbolic },
+            { .u = c->probes },     { .u = c->unresolved }, { .u = c->plt_lazy },
+            { .u = c->init },       { .u = c->preinit },    { .u = c->pages } } );
+}
+
+void
+rec_write_startup( struct obuf *ob, enum rec_format fmt, char const *root,
+        struct startup_obj *const *objs, size_t n,
+        struct startup_cost const *per_obj, struct startup_cost const *total ){
+    struct rec_stream rs = { .ob = ob, .fmt = fmt };
+
+    write_record( &rs, REC_FILE, (struct rec_val[]){ { .s = root, .len = strlen( root ) } } );
+    for( size_t i = 0; i < n; i++ ){
+        write_startup( &rs, startup_path( objs[i] ), &per_obj[i] );
+    }
+    write_startup( &rs, "", total );
+}
+
+static void
+write_relocs( struct rec_stream *rs, struct pe_file const *f, size_t shndx,
+        Elf64_Shdr const *sh, bool list ){
+    static _Thread_local struct pe_reloc_hist h;
+    struct pe_reloc_iter it;
+    Elf64_Shdr const *symsh = pe_shdr( f, sh->sh_link );
+    unsigned char const *syms = NULL, *strs = NULL;
+    size_t syms_len = 0, strs_len = 0, entsize = 0;
+
+    if( PE_OK != pe_reloc_begin( f, sh, &it ) ){
+        return;
+    }
+    memset( &h, 0, sizeof( h ) );
+    if( NULL != symsh && symsh->sh_entsize >= pe_sym_entsize( pe_variant( f ) )
+            && PE_OK == pe_section_data( f, symsh, &syms, &syms_len ) ){
+        entsize = symsh->sh_entsize;
+        h.nsyms = syms_len / entsize;
+        if( NULL != pe_shdr( f, symsh->sh_link ) ){
+            pe_section_data( f, pe_shdr( f, symsh->sh_link ), &strs, &strs_len );
+        }
+    }
+    h.sym_refs = calloc( h.nsyms + 1, sizeof( uint32_t ) );
+    if( NULL == h.sym_refs ){
+        return;
+    }
+    pe_reloc_count( it, &h );
+
+    for( uint32_t t = 0; t < PE_RELOC_NTYPES; t++ ){
+        if( h.by_type[t] ){
+            write_record( rs, REC_RELOC_TYPE, (struct rec_val[]){
+                    { .u = shndx }, { .u = t }, { .u = h.by_type[t] } } );
+        }
+    }
+    if( h.no_symbol ){
+        write_record( rs, REC_RELOC_SYM, (struct rec_val[]){
+                { .u = shndx }, { .u = 0 }, { .s = "", .len = 0 }, { .u = h.no_symbol } } );
+    }
+    for( size_t i = 1; i < h.nsyms; i++ ){
+        if( 0 == h.sym_refs[i] ){
+            continue;
+        }
+        Elf64_Sym sym;
+        pe_sym_read( pe_variant( f ), syms + i * entsize, &sym );
+        char const *name = pe_string( strs, strs_len, sym.st_name );
+        write_record( rs, REC_RELOC_SYM, (struct rec_val[]){
+                { .u = shndx },     { .u = i },
+                { .s = name ? name : "", .len = name ? strlen( name ) : 0 },
+                { .u = h.sym_refs[i] } } );
+    }
+    free( h.sym_refs );
+
+    if( list ){
+        struct pe_reloc r;
+        while( pe_reloc_next( &it, &r ) ){
+            write_record( rs, REC_RELOC, (struct rec_val[]){
+                    { .u = shndx },     { .u = r.offset },  { .u = r.type },
+                    { .u = r.sym },     { .u = (uint64_t)r.addend } } );
+        }
+    }
+}
+
+void
+rec_write_relocs( struct obuf *ob, enum rec_format fmt, struct pe_file const *f, bool list ){
+    struct rec_stream rs = { .ob = ob, .fmt = fmt };
+
+    for( size_t i = 0; i < pe_shnum( f ); i++ ){
+        Elf64_Shdr const *sh = pe_shdr( f, i );
+        unsigned char const *data;
+        size_t len;
+
+        if( SHT_REL == sh->sh_type || SHT_RELA == sh->sh_type ){
+            write_relocs( &rs, f, i, sh, list );
+        }else if( SHT_RELR == sh->sh_type && PE_OK == pe_section_data( f, sh, &data, &len ) ){
+            write_record( &rs, REC_RELOC_TYPE, (struct rec_val[]){
+                    { .u = i }, { .u = RECORDS_RELR_TYPE }, { .u = pe_relr_count( pe_variant( f ), data, len ) } } );
+        }
+    }
+}
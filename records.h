@@ -0,0 +1,133 @@
+/* records.h
+ *
+ * Machine-readable output.  A file is described as a stream of records,
+ * each an instance of one of the schemas below, and every record is written
+ * to the output buffer as soon as it is produced.  Nothing is collected per
+ * file.
+ *
+ * Formats:
+ *
+ *   ndjson  One JSON object per line.  "record" names the schema; the other
+ *           keys are the schema's fields.  Section names that can't be
+ *           resolved are empty strings.  Integers are JSON numbers, and
+ *           bytes outside printable ASCII in strings are written as \u00XX.
+ *
+ *   csv     RFC 4180.  Each schema's header row ("record,<fields...>") is
+ *           written before its first record in a file.
+ *
+ *   binary  Little-endian.  The stream starts with the 8-byte magic
+ *           RECORDS_BIN_MAGIC, then each record is
+ *
+ *               uint16 schema id, uint16 field count, uint32 payload bytes,
+ *               payload
+ *
+ *           where every field in the payload is either a uint64 or a string
+ *           stored as a uint32 length followed by that many bytes (no NUL).
+ *
+ * In every format a "file" record comes first and the records after it
+ * belong to that file, up to the next "file" record.
+ */
+#ifndef RECORDS_H
+#define RECORDS_H
+
+#include <stdint.h>     // uint64_t
+#include <stdbool.h>    // bool
+#include "obuf.h"
+#include "libparse_elf.h"
+#include "deps.h"
+#include "startup.h"
+#include "stats.h"
+
+enum rec_format {
+    REC_TEXT = 0,       // The human-readable tables, not handled here
+    REC_NDJSON,
+    REC_CSV,
+    REC_BINARY,
+};
+
+#define RECORDS_BIN_MAGIC "PEREC\0\1\0"
+#define RECORDS_BIN_MAGIC_SZ (8)
+
+// Schema ids, also used in the binary format.
+enum rec_schema_id {
+    REC_FILE = 0,       // path
+    REC_EHDR,           // ELF header fields
+    REC_PHDR,           // One program header
+    REC_SHDR,           // One section header
+    REC_STRING,         // One string from an SHT_STRTAB section
+    REC_SYMBOL,         // One symbol, in address order (--symbols)
+    REC_DYNAMIC,        // One PT_DYNAMIC entry
+    REC_NEEDED,         // One library in a DT_NEEDED closure (--deps)
+    REC_RELOC_TYPE,     // Relocations of one type in one section (--relocs)
+    REC_RELOC_SYM,      // References to one symbol from one section (--relocs)
+    REC_RELOC,          // One relocation (--reloc-list)
+    REC_STARTUP,        // Startup cost of one object in a program (--startup)
+    REC_HUGE_PAGE,      // Huge-page eligibility of one PT_LOAD (--huge-pages)
+    REC_RESIDENCY,      // Page-cache residency of a file range (--residency)
+    REC_STATS,          // Cost of one phase of one file (--stats)
+    REC_NSCHEMAS
+};
+
+// Parse a --format argument.  Returns -1 if it isn't a known format.
+int rec_format_parse( char const *name );
+
+// Write everything about f to ob in the given (non-text) format.
+void rec_write_file( struct obuf *ob, enum rec_format fmt, struct pe_file const *f );
+
+// Write the address-sorted symbols of f's SHT_SYMTAB and SHT_DYNSYM
+// sections.  "table" is the section type the symbol came from.
+void rec_write_symbols( struct obuf *ob, enum rec_format fmt, struct pe_file const *f );
+
+// Write a "file" record for f followed by a "symbol" record for sym, the
+// result of a successful --lookup of name.
+void rec_write_lookup( struct obuf *ob, enum rec_format fmt, struct pe_file const *f,
+        char const *name, Elf64_Sym const *sym );
+
+// Write a "file" record for f followed by a "symbol" record for sym, the
+// entry of f's sh_type table that an --address lookup landed in.
+void rec_write_address( struct obuf *ob, enum rec_format fmt, struct pe_file const *f,
+        uint32_t sh_type, char const *name, struct pe_sym const *sym );
+
+// Write the huge-page eligibility of every PT_LOAD segment of f, by its
+// program header index (see struct pe_huge).
+void rec_write_huge_pages( struct obuf *ob, enum rec_format fmt, struct pe_file const *f );
+
+// Write per-type and per-symbol relocation counts for every SHT_REL,
+// SHT_RELA and SHT_RELR section of f, and every relocation if list is set.
+// Relocations without a symbol are counted against symbol 0.  An SHT_RELR
+// section, whose entries have no type of their own, reports a single count
+// with type RECORDS_RELR_TYPE.
+#define RECORDS_RELR_TYPE (0xffffffffu)
+void rec_write_relocs( struct obuf *ob, enum rec_format fmt, struct pe_file const *f, bool list );
+
+// Write a "file" record for f followed by "residency" records for the whole
+// file (kind "file"), each PT_LOAD (kind "segment", by program header index)
+// and each section with file contents (kind "section").  resident is from
+// before, resident_after from after, or from before again if after is NULL.
+void rec_write_residency( struct obuf *ob, enum rec_format fmt, struct pe_file const *f,
+        struct pe_residency const *before, struct pe_residency const *after );
+
+// Write a "file" record for root followed by a "needed" record for each
+// entry of its closure.  Libraries that weren't found have an empty path.
+void rec_write_deps( struct obuf *ob, enum rec_format fmt, char const *root,
+        struct deps_entry const *e, size_t n );
+
+// Write a "file" record for root followed by a "startup" record for each
+// object in its global scope, root first, and a final one with an empty
+// object for the total.
+void rec_write_startup( struct obuf *ob, enum rec_format fmt, char const *root,
+        struct startup_obj *const *objs, size_t n,
+        struct startup_cost const *per_obj, struct startup_cost const *total );
+
+// Write a "file" record for path followed by a "stats" record for each
+// phase whose bit is set in used, with its entry of per_phase (see stats.h).
+void rec_write_stats( struct obuf *ob, enum rec_format fmt, char const *path,
+        struct stats_sample const *per_phase, unsigned used );
+
+// Write len bytes of s as a quoted JSON string, escaping what JSON requires.
+void rec_json_string( struct obuf *ob, char const *s, size_t len );
+
+// Anything that has to precede the first file in a stream.
+void rec_write_stream_header( struct obuf *ob, enum rec_format fmt );
+
+#endif // RECORDS_H
@@ -0,0 +1,163 @@
+/* relocs.c
+ *
+ * Relocation decoding, see libparse_elf.h.
+ *
+ * Everything works straight off the mapped table.  Counting is one pass
+ * with no allocation: the type histogram is a fixed array and symbol
+ * reference counts go into an array the caller sized for the symbol table
+ * up front.
+ *
+ * The counting and RELR loops are stamped out once per variant and the
+ * variant is picked once per table.
+ */
+
+#include "libparse_elf.h"
+#include "variant.h"
+
+#define RELOC_NEXT( sfx, id, bits, enc ) \
+static bool \
+next_##sfx( struct pe_reloc_iter *it, struct pe_reloc *r ){ \
+    if( it->p >= it->end ){ \
+        return false; \
+    } \
+    pe_rel_##sfx( it->p, it->rela, r ); \
+    it->p += it->entsize; \
+    return true; \
+}
+
+PE_VARIANTS( RELOC_NEXT )
+
+static bool (*const reloc_next[])( struct pe_reloc_iter *it, struct pe_reloc *r ) = {
+#define RELOC_NEXT_ENTRY( sfx, id, bits, enc ) [id] = next_##sfx,
+    PE_VARIANTS( RELOC_NEXT_ENTRY )
+#undef RELOC_NEXT_ENTRY
+};
+
+int
+pe_reloc_table( enum pe_variant v, unsigned char const *data, size_t len, bool rela,
+        size_t entsize, struct pe_reloc_iter *it ){
+    *it = (struct pe_reloc_iter){ 0 };
+    if( entsize < ( rela ? pe_variant_sizes[v].rela : pe_variant_sizes[v].rel ) ){
+        return PE_ERR_UNSUPPORTED;
+    }
+    it->p = data;
+    it->end = data + len - len % entsize;
+    it->entsize = entsize;
+    it->rela = rela;
+    it->variant = v;
+    it->next = reloc_next[v];
+    return PE_OK;
+}
+
+int
+pe_reloc_begin( struct pe_file const *f, Elf64_Shdr const *sh, struct pe_reloc_iter *it ){
+    unsigned char const *data;
+    size_t len;
+    int rc;
+
+    *it = (struct pe_reloc_iter){ 0 };
+    if( SHT_REL != sh->sh_type && SHT_RELA != sh->sh_type ){
+        return PE_ERR_RANGE;
+    }
+    if( PE_OK != ( rc = pe_section_data( f, sh, &data, &len ) ) ){
+        return rc;
+    }
+    return pe_reloc_table( pe_variant( f ), data, len, SHT_RELA == sh->sh_type, sh->sh_entsize, it );
+}
+
+static inline void
+count_one( struct pe_reloc_hist *h, uint32_t type, uint64_t sym ){
+    h->count++;
+    if( type < PE_RELOC_NTYPES ){
+        h->by_type[type]++;
+    }else{
+        h->other_type++;
+    }
+    if( 0 == sym ){
+        h->no_symbol++;
+    }else if( sym < h->nsyms ){
+        if( h->sym_refs ){
+            h->sym_refs[sym]++;
+        }
+    }else{
+        h->bad_symbol++;
+    }
+}
+
+// Only r_info matters here, so REL and RELA share the loop.
+#define RELOC_COUNT( sfx, id, bits, enc ) \
+static void \
+count_##sfx( struct pe_reloc_iter it, struct pe_reloc_hist *h ){ \
+    uint32_t type; \
+    for( unsigned char const *p = it.p; p < it.end; p += it.entsize ){ \
+        uint64_t sym = pe_rinfo_##sfx( p, &type ); \
+        count_one( h, type, sym ); \
+    } \
+}
+
+PE_VARIANTS( RELOC_COUNT )
+
+void
+pe_reloc_count( struct pe_reloc_iter it, struct pe_reloc_hist *h ){
+    switch( it.variant ){
+#define RELOC_COUNT_CASE( sfx, id, bits, enc ) \
+        case id: count_##sfx( it, h ); break;
+        PE_VARIANTS( RELOC_COUNT_CASE )
+#undef RELOC_COUNT_CASE
+    }
+}
+
+// An even word is an address (one relocation), an odd word a bitmap of one
+// bit fewer than the word has, covering the words after the last address.
+#define RELR( sfx, id, bits, enc ) \
+static uint64_t \
+relr_count_##sfx( unsigned char const *data, size_t len ){ \
+    uint64_t n = 0; \
+    for( size_t off = 0; off + bits / 8 <= len; off += bits / 8 ){ \
+        uint64_t word = pe_word_##sfx( data + off ); \
+        n += ( word & 1 ) ? (uint64_t)__builtin_popcountll( word ) - 1 : 1; \
+    } \
+    return n; \
+} \
+static void \
+relr_foreach_##sfx( unsigned char const *data, size_t len, pe_relr_fn fn, void *arg ){ \
+    uint64_t next = 0; \
+    for( size_t off = 0; off + bits / 8 <= len; off += bits / 8 ){ \
+        uint64_t word = pe_word_##sfx( data + off ); \
+        if( 0 == ( word & 1 ) ){ \
+            fn( word, arg ); \
+            next = word + bits / 8; \
+            continue; \
+        } \
+        /* Bit i of the bitmap covers the word i - 1 words after next. */ \
+        for( unsigned i = 1; i < bits; i++ ){ \
+            if( word & ( 1ull << i ) ){ \
+                fn( next + ( i - 1 ) * ( bits / 8 ), arg ); \
+            } \
+        } \
+        next += ( bits - 1 ) * ( bits / 8 ); \
+    } \
+}
+
+PE_VARIANTS( RELR )
+
+uint64_t
+pe_relr_count( enum pe_variant v, unsigned char const *data, size_t len ){
+    switch( v ){
+#define RELR_COUNT_CASE( sfx, id, bits, enc ) \
+        case id: return relr_count_##sfx( data, len );
+        PE_VARIANTS( RELR_COUNT_CASE )
+#undef RELR_COUNT_CASE
+    }
+    return 0;
+}
+
+void
+pe_relr_foreach( enum pe_variant v, unsigned char const *data, size_t len, pe_relr_fn fn, void *arg ){
+    switch( v ){
+#define RELR_FOREACH_CASE( sfx, id, bits, enc ) \
+        case id: relr_foreach_##sfx( data, len, fn, arg ); break;
+        PE_VARIANTS( RELR_FOREACH_CASE )
+#undef RELR_FOREACH_CASE
+    }
+}
@@ -0,0 +1,96 @@
+/* residency.c
+ *
+ * Page-cache residency and advice, see libparse_elf.h.
+ *
+ * pe_mincore() works from the path rather than an open pe_file because
+ * opening one reads the headers, and the readahead that triggers would
+ * show up as resident pages.  mmap(2) followed by mincore(2) reads nothing.
+ */
+
+#define _DEFAULT_SOURCE     // mincore(2)
+#include <stdlib.h>     // malloc(3), free(3)
+#include <sys/types.h>  // open(2), fstat(2)
+#include <sys/stat.h>   // open(2), fstat(2)
+#include <fcntl.h>      // open(2), posix_fadvise(3)
+#include <unistd.h>     // close(2), sysconf(3)
+#include <sys/mman.h>   // mmap(2), mincore(2), munmap(2)
+#include "libparse_elf.h"
+
+int
+pe_mincore( char const *path, struct pe_residency *r ){
+    struct stat s;
+    void *map;
+    int fd, rc = PE_OK;
+
+    *r = (struct pe_residency){ .page_size = sysconf( _SC_PAGESIZE ) };
+    fd = open( path, O_RDONLY | O_CLOEXEC );
+    if( -1 == fd ){
+        return PE_ERR_OPEN;
+    }
+    if( -1 == fstat( fd, &s ) ){
+        close( fd );
+        return PE_ERR_OPEN;
+    }
+    if( 0 == s.st_size ){
+        close( fd );
+        return PE_OK;
+    }
+    map = mmap( NULL, s.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if( MAP_FAILED == map ){
+        return PE_ERR_MAP;
+    }
+    r->npages = ( s.st_size + r->page_size - 1 ) / r->page_size;
+    r->vec = malloc( r->npages );
+    if( NULL == r->vec ){
+        rc = PE_ERR_NOMEM;
+    }else if( -1 == mincore( map, s.st_size, r->vec ) ){
+        free( r->vec );
+        r->vec = NULL;
+        rc = PE_ERR_MAP;
+    }
+    if( PE_OK != rc ){
+        r->npages = 0;
+    }
+    munmap( map, s.st_size );
+    return rc;
+}
+
+void
+pe_residency_free( struct pe_residency *r ){
+    free( r->vec );
+    r->vec = NULL;
+    r->npages = 0;
+}
+
+void
+pe_resident_range( struct pe_residency const *r, uint64_t off, uint64_t len,
+        uint64_t *pages, uint64_t *resident ){
+    uint64_t first = off / r->page_size;
+    uint64_t end = len ? ( off + len - 1 ) / r->page_size + 1 : first;
+
+    *pages = *resident = 0;
+    if( off + len < off || end > r->npages ){
+        end = r->npages;            // Clipped to the file
+    }
+    for( uint64_t i = first; i < end; i++ ){
+        ++*pages;
+        *resident += r->vec[i] & 1;
+    }
+}
+
+int
+pe_advise( char const *path, uint64_t off, uint64_t len, enum pe_advice advice ){
+    int fd = open( path, O_RDONLY | O_CLOEXEC );
+    int rc;
+
+    if( -1 == fd ){
+        return PE_ERR_OPEN;
+    }
+    // posix_fadvise() rather than madvise() so that eviction reaches the
+    // page cache and not just this process's mapping.
+    rc = posix_fadvise( fd, off, len,
+            PE_ADVISE_PREFETCH == advice ? POSIX_FADV_WILLNEED : POSIX_FADV_DONTNEED );
+    close( fd );
+    return 0 == rc ? PE_OK : PE_ERR_RANGE;
+}
@@ -0,0 +1,385 @@
+/* startup.c
+ *
+ * Loader startup-cost estimate, see startup.h.
+ *
+ * Each object is opened once and reduced to its own counts plus the list
+ * of symbols it needs looked up, with how many relocations want each.  The
+ * file stays mapped so that other programs' scope walks can ask its hash
+ * table whether it defines a symbol.  Only the probe counts depend on the
+ * program an object is loaded into.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>     // malloc(3), calloc(3), realloc(3), free(3)
+#include <string.h>     // memset(3), strcmp(3), strdup(3)
+#include <stdbool.h>    // bool
+#include <assert.h>     // assert(3)
+#include "startup.h"
+#include "libparse_elf.h"
+
+#define STARTUP_PAGE_SZ (4096)
+
+struct startup_obj {
+    char *path;
+    struct pe_file *f;              // Kept open for scope lookups
+    bool has_hash;
+    struct pe_dynhash hash;
+    bool symbolic;                  // DT_SYMBOLIC: own definitions first
+    char const *interp;
+
+    struct startup_cost own;        // All but probes and unresolved
+    size_t nrefs;                   // Distinct symbols looked up at startup
+    char const **ref_names;
+    uint32_t *ref_counts;
+};
+
+struct startup {
+    struct startup_obj **objs;
+    size_t nobjs, cap;
+    uint32_t *slots;                // Index + 1 by path hash, 0 = empty
+    size_t mask;
+};
+
+// Pages written by relocation, inside the span of the PT_LOAD segments.
+// The span comes from the file and can be anything, so pages are kept as a
+// list, sorted and deduplicated when counted, rather than a bitmap over the
+// span.  Relocation tables run in address order, so dropping repeats of the
+// last page keeps the list near the number of distinct pages.
+struct pages {
+    uint64_t lo, hi;                // First and last page of the span
+    uint64_t *v;
+    size_t n, cap;
+    int rc;                         // PE_ERR_NOMEM once an append failed
+};
+
+// FNV-1a
+static uint64_t
+hash_str( char const *s ){
+    uint64_t h = 14695981039346656037ull;
+    for( ; *s; s++ ){
+        h = ( h ^ (unsigned char)*s ) * 1099511628211ull;
+    }
+    return h;
+}
+
+struct startup *
+startup_create( void ){
+    struct startup *s = calloc( 1, sizeof( struct startup ) );
+
+    assert( NULL != s );
+    s->mask = 1023;
+    s->slots = calloc( s->mask + 1, sizeof( uint32_t ) );
+    assert( NULL != s->slots );
+    return s;
+}
+
+void
+startup_destroy( struct startup *s ){
+    for( size_t i = 0; i < s->nobjs; i++ ){
+        struct startup_obj *o = s->objs[i];
+        pe_close( o->f );
+        free( o->ref_names );
+        free( o->ref_counts );
+        free( o->path );
+        free( o );
+    }
+    free( s->objs );
+    free( s->slots );
+    free( s );
+}
+
+static uint32_t *
+slot_find( struct startup *s, char const *path ){
+    for( size_t j = hash_str( path ) & s->mask; ; j = ( j + 1 ) & s->mask ){
+        if( 0 == s->slots[j] || 0 == strcmp( s->objs[ s->slots[j] - 1 ]->path, path ) ){
+            return &s->slots[j];
+        }
+    }
+}
+
+struct startup_obj *
+startup_object( struct startup *s, char const *path ){
+    uint32_t *slot = slot_find( s, path );
+    struct startup_obj *o;
+
+    if( *slot ){
+        return s->objs[ *slot - 1 ];
+    }
+    if( 2 * ( s->nobjs + 1 ) > s->mask + 1 ){
+        free( s->slots );
+        s->mask = 2 * s->mask + 1;
+        s->slots = calloc( s->mask + 1, sizeof( uint32_t ) );
+        assert( NULL != s->slots );
+        for( size_t i = 0; i < s->nobjs; i++ ){
+            *slot_find( s, s->objs[i]->path ) = i + 1;
+        }
+        slot = slot_find( s, path );
+    }
+    if( s->nobjs == s->cap ){
+        s->cap = s->cap ? 2 * s->cap : 64;
+        s->objs = realloc( s->objs, s->cap * sizeof( struct startup_obj * ) );
+        assert( NULL != s->objs );
+    }
+    o = calloc( 1, sizeof( struct startup_obj ) );
+    assert( NULL != o );
+    o->path = strdup( path );
+    assert( NULL != o->path );
+    s->objs[ s->nobjs++ ] = o;
+    *slot = s->nobjs;
+    return o;
+}
+
+struct startup_obj *const *
+startup_objects( struct startup *s, size_t *n ){
+    *n = s->nobjs;
+    return s->objs;
+}
+
+char const *
+startup_path( struct startup_obj const *o ){
+    return o->path;
+}
+
+char const *
+startup_interp( struct startup_obj const *o ){
+    return o->interp;
+}
+
+static void
+pages_init( struct pages *pg, struct pe_file const *f ){
+    uint64_t lo = UINT64_MAX, hi = 0;
+
+    for( size_t i = 0; i < pe_phnum( f ); i++ ){
+        Elf64_Phdr const *ph = pe_phdr( f, i );
+        if( PT_LOAD == ph->p_type && ph->p_memsz && ph->p_vaddr + ph->p_memsz > ph->p_vaddr ){
+            lo = ph->p_vaddr < lo ? ph->p_vaddr : lo;
+            hi = ph->p_vaddr + ph->p_memsz > hi ? ph->p_vaddr + ph->p_memsz : hi;
+        }
+    }
+    *pg = (struct pages){ .lo = 1, .hi = 0 };
+    if( lo < hi ){
+        pg->lo = lo / STARTUP_PAGE_SZ;
+        pg->hi = ( hi - 1 ) / STARTUP_PAGE_SZ;
+    }
+}
+
+static void
+pages_mark( uint64_t addr, void *arg ){
+    struct pages *pg = arg;
+    uint64_t page = addr / STARTUP_PAGE_SZ;
+
+    if( page < pg->lo || page > pg->hi || ( pg->n && pg->v[ pg->n - 1 ] == page ) || pg->rc ){
+        return;
+    }
+    if( pg->n == pg->cap ){
+        size_t cap = pg->cap ? 2 * pg->cap : 256;
+        uint64_t *v = realloc( pg->v, cap * sizeof( uint64_t ) );
+        if( NULL == v ){
+            pg->rc = PE_ERR_NOMEM;
+            return;
+        }
+        pg->v = v;
+        pg->cap = cap;
+    }
+    pg->v[ pg->n++ ] = page;
+}
+
+static int
+cmp_u64( void const *a, void const *b ){
+    uint64_t x = *(uint64_t const *)a, y = *(uint64_t const *)b;
+    return ( x > y ) - ( x < y );
+}
+
+// The number of distinct pages marked, or PE_ERR_NOMEM if the list
+// couldn't hold them all.
+static int
+pages_count( struct pages *pg, uint64_t *count ){
+    size_t n = 0;
+
+    qsort( pg->v, pg->n, sizeof( uint64_t ), cmp_u64 );
+    for( size_t i = 0; i < pg->n; i++ ){
+        n += 0 == i || pg->v[i] != pg->v[ i - 1 ];
+    }
+    free( pg->v );
+    *count = n;
+    return pg->rc;
+}
+
+static uint32_t
+irelative_type( unsigned machine ){
+    switch( machine ){
+        case EM_X86_64:     return R_X86_64_IRELATIVE;
+        case EM_AARCH64:    return R_AARCH64_IRELATIVE;
+        case EM_386:        return R_386_IRELATIVE;
+        case EM_ARM:        return R_ARM_IRELATIVE;
+        default:            return UINT32_MAX;
+    }
+}
+
+// Count one dynamic relocation table into h and mark the pages it writes.
+static bool
+count_table( struct pe_file const *f, int64_t tag, struct pe_reloc_hist *h, struct pages *pg ){
+    struct pe_reloc_iter it;
+    struct pe_reloc r;
+
+    if( PE_OK != pe_dynamic_relocs( f, tag, &it ) ){
+        return false;
+    }
+    pe_reloc_count( it, h );
+    while( pe_reloc_next( &it, &r ) ){
+        pages_mark( r.offset, pg );
+    }
+    return true;
+}
+
+int
+startup_analyse( struct startup_obj *o ){
+    // Eager tables, and the PLT table, counted separately.
+    static _Thread_local struct pe_reloc_hist h, plt;
+    struct pe_file *f;
+    Elf64_Dyn const *dyn;
+    unsigned char const *syms, *strs, *relr;
+    size_t ndyn, nsyms, sym_entsize, strs_len, relr_len, word;
+    struct pages pg;
+    uint32_t irel;
+    bool bind_now;
+    int rc;
+
+    if( PE_OK != ( rc = pe_open( o->path, &o->f ) ) ){
+        o->f = NULL;
+        return rc;
+    }
+    f = o->f;
+    for( size_t i = 0; i < pe_phnum( f ); i++ ){
+        Elf64_Phdr const *ph = pe_phdr( f, i );
+        unsigned char const *p;
+        if( PT_INTERP == ph->p_type && PE_OK == pe_file_range( f, ph->p_offset, ph->p_filesz, &p ) ){
+            o->interp = pe_string( p, ph->p_filesz, 0 );
+        }
+    }
+    if( PE_OK != pe_dynamic( f, &dyn, &ndyn ) ){
+        return PE_OK;               // Static: the loader isn't involved
+    }
+    o->has_hash = PE_OK == pe_dynhash_open( f, &o->hash );
+    // DT_SYMBOLIC and DT_BIND_NOW carry no value; only presence counts.
+    o->symbolic = pe_dynamic_value( dyn, ndyn, DT_FLAGS, 0 ) & DF_SYMBOLIC;
+    bind_now = ( pe_dynamic_value( dyn, ndyn, DT_FLAGS, 0 ) & DF_BIND_NOW )
+            || ( pe_dynamic_value( dyn, ndyn, DT_FLAGS_1, 0 ) & DF_1_NOW );
+    for( size_t i = 0; i < ndyn; i++ ){
+        o->symbolic = o->symbolic || DT_SYMBOLIC == dyn[i].d_tag;
+        bind_now = bind_now || DT_BIND_NOW == dyn[i].d_tag;
+    }
+    // Constructor arrays hold one address-sized pointer per entry.
+    word = ELFCLASS32 == pe_ehdr( f )->e_ident[EI_CLASS] ? 4 : 8;
+    o->own.init = ( 0 != pe_dynamic_value( dyn, ndyn, DT_INIT, 0 ) )
+            + pe_dynamic_value( dyn, ndyn, DT_INIT_ARRAYSZ, 0 ) / word;
+    o->own.preinit = pe_dynamic_value( dyn, ndyn, DT_PREINIT_ARRAYSZ, 0 ) / word;
+
+    pe_dynamic_symtab( f, &syms, &nsyms, &sym_entsize );
+    pe_dynamic_strtab( f, &strs, &strs_len );
+    pages_init( &pg, f );
+    memset( &h, 0, sizeof( h ) );
+    memset( &plt, 0, sizeof( plt ) );
+    h.nsyms = plt.nsyms = nsyms;
+    h.sym_refs = calloc( nsyms + 1, sizeof( uint32_t ) );
+    assert( NULL != h.sym_refs );
+    // PLT lookups only happen now under immediate binding.
+    plt.sym_refs = bind_now ? h.sym_refs : NULL;
+
+    count_table( f, DT_RELA, &h, &pg );
+    count_table( f, DT_REL, &h, &pg );
+    count_table( f, DT_JMPREL, &plt, &pg );
+
+    // IFUNC relocations have no symbol and run their resolver even under
+    // lazy binding.
+    irel = irelative_type( pe_ehdr( f )->e_machine );
+    if( irel < PE_RELOC_NTYPES ){
+        o->own.irelative = h.by_type[irel] + plt.by_type[irel];
+    }
+    o->own.relative = h.no_symbol - ( irel < PE_RELOC_NTYPES ? h.by_type[irel] : 0 );
+    o->own.symbolic = h.count - h.no_symbol;
+    if( bind_now ){
+        o->own.symbolic += plt.count - plt.no_symbol;
+    }else{
+        o->own.plt_lazy = plt.count - plt.no_symbol;
+    }
+    if( PE_OK == pe_dynamic_relr( f, &relr, &relr_len ) ){
+        o->own.relative += pe_relr_count( pe_variant( f ), relr, relr_len );
+        pe_relr_foreach( pe_variant( f ), relr, relr_len, pages_mark, &pg );
+    }
+    rc = pages_count( &pg, &o->own.pages );
+
+    // Keep just the referenced symbols' names and counts.
+    for( size_t i = 1; i < nsyms; i++ ){
+        o->nrefs += 0 != h.sym_refs[i];
+    }
+    o->ref_names = malloc( o->nrefs * sizeof( char const * ) + 1 );
+    o->ref_counts = malloc( o->nrefs * sizeof( uint32_t ) + 1 );
+    assert( NULL != o->ref_names && NULL != o->ref_counts );
+    o->nrefs = 0;
+    for( size_t i = 1; i < nsyms; i++ ){
+        Elf64_Sym sym;
+        if( 0 == h.sym_refs[i] ){
+            continue;
+        }
+        pe_sym_read( pe_variant( f ), syms + i * sym_entsize, &sym );
+        char const *name = pe_string( strs, strs_len, sym.st_name );
+        if( name ){
+            o->ref_names[ o->nrefs ] = name;
+            o->ref_counts[ o->nrefs ] = h.sym_refs[i];
+            o->nrefs++;
+        }
+    }
+    free( h.sym_refs );
+    return rc;
+}
+
+static bool
+defines( struct startup_obj const *o, char const *name ){
+    return o->has_hash && pe_dynhash_lookup( &o->hash, name, NULL );
+}
+
+static void
+cost_add( struct startup_cost *sum, struct startup_cost const *c ){
+    sum->relative += c->relative;
+    sum->irelative += c->irelative;
+    sum->symbolic += c->symbolic;
+    sum->probes += c->probes;
+    sum->unresolved += c->unresolved;
+    sum->plt_lazy += c->plt_lazy;
+    sum->init += c->init;
+    sum->preinit += c->preinit;
+    sum->pages += c->pages;
+}
+
+void
+startup_cost( struct startup_obj *const *objs, size_t n,
+        struct startup_cost *per_obj, struct startup_cost *total ){
+    *total = (struct startup_cost){ 0 };
+    for( size_t i = 0; i < n; i++ ){
+        struct startup_obj const *o = objs[i];
+        struct startup_cost c = o->own;
+
+        if( i > 0 ){
+            c.preinit = 0;          // Only the executable's are run
+        }
+        for( size_t k = 0; k < o->nrefs; k++ ){
+            char const *name = o->ref_names[k];
+            uint64_t probes = 0;
+            bool found = false;
+
+            if( o->symbolic ){
+                probes++;
+                found = defines( o, name );
+            }
+            for( size_t j = 0; j < n && !found; j++ ){
+                probes++;
+                found = defines( objs[j], name );
+            }
+            c.probes += probes * o->ref_counts[k];
+            c.unresolved += found ? 0 : o->ref_counts[k];
+        }
+        per_obj[i] = c;
+        cost_add( total, &c );
+    }
+}
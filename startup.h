@@ -0,0 +1,73 @@
+/* startup.h
+ *
+ * Estimate of the work the dynamic loader does before main(), from the
+ * files alone.  For every object in a program (the executable and its
+ * DT_NEEDED closure, see deps.h) this counts:
+ *
+ *   relative    Relocations without a symbol (DT_RELA / DT_REL entries with
+ *               symbol 0, and DT_RELR).  Cheap: an add per entry.
+ *   irelative   IFUNC relocations, each a call into a resolver.
+ *   symbolic    Relocations that need a symbol lookup now, including PLT
+ *               entries when the object is bound immediately (DT_BIND_NOW,
+ *               DF_BIND_NOW, DF_1_NOW).
+ *   probes      Objects whose hash tables those lookups consult: a lookup
+ *               walks the global scope in load order until an object
+ *               defines the symbol, so a symbol defined by the last object
+ *               costs as many probes as there are objects.
+ *   unresolved  Lookups that no object in the scope satisfies, which for a
+ *               loadable program are the weak references left at zero.
+ *   plt_lazy    PLT entries left for lazy binding at first call.
+ *   init        DT_INIT plus DT_INIT_ARRAY constructors; preinit is
+ *               DT_PREINIT_ARRAY, which only the executable's counts.
+ *   pages       Distinct 4 KiB pages written by relocation, each a
+ *               copy-on-write fault.
+ */
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint64_t
+
+struct startup;
+struct startup_obj;
+
+struct startup_cost {
+    uint64_t relative;
+    uint64_t irelative;
+    uint64_t symbolic;
+    uint64_t probes;
+    uint64_t unresolved;
+    uint64_t plt_lazy;
+    uint64_t init;
+    uint64_t preinit;
+    uint64_t pages;
+};
+
+struct startup *startup_create( void );
+void startup_destroy( struct startup *s );
+
+// The object for path, created on first use.  Not thread-safe.
+struct startup_obj *startup_object( struct startup *s, char const *path );
+
+// Every object created so far, for handing out to startup_analyse().
+struct startup_obj *const *startup_objects( struct startup *s, size_t *n );
+
+// Open and count one object.  Objects are independent, so this can run on
+// any number of them in parallel, but only once per object.  Returns
+// pe_open()'s error for an object that can't be opened, which then counts
+// as doing nothing, or PE_ERR_NOMEM if its written pages couldn't all be
+// tracked, which leaves its page count short.
+int startup_analyse( struct startup_obj *o );
+
+char const *startup_path( struct startup_obj const *o );
+
+// The executable's PT_INTERP, or NULL.
+char const *startup_interp( struct startup_obj const *o );
+
+// Costs for the program whose global scope is objs[0..n) in load order,
+// objs[0] being the executable: one entry per object in per_obj, and their
+// sum in total.  All objects must have been analysed.  Thread-safe.
+void startup_cost( struct startup_obj *const *objs, size_t n,
+        struct startup_cost *per_obj, struct startup_cost *total );
+
+#endif // STARTUP_H
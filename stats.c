@@ -0,0 +1,363 @@
+/* stats.c
+ *
+ * Per-phase cost accounting, see stats.h.
+ *
+ * Each thread keeps the samples of the file it is working on and opens its
+ * own counter group on first use, since perf_event_open(2) counters with
+ * pid 0 follow the thread that opened them.  Only finishing a file takes
+ * the lock, to fold its phases into the totals and write its records and
+ * trace events.
+ */
+
+#define _GNU_SOURCE     // RUSAGE_THREAD, syscall(2)
+#include <stdio.h>      // fprintf(3)
+#include <stdlib.h>     // malloc(3)
+#include <string.h>     // strlen(3), memset(3)
+#include <inttypes.h>   // PRIu64
+#include <unistd.h>     // syscall(2), read(2), close(2), getpid(2), STDERR_FILENO
+#include <fcntl.h>      // open(2)
+#include <time.h>       // clock_gettime(3)
+#include <pthread.h>    // pthread_mutex_lock(3)
+#include <sys/resource.h> // getrusage(2)
+#include <sys/syscall.h>  // SYS_perf_event_open
+#include <linux/perf_event.h> // struct perf_event_attr
+#include "stats.h"
+#include "records.h"
+#include "obuf.h"
+#include "pool.h"
+
+#define STATS_SLOWEST (10)          // Files listed in the summary
+#define STATS_MAX_SPANS (32)        // Traced phases per file; the rest are dropped
+
+static char const *const phase_names[STATS_NPHASES] = {
+    [STATS_OPEN]        = "open",
+    [STATS_HEADER]      = "header",
+    [STATS_PHDRS]       = "phdrs",
+    [STATS_HUGE_PAGES]  = "huge_pages",
+    [STATS_SHDRS]       = "shdrs",
+    [STATS_STRTABS]     = "strtabs",
+    [STATS_SYMBOLS]     = "symbols",
+    [STATS_RELOCS]      = "relocs",
+    [STATS_RECORDS]     = "records",
+    [STATS_LOOKUP]      = "lookup",
+    [STATS_RESIDENCY]   = "residency",
+    [STATS_CLOSE]       = "close",
+};
+
+// The hardware events, in the order of the group's read(2) values.
+static uint64_t const hw_events[] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+};
+#define NHW (sizeof( hw_events ) / sizeof( hw_events[0] ))
+
+static bool enabled;                // Either of the two below
+static bool report;                 // --stats
+static int format;                  // enum rec_format
+static bool tracing;                // --trace
+
+// Totals, under lock.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct obuf err_ob;
+static uint64_t nfiles, nskipped;
+static uint64_t calls[STATS_NPHASES];
+static struct stats_sample totals[STATS_NPHASES];
+static bool hw_seen;                // Some thread got its counters
+static struct slow {
+    char *path;
+    uint64_t wall_ns;
+} slowest[STATS_SLOWEST];
+static struct obuf trace_ob;
+static uint64_t trace_t0;           // CLOCK_MONOTONIC at stats_trace()
+
+// The calling thread's counters and current file.
+static _Thread_local struct {
+    bool hw_tried;
+    int hw_fd[NHW];                 // -1 where the event isn't available; [0] leads
+    char const *path;
+    unsigned used;                  // Bit per phase run for this file
+    struct stats_sample start[STATS_NPHASES];
+    struct stats_sample sum[STATS_NPHASES];
+
+    // Tracing only.
+    int tid;                        // 0 until this thread's first trace event
+    uint64_t file_start;
+    size_t nspans;
+    struct span {
+        enum stats_phase ph;
+        uint64_t start, dur;
+    } spans[STATS_MAX_SPANS];
+} ts;
+
+static void
+hw_open( void ){
+    ts.hw_tried = true;
+    for( size_t i = 0; i < NHW; i++ ){
+        struct perf_event_attr attr = {
+            .type = PERF_TYPE_HARDWARE,
+            .size = sizeof( attr ),
+            .config = hw_events[i],
+            .read_format = PERF_FORMAT_GROUP,
+            .exclude_kernel = 1,
+            .exclude_hv = 1,
+        };
+        int leader = 0 == i ? -1 : ts.hw_fd[0];
+        ts.hw_fd[i] = 0 == i || -1 != leader
+                    ? syscall( SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC )
+                    : -1;
+    }
+    if( -1 != ts.hw_fd[0] ){
+        pthread_mutex_lock( &lock );
+        hw_seen = true;
+        pthread_mutex_unlock( &lock );
+    }
+}
+
+static uint64_t
+ns( clockid_t clk ){
+    struct timespec t;
+    clock_gettime( clk, &t );
+    return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+static void
+sample( struct stats_sample *s ){
+    struct rusage ru;
+    uint64_t v[1 + NHW] = { 0 };        // nr, then the values of the events that opened
+
+    if( !ts.hw_tried ){
+        hw_open();
+    }
+    s->wall_ns = ns( CLOCK_MONOTONIC );
+    s->cpu_ns = ns( CLOCK_THREAD_CPUTIME_ID );
+    getrusage( RUSAGE_THREAD, &ru );
+    s->minflt = ru.ru_minflt;
+    s->majflt = ru.ru_majflt;
+    if( -1 == ts.hw_fd[0] || read( ts.hw_fd[0], v, sizeof( v ) ) < (ssize_t)sizeof( uint64_t ) ){
+        memset( v, 0, sizeof( v ) );
+    }
+    // Members that failed to open aren't in the group's values.
+    uint64_t hw[NHW] = { 0 };
+    for( size_t i = 0, k = 1; i < NHW; i++ ){
+        if( -1 != ts.hw_fd[i] && k <= v[0] ){
+            hw[i] = v[k++];
+        }
+    }
+    s->cycles = hw[0];
+    s->instructions = hw[1];
+    s->cache_misses = hw[2];
+}
+
+static void
+add( struct stats_sample *sum, struct stats_sample const *end, struct stats_sample const *start ){
+    sum->wall_ns += end->wall_ns - start->wall_ns;
+    sum->cpu_ns += end->cpu_ns - start->cpu_ns;
+    sum->minflt += end->minflt - start->minflt;
+    sum->majflt += end->majflt - start->majflt;
+    sum->cycles += end->cycles - start->cycles;
+    sum->instructions += end->instructions - start->instructions;
+    sum->cache_misses += end->cache_misses - start->cache_misses;
+}
+
+void
+stats_enable( int fmt ){
+    enabled = report = true;
+    format = fmt;
+    ob_init_fd( &err_ob, STDERR_FILENO );
+    rec_write_stream_header( &err_ob, format );
+}
+
+bool
+stats_trace( char const *path ){
+    int fd = open( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+
+    if( -1 == fd ){
+        return false;
+    }
+    ob_init_fd( &trace_ob, fd );
+    // Name the process up front, so every later event can start with a comma.
+    ob_printf(&trace_ob, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"parse_elf\"}}",
+            (int)getpid());
+    trace_t0 = ns( CLOCK_MONOTONIC );
+    enabled = tracing = true;
+    return true;
+}
+
+bool
+stats_enabled( void ){
+    return enabled;
+}
+
+char const *
+stats_phase_name( enum stats_phase ph ){
+    return phase_names[ph];
+}
+
+void
+stats_file_begin( char const *path ){
+    if( !enabled ){
+        return;
+    }
+    ts.path = path;
+    ts.used = 0;
+    memset( ts.sum, 0, sizeof( ts.sum ) );
+    if( tracing ){
+        ts.file_start = ns( CLOCK_MONOTONIC );
+        ts.nspans = 0;
+    }
+}
+
+void
+stats_begin( enum stats_phase ph ){
+    if( enabled ){
+        sample( &ts.start[ph] );
+    }
+}
+
+void
+stats_end( enum stats_phase ph ){
+    struct stats_sample end;
+
+    if( !enabled ){
+        return;
+    }
+    sample( &end );
+    add( &ts.sum[ph], &end, &ts.start[ph] );
+    ts.used |= 1u << ph;
+    if( tracing && ts.nspans < STATS_MAX_SPANS ){
+        ts.spans[ ts.nspans++ ] = (struct span){
+            ph, ts.start[ph].wall_ns, end.wall_ns - ts.start[ph].wall_ns };
+    }
+}
+
+// Keep the STATS_SLOWEST files with the most wall time, slowest first.
+static void
+note_slow( char const *path, uint64_t wall_ns ){
+    size_t i = STATS_SLOWEST;
+
+    if( wall_ns <= slowest[ STATS_SLOWEST - 1 ].wall_ns ){
+        return;
+    }
+    free( slowest[ STATS_SLOWEST - 1 ].path );
+    while( i > 1 && wall_ns > slowest[ i - 2 ].wall_ns ){
+        slowest[ i - 1 ] = slowest[ i - 2 ];
+        i--;
+    }
+    slowest[ i - 1 ] = (struct slow){ strdup( path ), wall_ns };
+}
+
+// Microseconds since stats_trace(), the unit of trace event timestamps.
+static void
+trace_us( char const *key, uint64_t t ){
+    ob_printf(&trace_ob, ",\"%s\":%"PRIu64".%03u", key, t / 1000, (unsigned)( t % 1000 ));
+}
+
+// One complete ("X") event, without its closing brace.
+static void
+trace_span( char const *name, char const *cat, uint64_t start, uint64_t dur ){
+    ob_printf(&trace_ob, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d",
+            name, cat, (int)getpid(), ts.tid);
+    trace_us( "ts", start - trace_t0 );
+    trace_us( "dur", dur );
+}
+
+// The current file as a span on this thread with its phases nested inside,
+// under lock.  A thread's first events are preceded by its name.
+static void
+trace_file( bool ok ){
+    uint64_t end = ns( CLOCK_MONOTONIC );
+    size_t len = strlen( ts.path );
+
+    if( 0 == ts.tid ){
+        int id = pool_worker_id();
+        ts.tid = syscall( SYS_gettid );
+        ob_printf(&trace_ob, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"name\":\"", (int)getpid(), ts.tid);
+        if( -1 == id ){
+            ob_printf(&trace_ob, "main\"}}");
+        }else{
+            ob_printf(&trace_ob, "worker %d\"}}", id);
+        }
+    }
+    trace_span( "file", "file", ts.file_start, end - ts.file_start );
+    ob_printf(&trace_ob, ",\"args\":{\"path\":");
+    rec_json_string( &trace_ob, ts.path, len );
+    ob_printf(&trace_ob, ",\"ok\":%s}}", ok ? "true" : "false");
+    for( size_t i = 0; i < ts.nspans; i++ ){
+        trace_span( phase_names[ ts.spans[i].ph ], "phase", ts.spans[i].start, ts.spans[i].dur );
+        ob_printf(&trace_ob, ",\"args\":{\"path\":");
+        rec_json_string( &trace_ob, ts.path, len );
+        ob_printf(&trace_ob, "}}");
+    }
+}
+
+void
+stats_file_end( bool ok ){
+    uint64_t wall = 0;
+
+    if( !enabled ){
+        return;
+    }
+    pthread_mutex_lock( &lock );
+    nfiles += ok;
+    nskipped += !ok;
+    for( unsigned ph = 0; ph < STATS_NPHASES; ph++ ){
+        if( ts.used & ( 1u << ph ) ){
+            struct stats_sample zero = { 0 };
+            calls[ph]++;
+            add( &totals[ph], &ts.sum[ph], &zero );
+            wall += ts.sum[ph].wall_ns;
+        }
+    }
+    if( report && ok && REC_TEXT == format ){
+        note_slow( ts.path, wall );
+    }else if( report && ok ){
+        rec_write_stats( &err_ob, format, ts.path, ts.sum, ts.used );
+    }
+    if( tracing ){
+        trace_file( ok );
+    }
+    pthread_mutex_unlock( &lock );
+}
+
+void
+stats_report( void ){
+    if( tracing ){
+        ob_printf(&trace_ob, "\n]}\n");
+        ob_free( &trace_ob );
+        close( trace_ob.fd );
+        tracing = false;
+    }
+    if( !report ){
+        return;
+    }
+    if( REC_TEXT == format ){
+        ob_printf(&err_ob, "Stats\n");
+        ob_printf(&err_ob, "\tFiles = %"PRIu64", Skipped = %"PRIu64", Counters = %s\n\n",
+                nfiles, nskipped, hw_seen ? "cycles, instructions, cache misses" : "unavailable");
+        ob_printf(&err_ob, "%-12s %10s %12s %12s %10s %8s %14s %14s %14s\n",
+                "phase", "calls", "wall ms", "cpu ms", "minflt", "majflt",
+                "cycles", "instructions", "cache misses");
+        ob_printf(&err_ob, "%-12s %10s %12s %12s %10s %8s %14s %14s %14s\n",
+                "============", "==========", "============", "============", "==========",
+                "========", "==============", "==============", "==============");
+        for( unsigned ph = 0; ph < STATS_NPHASES; ph++ ){
+            struct stats_sample const *t = &totals[ph];
+            if( 0 == calls[ph] ){
+                continue;
+            }
+            ob_printf(&err_ob, "%-12s %10"PRIu64" %12.3f %12.3f %10"PRIu64" %8"PRIu64
+                    " %14"PRIu64" %14"PRIu64" %14"PRIu64"\n",
+                    phase_names[ph], calls[ph], t->wall_ns / 1e6, t->cpu_ns / 1e6,
+                    t->minflt, t->majflt, t->cycles, t->instructions, t->cache_misses);
+        }
+        ob_printf(&err_ob, "\nSlowest files\n\n");
+        for( size_t i = 0; i < STATS_SLOWEST && slowest[i].path; i++ ){
+            ob_printf(&err_ob, "%12.3f ms  %s\n", slowest[i].wall_ns / 1e6, slowest[i].path);
+            free( slowest[i].path );
+        }
+    }
+    ob_free( &err_ob );
+}
@@ -0,0 +1,80 @@
+/* stats.h
+ *
+ * Per-phase cost accounting for --stats.  parse_file() brackets each phase
+ * of each file with stats_begin() / stats_end(), and for every phase the
+ * thread that ran it records:
+ *
+ *   wall_ns       CLOCK_MONOTONIC time
+ *   cpu_ns        CLOCK_THREAD_CPUTIME_ID time
+ *   minflt        Minor and major page faults, from getrusage(RUSAGE_THREAD)
+ *   majflt
+ *   cycles        User-space hardware counters from perf_event_open(2), one
+ *   instructions  group per thread; 0 where the kernel or the
+ *   cache_misses  perf_event_paranoid setting doesn't allow them
+ *
+ * A file's phases are written as it finishes, as "stats" records in any
+ * of the --format formats (see records.h).  With text instead, the totals
+ * per phase and the slowest files are printed once at the end.  Either way
+ * the output goes to stderr, so it can't mix with the listing.
+ *
+ * With --trace the same brackets also become Chrome trace events (the JSON
+ * object format that Perfetto and chrome://tracing load): a "file" span per
+ * file on the thread that parsed it, named after its pool worker, with a
+ * span per phase inside.  Failed files are traced too, with "ok":false.
+ *
+ * Everything is a no-op until stats_enable() or stats_trace() has been
+ * called.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>     // uint64_t
+#include <stdbool.h>    // bool
+
+enum stats_phase {
+    STATS_OPEN = 0,     // pe_open(): map, check and convert the headers
+    STATS_HEADER,       // The listing's sections, in order
+    STATS_PHDRS,
+    STATS_HUGE_PAGES,
+    STATS_SHDRS,
+    STATS_STRTABS,
+    STATS_SYMBOLS,
+    STATS_RELOCS,
+    STATS_RECORDS,      // The ELF headers and strings as --format records
+    STATS_LOOKUP,       // --lookup or --address
+    STATS_RESIDENCY,    // --residency
+    STATS_CLOSE,        // pe_close()
+    STATS_NPHASES
+};
+
+struct stats_sample {
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    uint64_t minflt;
+    uint64_t majflt;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t cache_misses;
+};
+
+// Start accounting; format is an enum rec_format, REC_TEXT for the summary.
+void stats_enable( int format );
+// Start tracing into path; false if it can't be created.
+bool stats_trace( char const *path );
+bool stats_enabled( void );
+
+char const *stats_phase_name( enum stats_phase ph );
+
+// Bracket one file, on the thread that parses it.  ok says whether it was
+// parsed; files that weren't still count towards the totals.
+void stats_file_begin( char const *path );
+void stats_file_end( bool ok );
+
+// Bracket one phase of the current file.  A phase run twice adds up.
+void stats_begin( enum stats_phase ph );
+void stats_end( enum stats_phase ph );
+
+// Print the summary (text format only), finish the trace and flush.
+void stats_report( void );
+
+#endif // STATS_H
@@ -0,0 +1,179 @@
+/* strtab.c
+ *
+ * String-table boundary scanning, see strtab.h.
+ *
+ * All kernels do the same thing: compare a block of bytes against zero,
+ * turn the comparison into a bitmask and then either popcount the mask
+ * (counting) or peel off its set bits (scanning).  The SIMD versions only
+ * differ in block width; the remainder of a table is always handled by the
+ * scalar loop.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>     // malloc(3)
+#include <pthread.h>    // pthread_once(3)
+#include "strtab.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>  // _mm_*, _mm256_*
+#endif
+
+typedef size_t (*count_fn)( unsigned char const *tab, size_t n );
+typedef size_t (*scan_fn)( unsigned char const *tab, size_t n, uint32_t *starts );
+
+// Count NULs in tab[0, n).
+static size_t
+count_nuls_scalar( unsigned char const *tab, size_t n ){
+    size_t k = 0;
+    for( size_t i = 0; i < n; i++ ){
+        k += ( 0 == tab[i] );
+    }
+    return k;
+}
+
+// For every NUL at tab[p], p < n, record p+1 as the start of the next string.
+static size_t
+scan_nuls_scalar( unsigned char const *tab, size_t n, uint32_t *starts ){
+    size_t k = 0;
+    for( size_t i = 0; i < n; i++ ){
+        if( 0 == tab[i] ){
+            starts[k++] = (uint32_t)( i + 1 );
+        }
+    }
+    return k;
+}
+
+#if defined(__x86_64__)
+
+static size_t
+count_nuls_sse2( unsigned char const *tab, size_t n ){
+    __m128i const zero = _mm_setzero_si128();
+    size_t k = 0, i = 0;
+    for( ; i + 16 <= n; i += 16 ){
+        __m128i v = _mm_loadu_si128( (__m128i const *)( tab + i ) );
+        unsigned mask = (unsigned)_mm_movemask_epi8( _mm_cmpeq_epi8( v, zero ) );
+        k += __builtin_popcount( mask );
+    }
+    return k + count_nuls_scalar( tab + i, n - i );
+}
+
+static size_t
+scan_nuls_sse2( unsigned char const *tab, size_t n, uint32_t *starts ){
+    __m128i const zero = _mm_setzero_si128();
+    size_t k = 0, i = 0;
+    for( ; i + 16 <= n; i += 16 ){
+        __m128i v = _mm_loadu_si128( (__m128i const *)( tab + i ) );
+        unsigned mask = (unsigned)_mm_movemask_epi8( _mm_cmpeq_epi8( v, zero ) );
+        while( mask ){
+            starts[k++] = (uint32_t)( i + __builtin_ctz( mask ) + 1 );
+            mask &= mask - 1;
+        }
+    }
+    for( ; i < n; i++ ){
+        if( 0 == tab[i] ){
+            starts[k++] = (uint32_t)( i + 1 );
+        }
+    }
+    return k;
+}
+
+__attribute__((target("avx2")))
+static size_t
+count_nuls_avx2( unsigned char const *tab, size_t n ){
+    __m256i const zero = _mm256_setzero_si256();
+    size_t k = 0, i = 0;
+    for( ; i + 32 <= n; i += 32 ){
+        __m256i v = _mm256_loadu_si256( (__m256i const *)( tab + i ) );
+        unsigned mask = (unsigned)_mm256_movemask_epi8( _mm256_cmpeq_epi8( v, zero ) );
+        k += __builtin_popcount( mask );
+    }
+    return k + count_nuls_scalar( tab + i, n - i );
+}
+
+__attribute__((target("avx2")))
+static size_t
+scan_nuls_avx2( unsigned char const *tab, size_t n, uint32_t *starts ){
+    __m256i const zero = _mm256_setzero_si256();
+    size_t k = 0, i = 0;
+    for( ; i + 32 <= n; i += 32 ){
+        __m256i v = _mm256_loadu_si256( (__m256i const *)( tab + i ) );
+        unsigned mask = (unsigned)_mm256_movemask_epi8( _mm256_cmpeq_epi8( v, zero ) );
+        while( mask ){
+            starts[k++] = (uint32_t)( i + __builtin_ctz( mask ) + 1 );
+            mask &= mask - 1;
+        }
+    }
+    for( ; i < n; i++ ){
+        if( 0 == tab[i] ){
+            starts[k++] = (uint32_t)( i + 1 );
+        }
+    }
+    return k;
+}
+
+#endif // __x86_64__
+
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+static count_fn count_nuls = count_nuls_scalar;
+static scan_fn scan_nuls = scan_nuls_scalar;
+static char const *kernel_name = "scalar";
+
+static void
+pick_kernel( void ){
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) ){
+        count_nuls = count_nuls_avx2;
+        scan_nuls = scan_nuls_avx2;
+        kernel_name = "avx2";
+    }else if( __builtin_cpu_supports( "sse2" ) ){
+        count_nuls = count_nuls_sse2;
+        scan_nuls = scan_nuls_sse2;
+        kernel_name = "sse2";
+    }
+#endif
+}
+
+size_t
+strtab_count( unsigned char const *tab, size_t len ){
+    pthread_once( &kernel_once, pick_kernel );
+    if( 0 == len ){
+        return 0;
+    }
+    // A NUL in the last byte ends the last string rather than starting one.
+    return 1 + count_nuls( tab, len - 1 );
+}
+
+size_t
+strtab_scan( unsigned char const *tab, size_t len, uint32_t *starts ){
+    pthread_once( &kernel_once, pick_kernel );
+    if( 0 == len ){
+        return 0;
+    }
+    starts[0] = 0;
+    return 1 + scan_nuls( tab, len - 1, starts + 1 );
+}
+
+uint32_t *
+strtab_index( unsigned char const *tab, size_t len, size_t *count ){
+    uint32_t *starts;
+
+    *count = 0;
+    if( 0 == len || len > STRTAB_MAX_LEN ){
+        return NULL;
+    }
+    // Counting first costs a second pass over the table but keeps the
+    // array exact instead of sizing it for the worst case of len entries.
+    starts = malloc( strtab_count( tab, len ) * sizeof( uint32_t ) );
+    if( NULL == starts ){
+        return NULL;
+    }
+    *count = strtab_scan( tab, len, starts );
+    return starts;
+}
+
+char const *
+strtab_kernel( void ){
+    pthread_once( &kernel_once, pick_kernel );
+    return kernel_name;
+}
@@ -0,0 +1,33 @@
+/* strtab.h
+ *
+ * String-table boundary scanning.  A string table is a run of
+ * NUL-terminated strings; the index is the offset (relative to the start of
+ * the table) of every string in it.  The scan kernel is picked once at run
+ * time: AVX2 or SSE2 on x86-64 when the CPU has them, scalar otherwise.
+ */
+#ifndef STRTAB_H
+#define STRTAB_H
+
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint32_t
+
+// Largest table strtab_index() will index; offsets are stored as uint32_t.
+#define STRTAB_MAX_LEN ((size_t)UINT32_MAX)
+
+// Number of strings in tab[0, len).  Every string starts either at offset 0
+// or just after a NUL; a final string without a terminating NUL counts.
+size_t strtab_count( unsigned char const *tab, size_t len );
+
+// Write the offset of every string in tab[0, len) to starts, which must
+// have room for strtab_count( tab, len ) entries.  Returns the count.
+size_t strtab_scan( unsigned char const *tab, size_t len, uint32_t *starts );
+
+// Allocate and fill an exactly-sized offset array.  Returns NULL (and a
+// count of 0) for an empty table or one longer than STRTAB_MAX_LEN.  The
+// caller frees the array.
+uint32_t *strtab_index( unsigned char const *tab, size_t len, size_t *count );
+
+// Name of the kernel in use: "avx2", "sse2" or "scalar".
+char const *strtab_kernel( void );
+
+#endif // STRTAB_H
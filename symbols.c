@@ -0,0 +1,306 @@
+/* symbols.c
+ *
+ * Address-sorted symbol index, see libparse_elf.h.
+ *
+ * Symbols are kept as a struct of arrays sorted by address, so a scan over
+ * addresses touches only the value array.  Sorting is an LSD radix sort on
+ * the 64-bit values that skips byte positions on which every key agrees
+ * (usually the top three or four).  Lookups don't binary search the sorted
+ * array directly; they walk a copy of the values in Eytzinger (BFS) order,
+ * which keeps the first levels of every search in the same few cache lines
+ * and lets the loop run without unpredictable branches.
+ *
+ * The two passes over the file's own table are stamped out once per
+ * variant (see variant.h); pe_symtab_build() picks the pair to use.
+ */
+
+#include <stdlib.h>     // malloc(3), calloc(3), aligned_alloc(3), free(3)
+#include <string.h>     // memcpy(3)
+#include <stdbool.h>    // bool
+#include "libparse_elf.h"
+#include "variant.h"
+
+#define EYT_ALIGN (64)         // A cache line of eyt[], 8 values
+
+struct pe_symtab {
+    size_t n;
+    uint64_t *value;            // Sorted ascending
+    uint64_t *size;
+    uint32_t *name;             // Offsets into strtab
+    uint8_t *info;
+    uint32_t *shndx;
+
+    unsigned char const *strtab;
+    size_t strtab_len;
+
+    uint64_t *eyt;              // eyt[1..n]: values in Eytzinger order,
+                                // cache line aligned
+    uint32_t *eyt_rank;         // Sorted position of each eyt[] entry
+};
+
+// Symbols that name an address: defined, and not section, file or TLS
+// symbols (whose values are not addresses).
+static bool
+is_address_symbol( Elf64_Sym const *s ){
+    unsigned type = ELF64_ST_TYPE( s->st_info );
+    return SHN_UNDEF != s->st_shndx
+        && SHN_ABS != s->st_shndx
+        && STT_SECTION != type
+        && STT_FILE != type
+        && STT_TLS != type;
+}
+
+// Sort perm[0, n) by keys[perm[i]], stable, using tmp as scratch.
+static void
+radix_sort( uint64_t const *keys, uint32_t *perm, uint32_t *tmp, size_t n ){
+    uint64_t all_or = 0, all_and = ~(uint64_t)0;
+
+    for( size_t i = 0; i < n; i++ ){
+        all_or |= keys[i];
+        all_and &= keys[i];
+    }
+    for( unsigned shift = 0; shift < 64; shift += 8 ){
+        size_t count[256] = { 0 };
+
+        // Every key has the same byte here; this pass would be a copy.
+        if( 0 == ( ( ( all_or ^ all_and ) >> shift ) & 0xff ) ){
+            continue;
+        }
+        for( size_t i = 0; i < n; i++ ){
+            count[ ( keys[ perm[i] ] >> shift ) & 0xff ]++;
+        }
+        for( size_t b = 0, sum = 0; b < 256; b++ ){
+            size_t c = count[b];
+            count[b] = sum;
+            sum += c;
+        }
+        for( size_t i = 0; i < n; i++ ){
+            tmp[ count[ ( keys[ perm[i] ] >> shift ) & 0xff ]++ ] = perm[i];
+        }
+        memcpy( perm, tmp, n * sizeof( uint32_t ) );
+    }
+}
+
+// In-order walk of the implicit tree rooted at k, handing out sorted
+// positions starting at i.  Returns the next unused position.
+static size_t
+eyt_fill( struct pe_symtab *st, size_t i, size_t k ){
+    if( k <= st->n ){
+        i = eyt_fill( st, i, 2 * k );
+        st->eyt[k] = st->value[i];
+        st->eyt_rank[k] = (uint32_t)i;
+        i = eyt_fill( st, i + 1, 2 * k + 1 );
+    }
+    return i;
+}
+
+void
+pe_symtab_free( struct pe_symtab *st ){
+    if( NULL == st ){
+        return;
+    }
+    free( st->value );
+    free( st->size );
+    free( st->name );
+    free( st->info );
+    free( st->shndx );
+    free( st->eyt );
+    free( st->eyt_rank );
+    free( st );
+}
+
+// Steps 1 and 3 of pe_symtab_build(), the ones that read the file's table.
+// collect() also says whether any kept symbol has its section index in an
+// SHT_SYMTAB_SHNDX table.
+#define SYMTAB_PASSES( sfx, id, bits, enc ) \
+static size_t \
+collect_##sfx( unsigned char const *data, size_t entsize, size_t nsyms, \
+        uint64_t *keys, uint32_t *symno, uint32_t *order, bool *xindex ){ \
+    size_t n = 0; \
+    for( size_t i = 0; i < nsyms; i++ ){ \
+        Elf64_Sym s; \
+        pe_sym_##sfx( data + i * entsize, &s ); \
+        if( is_address_symbol( &s ) ){ \
+            *xindex |= SHN_XINDEX == s.st_shndx; \
+            keys[n] = s.st_value; \
+            symno[n] = (uint32_t)i; \
+            order[n] = (uint32_t)n; \
+            n++; \
+        } \
+    } \
+    return n; \
+} \
+static void \
+scatter_##sfx( struct pe_symtab *st, unsigned char const *data, size_t entsize, \
+        uint32_t const *symno, uint32_t const *order, \
+        unsigned char const *xndx, size_t nxndx ){ \
+    for( size_t i = 0; i < st->n; i++ ){ \
+        Elf64_Sym s; \
+        uint32_t x; \
+        pe_sym_##sfx( data + symno[ order[i] ] * entsize, &s ); \
+        st->value[i] = s.st_value; \
+        st->size[i] = s.st_size; \
+        st->name[i] = s.st_name; \
+        st->info[i] = s.st_info; \
+        st->shndx[i] = s.st_shndx; \
+        if( SHN_XINDEX == s.st_shndx && symno[ order[i] ] < nxndx ){ \
+            memcpy( &x, xndx + 4 * symno[ order[i] ], 4 ); \
+            st->shndx[i] = PE_GET( enc, x ); \
+        } \
+    } \
+}
+
+PE_VARIANTS( SYMTAB_PASSES )
+
+static struct {
+    size_t (*collect)( unsigned char const *data, size_t entsize, size_t nsyms,
+            uint64_t *keys, uint32_t *symno, uint32_t *order, bool *xindex );
+    void (*scatter)( struct pe_symtab *st, unsigned char const *data, size_t entsize,
+            uint32_t const *symno, uint32_t const *order,
+            unsigned char const *xndx, size_t nxndx );
+} const passes[] = {
+#define SYMTAB_PASS_ENTRY( sfx, id, bits, enc ) \
+    [id] = { collect_##sfx, scatter_##sfx },
+    PE_VARIANTS( SYMTAB_PASS_ENTRY )
+#undef SYMTAB_PASS_ENTRY
+};
+
+int
+pe_symtab_build( struct pe_file const *f, uint32_t sh_type, struct pe_symtab **out ){
+    Elf64_Shdr const *sh = NULL;
+    unsigned char const *data, *xndx = NULL;
+    size_t len, nsyms, n, symndx = 0, nxndx = 0;
+    bool xindex = false;
+    struct pe_symtab *st;
+    uint64_t *keys;
+    uint32_t *symno, *order, *tmp;
+    int rc;
+
+    *out = NULL;
+    for( size_t i = 0; i < pe_shnum( f ) && NULL == sh; i++ ){
+        if( pe_shdr( f, i )->sh_type == sh_type ){
+            sh = pe_shdr( f, i );
+            symndx = i;
+        }
+    }
+    if( NULL == sh ){
+        return PE_ERR_RANGE;
+    }
+    if( sh->sh_entsize < pe_sym_entsize( pe_variant( f ) ) ){
+        return PE_ERR_UNSUPPORTED;
+    }
+    if( PE_OK != ( rc = pe_section_data( f, sh, &data, &len ) ) ){
+        return rc;
+    }
+    nsyms = len / sh->sh_entsize;
+    if( nsyms > UINT32_MAX ){
+        return PE_ERR_RANGE;
+    }
+
+    st = calloc( 1, sizeof( struct pe_symtab ) );
+    keys = malloc( nsyms * sizeof( uint64_t ) + 1 );
+    symno = malloc( nsyms * sizeof( uint32_t ) + 1 );
+    order = malloc( nsyms * sizeof( uint32_t ) + 1 );
+    tmp = malloc( nsyms * sizeof( uint32_t ) + 1 );
+    if( NULL == st || NULL == keys || NULL == symno || NULL == order || NULL == tmp ){
+        goto nomem;
+    }
+    if( sh->sh_link < pe_shnum( f ) ){
+        pe_section_data( f, pe_shdr( f, sh->sh_link ), &st->strtab, &st->strtab_len );
+    }
+
+    // 1. Pick out the symbols worth indexing, keyed by address.
+    n = passes[ pe_variant( f ) ].collect( data, sh->sh_entsize, nsyms, keys, symno, order, &xindex );
+
+    // With more sections than st_shndx can hold, symbols say SHN_XINDEX and
+    // the real index is in a parallel SHT_SYMTAB_SHNDX table of words.  Only
+    // looked for when needed: files like that can have millions of sections.
+    for( size_t i = 0; xindex && i < pe_shnum( f ) && NULL == xndx; i++ ){
+        Elf64_Shdr const *x = pe_shdr( f, i );
+        if( SHT_SYMTAB_SHNDX == x->sh_type && symndx == x->sh_link
+                && PE_OK == pe_section_data( f, x, &xndx, &len ) ){
+            nxndx = len / 4;
+        }
+    }
+
+    // 2. Sort.
+    radix_sort( keys, order, tmp, n );
+
+    st->n = n;
+    st->value = malloc( n * sizeof( uint64_t ) + 1 );
+    st->size = malloc( n * sizeof( uint64_t ) + 1 );
+    st->name = malloc( n * sizeof( uint32_t ) + 1 );
+    st->info = malloc( n + 1 );
+    st->shndx = malloc( n * sizeof( uint32_t ) + 1 );
+    st->eyt = aligned_alloc( EYT_ALIGN,
+            ( ( n + 1 ) * sizeof( uint64_t ) + EYT_ALIGN - 1 ) & ~(size_t)( EYT_ALIGN - 1 ) );
+    st->eyt_rank = malloc( ( n + 1 ) * sizeof( uint32_t ) );
+    if( NULL == st->value || NULL == st->size || NULL == st->name || NULL == st->info
+            || NULL == st->shndx || NULL == st->eyt || NULL == st->eyt_rank ){
+        goto nomem;
+    }
+
+    // 3. Scatter the fields into sorted struct-of-arrays form.
+    passes[ pe_variant( f ) ].scatter( st, data, sh->sh_entsize, symno, order, xndx, nxndx );
+
+    // 4. Lay the values out for searching.
+    eyt_fill( st, 0, 1 );
+
+    free( keys );
+    free( symno );
+    free( order );
+    free( tmp );
+    *out = st;
+    return PE_OK;
+
+nomem:
+    free( keys );
+    free( symno );
+    free( order );
+    free( tmp );
+    pe_symtab_free( st );
+    return PE_ERR_NOMEM;
+}
+
+size_t
+pe_symtab_count( struct pe_symtab const *st ){
+    return st->n;
+}
+
+void
+pe_symtab_get( struct pe_symtab const *st, size_t i, struct pe_sym *sym ){
+    sym->value = st->value[i];
+    sym->size = st->size[i];
+    sym->name = st->name[i];
+    sym->info = st->info[i];
+    sym->shndx = st->shndx[i];
+}
+
+char const *
+pe_symtab_name( struct pe_symtab const *st, size_t i ){
+    return pe_string( st->strtab, st->strtab_len, st->name[i] );
+}
+
+ptrdiff_t
+pe_symtab_lookup( struct pe_symtab const *st, uint64_t addr ){
+    size_t k = 1, ub;
+
+    // Descend to the first value greater than addr, prefetching the 8
+    // descendants three levels down: eyt[8k, 8k + 8) is one aligned line.
+    while( k <= st->n ){
+        __builtin_prefetch( &st->eyt[ 8 * k ] );
+        k = 2 * k + ( st->eyt[k] <= addr );
+    }
+    // ...undo the trailing right turns to find where that happened...
+    k >>= __builtin_ffsll( ~(unsigned long long)k );
+    ub = k ? st->eyt_rank[k] : st->n;
+    if( 0 == ub ){
+        return -1;
+    }
+    // ...and the symbol before it is the last one starting at or below addr.
+    size_t i = ub - 1;
+    if( addr < st->value[i] + st->size[i] || addr == st->value[i] ){
+        return (ptrdiff_t)i;
+    }
+    return -1;
+}
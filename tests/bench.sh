@@ -0,0 +1,93 @@
+#!/bin/sh
+#
+# tests/bench.sh
+#
+# Build a corpus of synthetic ELF files with mkelf, each scaling one kind
+# of table into the millions.  Time the parse phases over it with
+# elfbench, then the whole listing with parse_elf --stats.  The corpus goes
+# in $BENCH_DIR if set (and is kept, and reused if already there), else in
+# a temporary directory.  $BENCH_REPS sets the runs per phase.
+
+set -eu
+
+if [ -n "${BENCH_DIR:-}" ]; then
+    dir=$BENCH_DIR
+    mkdir -p "$dir"
+else
+    dir=$( mktemp -d )
+    trap 'rm -rf "$dir"' EXIT
+fi
+
+# name: mkelf arguments
+corpus="
+syms64lsb:-n 1000000
+syms64msb:-n 1000000 -e msb
+syms32lsb:-n 1000000 -c 32
+relocs64lsb:-n 1000 -r 2000000
+relocs64msb:-n 1000 -r 2000000 -e msb
+sections65k:-S 65000
+sections64lsb:-S 1000000
+sections64msb:-S 1000000 -e msb
+segments64lsb:-P 1000000
+segments64msb:-P 1000000 -e msb
+strings:-T 67108864
+"
+
+files=""
+IFS='
+'
+for entry in $corpus; do
+    name=${entry%%:*}
+    so="$dir/$name.so"
+    if [ ! -s "$so" ]; then
+        IFS=' '
+        ./mkelf ${entry#*:} -o "$so"
+        IFS='
+'
+    fi
+    files="$files$so
+"
+done
+
+reps=${BENCH_REPS:-5}
+./elfbench -n "$reps" $files
+
+# elfbench leaves out formatting and writing the output, which the listing
+# spends most of its time on.  So run parse_elf -s -x over the same files,
+# with the output thrown away, and take each phase's best wall time (and
+# the CPU time of that run) from --stats.
+echo
+for so in $files; do
+    r=0
+    while [ "$r" -lt "$reps" ]; do
+        ./parse_elf --stats=ndjson -s -x "$so" 2>&1 >/dev/null
+        r=$(( r + 1 ))
+    done
+done | awk '
+function field( name, quoted ){
+    if( !match( $0, "\"" name "\":" ( quoted ? "\"[^\"]*\"" : "[0-9]+" ) ) ){
+        return ""
+    }
+    return substr( $0, RSTART + length( name ) + 3 + quoted, RLENGTH - length( name ) - 3 - 2 * quoted )
+}
+/"record":"file"/ {
+    file = field( "path", 1 )
+}
+/"record":"stats"/ {
+    k = file SUBSEP field( "phase", 1 )
+    wall = field( "wall_ns", 0 ) + 0
+    if( !( k in best ) ){
+        order[ n++ ] = k
+    }
+    if( !( k in best ) || wall < best[k] ){
+        best[k] = wall
+        cpu[k] = field( "cpu_ns", 0 ) + 0
+    }
+}
+END {
+    printf "%-32s %-13s %10s %10s\n", "file", "parse_elf", "best ms", "cpu ms"
+    for( i = 0; i < n; i++ ){
+        split( order[i], a, SUBSEP )
+        printf "%-32s %-13s %10.3f %10.3f\n", a[1], a[2], best[ order[i] ] / 1e6, cpu[ order[i] ] / 1e6
+    }
+}'
@@ -0,0 +1,122 @@
+/* tests/bswap_kernels.c
+ *
+ * Check every byte-swap kernel in bswap.c against a field-by-field swap of
+ * the Elf64 structs, whichever kernel the host would pick: each layout,
+ * n = 0..39 entries (so whole blocks, partial blocks and the scalar tail),
+ * unaligned tables, and in place.  Kernels the CPU can't run are reported
+ * as skipped.  Built and run by `make check`.
+ */
+
+// First, for the feature macros it defines; its kernels are static.
+#include "../bswap.c"
+#include <stdio.h>      // printf(3)
+#include <stdlib.h>     // rand(3)
+#include <elf.h>        // Elf64_*
+
+#define MAX_N (40)
+
+#define SWAP( x ) ( (x) = sizeof( x ) == 2 ? __builtin_bswap16( x ) \
+                        : sizeof( x ) == 4 ? __builtin_bswap32( x ) \
+                        : __builtin_bswap64( x ) )
+
+// The expected output, from the struct definitions rather than the layout
+// tables the kernels are built from.
+static void
+reference( enum bswap_layout l, unsigned char *dst, unsigned char const *src, size_t n ){
+    for( size_t i = 0; i < n; i++ ){
+        switch( l ){
+            case BSWAP_DYN: {
+                Elf64_Dyn d;
+                memcpy( &d, src + i * sizeof( d ), sizeof( d ) );
+                SWAP( d.d_tag ); SWAP( d.d_un.d_val );
+                memcpy( dst + i * sizeof( d ), &d, sizeof( d ) );
+                break;
+            }
+            case BSWAP_PHDR: {
+                Elf64_Phdr p;
+                memcpy( &p, src + i * sizeof( p ), sizeof( p ) );
+                SWAP( p.p_type ); SWAP( p.p_flags ); SWAP( p.p_offset ); SWAP( p.p_vaddr );
+                SWAP( p.p_paddr ); SWAP( p.p_filesz ); SWAP( p.p_memsz ); SWAP( p.p_align );
+                memcpy( dst + i * sizeof( p ), &p, sizeof( p ) );
+                break;
+            }
+            case BSWAP_SHDR: {
+                Elf64_Shdr s;
+                memcpy( &s, src + i * sizeof( s ), sizeof( s ) );
+                SWAP( s.sh_name ); SWAP( s.sh_type ); SWAP( s.sh_flags ); SWAP( s.sh_addr );
+                SWAP( s.sh_offset ); SWAP( s.sh_size ); SWAP( s.sh_link ); SWAP( s.sh_info );
+                SWAP( s.sh_addralign ); SWAP( s.sh_entsize );
+                memcpy( dst + i * sizeof( s ), &s, sizeof( s ) );
+                break;
+            }
+            case BSWAP_NLAYOUTS:
+                break;
+        }
+    }
+}
+
+static char const *const layout_names[] = {
+    [BSWAP_DYN] = "dyn", [BSWAP_PHDR] = "phdr", [BSWAP_SHDR] = "shdr",
+};
+
+// Run fn over every layout and size; the number of mismatches.
+static unsigned
+check( char const *name, swap_fn fn ){
+    static unsigned char src[ MAX_N * MAX_ENTSIZE + 64 ], want[ sizeof( src ) ];
+    static unsigned char got[ sizeof( src ) ], inplace[ sizeof( src ) ];
+    unsigned bad = 0;
+
+    for( size_t i = 0; i < sizeof( src ); i++ ){
+        src[i] = rand();
+    }
+    for( enum bswap_layout l = 0; l < BSWAP_NLAYOUTS; l++ ){
+        for( size_t n = 0; n < MAX_N; n++ ){
+            // Odd offsets: the tables needn't be aligned.
+            for( size_t off = 0; off < 3; off++ ){
+                size_t len = n * layouts[l].size;
+                reference( l, want, src + off, n );
+                memset( got, 0, sizeof( got ) );
+                fn( &layouts[l], got + off, src + off, n );
+                memcpy( inplace, src, sizeof( src ) );
+                fn( &layouts[l], inplace + off, inplace + off, n );
+                if( memcmp( got + off, want, len ) || memcmp( inplace + off, want, len ) ){
+                    printf("FAIL %s %s n=%zu offset=%zu\n", name, layout_names[l], n, off);
+                    bad++;
+                }
+            }
+        }
+    }
+    return bad;
+}
+
+int
+main( void ){
+    unsigned bad = 0;
+
+    for( enum bswap_layout l = 0; l < BSWAP_NLAYOUTS; l++ ){
+        build_masks( &layouts[l] );
+        // Otherwise the vector kernels would quietly run the scalar loop.
+        if( 0 == layouts[l].lanes ){
+            printf("FAIL %s: no shuffle masks\n", layout_names[l]);
+            bad++;
+        }
+    }
+    bad += check( "scalar", swap_scalar );
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "ssse3" ) ){
+        bad += check( "ssse3", swap_ssse3 );
+    }else{
+        printf("bswap: ssse3 skipped, not supported by this CPU\n");
+    }
+    if( __builtin_cpu_supports( "avx2" ) ){
+        bad += check( "avx2", swap_avx2 );
+    }else{
+        printf("bswap: avx2 skipped, not supported by this CPU\n");
+    }
+#endif
+    if( 0 == bad ){
+        printf("bswap: ok\n");
+    }
+    return bad ? 1 : 0;
+}
@@ -0,0 +1,193 @@
+/* variant.h
+ *
+ * Decoders for the four ELF class / data encoding combinations.  Each is
+ * written once, as a template, and PE_VARIANTS() stamps out a copy per
+ * variant, so code that walks a table picks its copy once per file (or per
+ * table) and the loop body never tests the class or the byte order.
+ *
+ * A decoder memcpy(3)s the file's struct (tables need not be aligned), then
+ * widens each field to its Elf64 counterpart in host byte order.  For the
+ * host's own variant the swaps are the identity and the whole thing
+ * compiles to the plain copy it replaces.
+ *
+ * Library-internal; the public face of this is enum pe_variant and
+ * pe_sym_read() in libparse_elf.h.
+ */
+#ifndef VARIANT_H
+#define VARIANT_H
+
+#include <stdint.h>     // uint64_t and friends
+#include <string.h>     // memcpy(3)
+#include <elf.h>        // Elf32_*, Elf64_*
+#include "libparse_elf.h"
+#include "bswap.h"
+
+// The ELF64 variant of the other byte order, whose tables have the native
+// layout and can be converted with bswap_table().
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PE_SWAPPED PE_ELF64_MSB
+#else
+#define PE_SWAPPED PE_ELF64_LSB
+#endif
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PE_LSB16( x ) ( x )
+#define PE_LSB32( x ) ( x )
+#define PE_LSB64( x ) ( x )
+#define PE_MSB16( x ) __builtin_bswap16( x )
+#define PE_MSB32( x ) __builtin_bswap32( x )
+#define PE_MSB64( x ) __builtin_bswap64( x )
+#else
+#define PE_LSB16( x ) __builtin_bswap16( x )
+#define PE_LSB32( x ) __builtin_bswap32( x )
+#define PE_LSB64( x ) __builtin_bswap64( x )
+#define PE_MSB16( x ) ( x )
+#define PE_MSB32( x ) ( x )
+#define PE_MSB64( x ) ( x )
+#endif
+
+// A field of any width in host byte order.  sizeof is a constant, so only
+// one arm survives compilation.
+#define PE_GET( enc, x ) \
+    ( sizeof( x ) == 1 ? (uint64_t)( x ) \
+    : sizeof( x ) == 2 ? (uint64_t)PE_##enc##16( x ) \
+    : sizeof( x ) == 4 ? (uint64_t)PE_##enc##32( x ) \
+    : (uint64_t)PE_##enc##64( x ) )
+
+// Signed fields (d_tag, r_addend) are sign-extended from the class width.
+#define PE_GET_SIGNED( bits, enc, x ) ( (int64_t)(int##bits##_t)PE_GET( enc, x ) )
+
+// X( sfx, id, bits, enc ) for each variant: sfx is the suffix the generated
+// functions get, id the enum pe_variant value, bits the class and enc the
+// data encoding.
+#define PE_VARIANTS( X ) \
+    X( elf64_lsb, PE_ELF64_LSB, 64, LSB ) \
+    X( elf64_msb, PE_ELF64_MSB, 64, MSB ) \
+    X( elf32_lsb, PE_ELF32_LSB, 32, LSB ) \
+    X( elf32_msb, PE_ELF32_MSB, 32, MSB )
+
+#define PE_DECODERS( sfx, id, bits, enc ) \
+static inline void \
+pe_ehdr_##sfx( unsigned char const *p, Elf64_Ehdr *d ){ \
+    Elf##bits##_Ehdr s; \
+    memcpy( &s, p, sizeof( s ) ); \
+    memcpy( d->e_ident, s.e_ident, EI_NIDENT ); \
+    d->e_type = PE_GET( enc, s.e_type ); \
+    d->e_machine = PE_GET( enc, s.e_machine ); \
+    d->e_version = PE_GET( enc, s.e_version ); \
+    d->e_entry = PE_GET( enc, s.e_entry ); \
+    d->e_phoff = PE_GET( enc, s.e_phoff ); \
+    d->e_shoff = PE_GET( enc, s.e_shoff ); \
+    d->e_flags = PE_GET( enc, s.e_flags ); \
+    d->e_ehsize = PE_GET( enc, s.e_ehsize ); \
+    d->e_phentsize = PE_GET( enc, s.e_phentsize ); \
+    d->e_phnum = PE_GET( enc, s.e_phnum ); \
+    d->e_shentsize = PE_GET( enc, s.e_shentsize ); \
+    d->e_shnum = PE_GET( enc, s.e_shnum ); \
+    d->e_shstrndx = PE_GET( enc, s.e_shstrndx ); \
+} \
+static inline void \
+pe_phdr_##sfx( unsigned char const *p, Elf64_Phdr *d ){ \
+    Elf##bits##_Phdr s; \
+    memcpy( &s, p, sizeof( s ) ); \
+    d->p_type = PE_GET( enc, s.p_type ); \
+    d->p_flags = PE_GET( enc, s.p_flags ); \
+    d->p_offset = PE_GET( enc, s.p_offset ); \
+    d->p_vaddr = PE_GET( enc, s.p_vaddr ); \
+    d->p_paddr = PE_GET( enc, s.p_paddr ); \
+    d->p_filesz = PE_GET( enc, s.p_filesz ); \
+    d->p_memsz = PE_GET( enc, s.p_memsz ); \
+    d->p_align = PE_GET( enc, s.p_align ); \
+} \
+static inline void \
+pe_shdr_##sfx( unsigned char const *p, Elf64_Shdr *d ){ \
+    Elf##bits##_Shdr s; \
+    memcpy( &s, p, sizeof( s ) ); \
+    d->sh_name = PE_GET( enc, s.sh_name ); \
+    d->sh_type = PE_GET( enc, s.sh_type ); \
+    d->sh_flags = PE_GET( enc, s.sh_flags ); \
+    d->sh_addr = PE_GET( enc, s.sh_addr ); \
+    d->sh_offset = PE_GET( enc, s.sh_offset ); \
+    d->sh_size = PE_GET( enc, s.sh_size ); \
+    d->sh_link = PE_GET( enc, s.sh_link ); \
+    d->sh_info = PE_GET( enc, s.sh_info ); \
+    d->sh_addralign = PE_GET( enc, s.sh_addralign ); \
+    d->sh_entsize = PE_GET( enc, s.sh_entsize ); \
+} \
+static inline void \
+pe_sym_##sfx( unsigned char const *p, Elf64_Sym *d ){ \
+    Elf##bits##_Sym s; \
+    memcpy( &s, p, sizeof( s ) ); \
+    d->st_name = PE_GET( enc, s.st_name ); \
+    d->st_info = s.st_info; \
+    d->st_other = s.st_other; \
+    d->st_shndx = PE_GET( enc, s.st_shndx ); \
+    d->st_value = PE_GET( enc, s.st_value ); \
+    d->st_size = PE_GET( enc, s.st_size ); \
+} \
+static inline void \
+pe_dyn_##sfx( unsigned char const *p, Elf64_Dyn *d ){ \
+    Elf##bits##_Dyn s; \
+    memcpy( &s, p, sizeof( s ) ); \
+    d->d_tag = PE_GET_SIGNED( bits, enc, s.d_tag ); \
+    d->d_un.d_val = PE_GET( enc, s.d_un.d_val ); \
+} \
+static inline void \
+pe_rel_##sfx( unsigned char const *p, bool rela, struct pe_reloc *r ){ \
+    Elf##bits##_Rela s; \
+    memcpy( &s, p, rela ? sizeof( Elf##bits##_Rela ) : sizeof( Elf##bits##_Rel ) ); \
+    uint64_t info = PE_GET( enc, s.r_info ); \
+    r->offset = PE_GET( enc, s.r_offset ); \
+    r->type = ELF##bits##_R_TYPE( info ); \
+    r->sym = ELF##bits##_R_SYM( info ); \
+    r->addend = rela ? PE_GET_SIGNED( bits, enc, s.r_addend ) : 0; \
+} \
+/* r_info alone, for loops that only count */ \
+static inline uint64_t \
+pe_rinfo_##sfx( unsigned char const *p, uint32_t *type ){ \
+    Elf##bits##_Rel s; \
+    memcpy( &s, p, sizeof( s ) ); \
+    uint64_t info = PE_GET( enc, s.r_info ); \
+    *type = ELF##bits##_R_TYPE( info ); \
+    return ELF##bits##_R_SYM( info ); \
+} \
+/* One address-sized word, as in RELR tables and GNU Bloom filters */ \
+static inline uint64_t \
+pe_word_##sfx( unsigned char const *p ){ \
+    uint##bits##_t v; \
+    memcpy( &v, p, sizeof( v ) ); \
+    return PE_GET( enc, v ); \
+} \
+static inline uint32_t \
+pe_u32_##sfx( unsigned char const *p ){ \
+    uint32_t v; \
+    memcpy( &v, p, sizeof( v ) ); \
+    return PE_GET( enc, v ); \
+}
+
+PE_VARIANTS( PE_DECODERS )
+
+// Sizes of the file's own structs, by variant.
+struct pe_variant_sizes {
+    size_t word;
+    size_t ehdr, phdr, shdr;
+    size_t sym, dyn, rel, rela;
+};
+
+#define PE_VARIANT_SIZES( sfx, id, bits, enc ) \
+    [id] = { \
+        bits / 8, \
+        sizeof( Elf##bits##_Ehdr ), sizeof( Elf##bits##_Phdr ), sizeof( Elf##bits##_Shdr ), \
+        sizeof( Elf##bits##_Sym ), sizeof( Elf##bits##_Dyn ), \
+        sizeof( Elf##bits##_Rel ), sizeof( Elf##bits##_Rela ) },
+
+static struct pe_variant_sizes const pe_variant_sizes[] = {
+    PE_VARIANTS( PE_VARIANT_SIZES )
+};
+
+// pe_dynamic() for a file whose tables were converted at open (it isn't
+// PE_NATIVE, or they were misaligned): sets the converted array and the
+// result of finding it in *rc.  False for files read in place.
+bool pe_dynamic_converted( struct pe_file const *f, Elf64_Dyn const **dyn, size_t *count, int *rc );
+
+#endif // VARIANT_H
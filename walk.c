@@ -0,0 +1,111 @@
+/* walk.c
+ *
+ * Parallel directory-tree traversal, see walk.h.
+ */
+
+#define _GNU_SOURCE     // getdents64(2), struct dirent64
+#include <stdio.h>      // fprintf(3)
+#include <stdlib.h>     // malloc(3), free(3)
+#include <string.h>     // strlen(3), memcpy(3)
+#include <assert.h>     // assert(3)
+#include <errno.h>      // errno
+#include <fcntl.h>      // open(2), O_DIRECTORY
+#include <unistd.h>     // close(2)
+#include <dirent.h>     // getdents64(2), DT_*
+#include <sys/stat.h>   // fstatat(2)
+#include "walk.h"
+
+#define DENTS_BUF_SZ (64 * 1024)
+
+// One unit of traversal work: a directory to read or a file to visit.
+struct walk_item {
+    struct pool *p;
+    walk_fn fn;
+    void *arg;
+    char path[];        // NUL terminated.
+};
+
+// Queue task on dir/name (or on dir alone if name is NULL).
+static void
+queue_item( struct pool *p, walk_fn fn, void *arg, pool_fn task, char const *dir, char const *name ){
+    size_t dlen = strlen( dir );
+    size_t nlen = name ? strlen( name ) : 0;
+    struct walk_item *w = malloc( sizeof( struct walk_item ) + dlen + 1 + nlen + 1 );
+    assert( NULL != w );
+
+    w->p = p;
+    w->fn = fn;
+    w->arg = arg;
+    memcpy( w->path, dir, dlen );
+    if( name ){
+        w->path[dlen] = '/';
+        memcpy( w->path + dlen + 1, name, nlen + 1 );
+    }else{
+        w->path[dlen] = '\0';
+    }
+    pool_submit( p, task, w );
+}
+
+static void
+walk_file_task( void *arg ){
+    struct walk_item *w = arg;
+    w->fn( w->path, w->arg );
+    free( w );
+}
+
+// Files get a task of their own rather than being visited inline so that a
+// single huge directory still spreads across every worker.
+static void
+walk_dir_task( void *arg ){
+    struct walk_item *w = arg;
+    static _Thread_local char dents[ DENTS_BUF_SZ ];
+    ssize_t nread;
+    int fd;
+
+    fd = open( w->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    if( -1 == fd ){
+        fprintf(stderr, "%s:%s:%d Unable to open directory %s (errno=%d).\n",
+                __FILE__, __func__, __LINE__, w->path, errno);
+        free( w );
+        return;
+    }
+
+    while( ( nread = getdents64( fd, dents, DENTS_BUF_SZ ) ) > 0 ){
+        for( ssize_t pos = 0; pos < nread; ){
+            struct dirent64 *d = (struct dirent64 *)( dents + pos );
+            unsigned char type = d->d_type;
+            pos += d->d_reclen;
+
+            if( '.' == d->d_name[0]
+                    && ( '\0' == d->d_name[1] || ( '.' == d->d_name[1] && '\0' == d->d_name[2] ) ) ){
+                continue;
+            }
+            // Some filesystems don't fill in d_type.
+            if( DT_UNKNOWN == type ){
+                struct stat s;
+                if( -1 == fstatat( fd, d->d_name, &s, AT_SYMLINK_NOFOLLOW ) ){
+                    continue;
+                }
+                type = S_ISDIR( s.st_mode ) ? DT_DIR :
+                       S_ISREG( s.st_mode ) ? DT_REG :
+                       DT_UNKNOWN;
+            }
+            if( DT_DIR == type ){
+                queue_item( w->p, w->fn, w->arg, walk_dir_task, w->path, d->d_name );
+            }else if( DT_REG == type ){
+                queue_item( w->p, w->fn, w->arg, walk_file_task, w->path, d->d_name );
+            }
+        }
+    }
+    if( -1 == nread ){
+        fprintf(stderr, "%s:%s:%d getdents64 failed on %s (errno=%d).\n",
+                __FILE__, __func__, __LINE__, w->path, errno);
+    }
+    close( fd );
+    free( w );
+}
+
+void
+walk_tree( struct pool *p, char const *root, walk_fn fn, void *arg ){
+    queue_item( p, fn, arg, walk_dir_task, root, NULL );
+}
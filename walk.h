@@ -0,0 +1,21 @@
+/* walk.h
+ *
+ * Parallel directory-tree traversal on top of the thread pool.  Every
+ * directory is read (getdents64(2)) by its own pool task, so many
+ * directories are in flight at once and subdirectories are picked up by
+ * whichever worker is idle.
+ */
+#ifndef WALK_H
+#define WALK_H
+
+#include "pool.h"
+
+// Called once for every regular file below the root, on a pool worker.
+// The path is only valid for the duration of the call.
+typedef void (*walk_fn)( char const *path, void *arg );
+
+// Queue a walk of the tree rooted at the directory root.  Symbolic links
+// are not followed.  Use pool_wait() to wait for the walk to finish.
+void walk_tree( struct pool *p, char const *root, walk_fn fn, void *arg );
+
+#endif // WALK_H